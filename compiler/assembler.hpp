@@ -0,0 +1,535 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <iostream>
+#include "x86.hpp"
+
+// All sections of an object file, in the order they are written.
+enum x86_section_kind_t {
+	sk_text,
+	sk_rodata,
+	sk_data,
+	sk_bss,
+	sk_count
+};
+
+// All relocation types: a 32-bit offset from the end of the field, the same
+// for a call that may go through the PLT, and a 64-bit address.
+enum x86_relocation_type_t {
+	rt_pc32,
+	rt_plt32,
+	rt_abs64
+};
+
+// A relocation: the field at an offset in a section is computed from the
+// address of a symbol plus an addend when the object is linked.
+struct x86_relocation_t {
+	long					offset;
+	x86_relocation_type_t	type;
+	std::string				symbol;
+	long					addend;
+};
+
+// A section. Bytes are not stored for .bss, only it's size.
+struct x86_section_t {
+	std::string						bytes;
+	long							size = 0;
+	long							alignment = 1;
+	std::vector<x86_relocation_t>	relocations;
+};
+
+// The definition of a symbol, at an offset in a section.
+struct x86_definition_t {
+	x86_section_kind_t	section;
+	long				offset;
+};
+
+// A run of code in the text section. A fragment starts with the padding of
+// it's alignment, followed by it's bytes, and may end in a branch whose
+// length is only known once the fragments are laid out.
+struct x86_fragment_t {
+	std::string						bytes;
+	std::vector<x86_relocation_t>	relocations;
+	std::vector<std::string>		labels;
+	long							align = 0;
+	long							limit = 0;
+	bool							branch = false;
+	x86_opcode_t					opcode = xo_jmp;
+	x86_condition_t					condition = cc_e;
+	std::string						target;
+	bool							near = false;
+	long							offset = 0;
+	long							padding = 0;
+};
+
+// The multi-byte no-ops of 1 to 10 bytes recommended by the manufacturers,
+// used to pad code to an alignment.
+const char* x86_nops[11] = {
+	"",
+	"\x90",
+	"\x66\x90",
+	"\x0f\x1f\x00",
+	"\x0f\x1f\x40\x00",
+	"\x0f\x1f\x44\x00\x00",
+	"\x66\x0f\x1f\x44\x00\x00",
+	"\x0f\x1f\x80\x00\x00\x00\x00",
+	"\x0f\x1f\x84\x00\x00\x00\x00\x00",
+	"\x66\x0f\x1f\x84\x00\x00\x00\x00\x00",
+	"\x66\x2e\x0f\x1f\x84\x00\x00\x00\x00\x00"
+};
+
+// Append an integer of a number of bytes in little-endian order.
+void x86_append_le(std::string& bytes, unsigned long value, long count) {
+	for (long i = 0; i < count; i++) {
+		bytes += (char)(value >> (8 * i));
+	}
+}
+
+// An assembler. The assembler encodes the instructions of the compiler into
+// x86-64 machine code and lays out the sections of an object file, recording
+// a relocation for every reference to a symbol. Branches to labels are
+// encoded in their short form when the target is in reach, which is only
+// known once all code is laid out: the text section is kept as fragments
+// until finish() is called.
+struct x86_assembler_t {
+	x86_section_t sections[sk_count];
+	// The definitions of all symbols, and their names in definition order.
+	std::unordered_map<std::string, x86_definition_t> definitions;
+	std::vector<std::string> defined;
+	// The symbols declared global.
+	std::unordered_set<std::string> globals;
+
+	// Default constructor.
+	x86_assembler_t() {
+		fragments.push_back(x86_fragment_t());
+	}
+
+	// Switch to a section.
+	void section(x86_section_kind_t kind) {
+		current = kind;
+	}
+
+	// Align the current position to 2^power bytes, unless that takes more
+	// than limit bytes of padding.
+	void align(long power, long limit = 0) {
+		long alignment = 1l << power;
+		x86_section_t& section = sections[current];
+		section.alignment = std::max(section.alignment, alignment);
+		if (current == sk_text) {
+			new_fragment(true);
+			fragments.back().align = alignment;
+			fragments.back().limit = limit ? limit : alignment;
+			return;
+		}
+		long padding = (alignment - section.size % alignment) % alignment;
+		zero(padding);
+	}
+
+	// Declare a symbol global.
+	void global(const std::string& symbol) {
+		globals.insert(symbol);
+	}
+
+	// Define a symbol at the current position.
+	void label(const std::string& symbol) {
+		if (definitions.count(symbol)) {
+			internal_error("symbol '" + symbol + "' is already defined");
+		}
+		defined.push_back(symbol);
+		if (current == sk_text) {
+			new_fragment(false);
+			fragments.back().labels.push_back(symbol);
+			return;
+		}
+		definitions[symbol] = {current, sections[current].size};
+	}
+
+	// Append bytes to the current section.
+	void bytes(const std::string& data, long begin, long end) {
+		sections[current].bytes.append(data, begin, end - begin);
+		sections[current].size += end - begin;
+	}
+
+	// Append zero bytes to the current section.
+	void zero(long count) {
+		if (current != sk_bss) {
+			sections[current].bytes.append(count, '\0');
+		}
+		sections[current].size += count;
+	}
+
+	// Append the 64-bit address of a symbol.
+	void quad(const std::string& symbol) {
+		x86_section_t& section = sections[current];
+		section.relocations.push_back({section.size, rt_abs64, symbol, 0});
+		zero(8);
+	}
+
+	// Append the 32-bit difference between a symbol and a base symbol defined
+	// earlier in the current section.
+	void difference(const std::string& symbol, const std::string& base) {
+		x86_section_t& section = sections[current];
+		if (!definitions.count(base) || definitions[base].section != current) {
+			internal_error("symbol '" + base + "' is not defined in the current section");
+		}
+		section.relocations.push_back({section.size, rt_pc32, symbol, section.size - definitions[base].offset});
+		zero(4);
+	}
+
+	// Encode an instruction into the text section.
+	void instruction(x86_instruction_t& instruction) {
+		x86_opcode_t opcode = instruction.opcode;
+		std::vector<x86_operand_t>& operands = instruction.operands;
+		long size = instruction.size;
+		code = &fragments.back().bytes;
+		rip_field = -1;
+		encoding = &instruction;
+		if ((opcode == xo_jmp || opcode == xo_j) && operands[0].type == ot_label) {
+			x86_fragment_t& fragment = fragments.back();
+			fragment.branch = true;
+			fragment.opcode = opcode;
+			fragment.condition = instruction.condition;
+			fragment.target = "L" + std::to_string(operands[0].label);
+			fragments.push_back(x86_fragment_t());
+			return;
+		} else if (opcode == xo_add || opcode == xo_or || opcode == xo_and || opcode == xo_sub ||
+				   opcode == xo_xor || opcode == xo_cmp)
+		{
+			long extension = opcode == xo_add ? 0 : opcode == xo_or ? 1 : opcode == xo_and ? 4 :
+							 opcode == xo_sub ? 5 : opcode == xo_xor ? 6 : 7;
+			if (operands[0].type == ot_immediate) {
+				long value = operands[0].displacement;
+				if (accumulator(operands[1]) && (size == 1 || value != (signed char)value)) {
+					// The short form of %al, %ax, %eax and %rax.
+					prefixes(size, 0, 0, 0, false);
+					*code += (char)(extension * 8 + (size == 1 ? 4 : 5));
+					immediate(value, size == 1 ? 1 : size == 2 ? 2 : 4);
+				} else if (size == 1) {
+					modrm({0x80}, size, extension, 0, operands[1], size);
+					immediate(value, 1);
+				} else if (value == (signed char)value) {
+					modrm({0x83}, size, extension, 0, operands[1], size);
+					immediate(value, 1);
+				} else {
+					modrm({0x81}, size, extension, 0, operands[1], size);
+					immediate(value, size == 2 ? 2 : 4);
+				}
+			} else if (operands[0].type == ot_register) {
+				modrm({extension * 8 + (size == 1 ? 0 : 1)}, size, operands[0].reg, size, operands[1], size);
+			} else {
+				modrm({extension * 8 + (size == 1 ? 2 : 3)}, size, operands[1].reg, size, operands[0], size);
+			}
+		} else if (opcode == xo_test) {
+			if (operands[0].type == ot_immediate && accumulator(operands[1])) {
+				prefixes(size, 0, 0, 0, false);
+				*code += (char)(size == 1 ? 0xa8 : 0xa9);
+				immediate(operands[0].displacement, size == 1 ? 1 : size == 2 ? 2 : 4);
+			} else if (operands[0].type == ot_immediate) {
+				modrm({size == 1 ? 0xf6 : 0xf7}, size, 0, 0, operands[1], size);
+				immediate(operands[0].displacement, size == 1 ? 1 : size == 2 ? 2 : 4);
+			} else if (operands[0].type == ot_register) {
+				modrm({size == 1 ? 0x84 : 0x85}, size, operands[0].reg, size, operands[1], size);
+			} else {
+				modrm({size == 1 ? 0x84 : 0x85}, size, operands[1].reg, size, operands[0], size);
+			}
+		} else if (opcode == xo_mov) {
+			if (operands[0].type == ot_immediate && operands[1].type == ot_register) {
+				long value = operands[0].displacement;
+				long reg = operands[1].reg;
+				if (size == 8 && value == (int)value) {
+					modrm({0xc7}, size, 0, 0, operands[1], size);
+					immediate(value, 4);
+				} else {
+					prefixes(size, 0, 0, reg, size == 1 && reg >= 4);
+					*code += (char)((size == 1 ? 0xb0 : 0xb8) + (reg & 7));
+					immediate(value, size);
+				}
+			} else if (operands[0].type == ot_immediate) {
+				modrm({size == 1 ? 0xc6 : 0xc7}, size, 0, 0, operands[1], size);
+				immediate(operands[0].displacement, size == 1 ? 1 : size == 2 ? 2 : 4);
+			} else if (operands[0].type == ot_register) {
+				modrm({size == 1 ? 0x88 : 0x89}, size, operands[0].reg, size, operands[1], size);
+			} else {
+				modrm({size == 1 ? 0x8a : 0x8b}, size, operands[1].reg, size, operands[0], size);
+			}
+		} else if (opcode == xo_movzb || opcode == xo_movsb || opcode == xo_movsw) {
+			long second = opcode == xo_movzb ? 0xb6 : opcode == xo_movsb ? 0xbe : 0xbf;
+			modrm({0x0f, second}, size, operands[1].reg, size, operands[0], x86_operand_size(instruction, 0));
+		} else if (opcode == xo_movsl) {
+			modrm({0x63}, 8, operands[1].reg, 8, operands[0], 4);
+		} else if (opcode == xo_lea) {
+			modrm({0x8d}, size, operands[1].reg, size, operands[0], size);
+		} else if (opcode == xo_imul && operands.size() == 1) {
+			modrm({0xf7}, size, 5, 0, operands[0], size);
+		} else if (opcode == xo_imul && operands.size() == 2) {
+			modrm({0x0f, 0xaf}, size, operands[1].reg, size, operands[0], size);
+		} else if (opcode == xo_imul) {
+			long value = operands[0].displacement;
+			if (value == (signed char)value) {
+				modrm({0x6b}, size, operands[2].reg, size, operands[1], size);
+				immediate(value, 1);
+			} else {
+				modrm({0x69}, size, operands[2].reg, size, operands[1], size);
+				immediate(value, size == 2 ? 2 : 4);
+			}
+		} else if (opcode == xo_idiv || opcode == xo_neg || opcode == xo_not) {
+			long extension = opcode == xo_idiv ? 7 : opcode == xo_neg ? 3 : 2;
+			modrm({size == 1 ? 0xf6 : 0xf7}, size, extension, 0, operands[0], size);
+		} else if (opcode == xo_cqto || opcode == xo_cltd) {
+			prefixes(opcode == xo_cqto ? 8 : 4, 0, 0, 0, false);
+			*code += (char)0x99;
+		} else if (opcode == xo_sal || opcode == xo_sar || opcode == xo_shr) {
+			long extension = opcode == xo_sal ? 4 : opcode == xo_shr ? 5 : 7;
+			if (operands[0].type == ot_register) {
+				modrm({size == 1 ? 0xd2 : 0xd3}, size, extension, 0, operands[1], size);
+			} else if (operands[0].displacement == 1) {
+				modrm({size == 1 ? 0xd0 : 0xd1}, size, extension, 0, operands[1], size);
+			} else {
+				modrm({size == 1 ? 0xc0 : 0xc1}, size, extension, 0, operands[1], size);
+				immediate(operands[0].displacement, 1);
+			}
+		} else if (opcode == xo_set) {
+			modrm({0x0f, 0x90 + instruction.condition}, 1, 0, 0, operands[0], 1);
+		} else if (opcode == xo_cmov) {
+			modrm({0x0f, 0x40 + instruction.condition}, size, operands[1].reg, size, operands[0], size);
+		} else if (opcode == xo_jmp) {
+			modrm({0xff}, 4, 4, 0, operands[0], 8);
+		} else if (opcode == xo_call && operands[0].type == ot_symbol) {
+			*code += (char)0xe8;
+			fragments.back().relocations.push_back({(long)code->size(), rt_plt32, operands[0].symbol, -4});
+			immediate(0, 4);
+		} else if (opcode == xo_call) {
+			modrm({0xff}, 4, 2, 0, operands[0], 8);
+		} else if (opcode == xo_ret) {
+			*code += (char)0xc3;
+		} else if ((opcode == xo_push || opcode == xo_pop) && operands[0].type == ot_register) {
+			long reg = operands[0].reg;
+			prefixes(4, 0, 0, reg, false);
+			*code += (char)((opcode == xo_push ? 0x50 : 0x58) + (reg & 7));
+		} else if (opcode == xo_push && operands[0].type == ot_immediate) {
+			long value = operands[0].displacement;
+			*code += (char)(value == (signed char)value ? 0x6a : 0x68);
+			immediate(value, value == (signed char)value ? 1 : 4);
+		} else if (opcode == xo_push) {
+			modrm({0xff}, 4, 6, 0, operands[0], 8);
+		} else if (opcode == xo_pop) {
+			modrm({0x8f}, 4, 0, 0, operands[0], 8);
+		} else {
+			internal_error("cannot encode instruction");
+		}
+		// A RIP-relative displacement counts from the end of the instruction.
+		if (rip_field >= 0) {
+			fragments.back().relocations.back().addend -= code->size() - rip_field;
+		}
+		encoding = nullptr;
+	}
+
+	// Lay out the text section and resolve the definitions of it's labels.
+	// Every branch starts out short and is made near once it's target turns
+	// out to be out of reach, until no more branches change; branches only
+	// ever grow, so this ends.
+	void finish() {
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			long offset = 0;
+			for (int i = 0; i < fragments.size(); i++) {
+				x86_fragment_t& fragment = fragments[i];
+				fragment.offset = offset;
+				fragment.padding = 0;
+				if (fragment.align) {
+					long padding = (fragment.align - offset % fragment.align) % fragment.align;
+					fragment.padding = padding <= fragment.limit ? padding : 0;
+				}
+				offset += fragment.padding + fragment.bytes.size() + branch_size(fragment);
+				for (int j = 0; j < fragment.labels.size(); j++) {
+					definitions[fragment.labels[j]] = {sk_text, fragment.offset + fragment.padding};
+				}
+			}
+			for (int i = 0; i < fragments.size(); i++) {
+				x86_fragment_t& fragment = fragments[i];
+				if (fragment.branch && !fragment.near) {
+					long end = fragment.offset + fragment.padding + fragment.bytes.size() + branch_size(fragment);
+					long displacement = target_offset(fragment) - end;
+					if (displacement != (signed char)displacement) {
+						fragment.near = true;
+						changed = true;
+					}
+				}
+			}
+		}
+		x86_section_t& text = sections[sk_text];
+		for (int i = 0; i < fragments.size(); i++) {
+			x86_fragment_t& fragment = fragments[i];
+			for (long padding = fragment.padding; padding > 0; padding -= 10) {
+				text.bytes.append(x86_nops[std::min(padding, 10l)], std::min(padding, 10l));
+			}
+			for (int j = 0; j < fragment.relocations.size(); j++) {
+				x86_relocation_t relocation = fragment.relocations[j];
+				relocation.offset += text.bytes.size();
+				text.relocations.push_back(relocation);
+			}
+			text.bytes += fragment.bytes;
+			if (fragment.branch) {
+				long end = text.bytes.size() + branch_size(fragment);
+				long displacement = target_offset(fragment) - end;
+				if (!fragment.near) {
+					text.bytes += (char)(fragment.opcode == xo_jmp ? 0xeb : 0x70 + fragment.condition);
+					immediate(text.bytes, displacement, 1);
+				} else if (fragment.opcode == xo_jmp) {
+					text.bytes += (char)0xe9;
+					immediate(text.bytes, displacement, 4);
+				} else {
+					text.bytes += (char)0x0f;
+					text.bytes += (char)(0x80 + fragment.condition);
+					immediate(text.bytes, displacement, 4);
+				}
+			}
+		}
+		text.size = text.bytes.size();
+		fragments.clear();
+	}
+
+private:
+	// The section being assembled.
+	x86_section_kind_t current = sk_text;
+	// The fragments of the text section.
+	std::vector<x86_fragment_t> fragments;
+	// The bytes of the fragment the instruction is encoded into.
+	std::string* code = nullptr;
+	// The position of the RIP-relative displacement of the instruction being
+	// encoded, or -1.
+	long rip_field = -1;
+	// The instruction being encoded, if any.
+	x86_instruction_t* encoding = nullptr;
+
+	// Report an internal compiler error.
+	void internal_error(std::string message) {
+		std::cerr << "internal compiler error: " << message;
+		if (encoding) {
+			output_buffer_t text;
+			x86_write_instruction(text, *encoding);
+			std::cerr << " in '" << text.data.substr(4, text.data.size() - 5) << "'";
+		}
+		std::cerr << std::endl;
+		exit(4);
+	}
+
+	// Start a new text fragment unless the last one is still empty. Labels
+	// may share a fragment with the alignment before them, but not the other
+	// way around.
+	void new_fragment(bool aligning) {
+		x86_fragment_t& fragment = fragments.back();
+		if (!fragment.bytes.empty() || fragment.branch || (aligning && (fragment.align || !fragment.labels.empty()))) {
+			fragments.push_back(x86_fragment_t());
+		}
+	}
+
+	// Get the length of the branch ending a fragment.
+	long branch_size(x86_fragment_t& fragment) {
+		if (!fragment.branch) {
+			return 0;
+		}
+		return !fragment.near ? 2 : fragment.opcode == xo_jmp ? 5 : 6;
+	}
+
+	// Get the offset of the target of the branch ending a fragment.
+	long target_offset(x86_fragment_t& fragment) {
+		auto it = definitions.find(fragment.target);
+		if (it == definitions.end() || it->second.section != sk_text) {
+			internal_error("branch to undefined label '" + fragment.target + "'");
+		}
+		return it->second.offset;
+	}
+
+	// Append an immediate of a number of bytes to the instruction.
+	void immediate(long value, long count) {
+		x86_append_le(*code, value, count);
+	}
+
+	// Append an immediate of a number of bytes to a string of code.
+	void immediate(std::string& bytes, long value, long count) {
+		x86_append_le(bytes, value, count);
+	}
+
+	// Append the legacy operand size prefix and REX prefix of an instruction.
+	// REX.W selects 64-bit operands, and an empty REX prefix is still needed
+	// to address %spl, %bpl, %sil and %dil instead of %ah to %bh.
+	void prefixes(long size, long reg, long index, long base, bool byte_register) {
+		if (size == 2) {
+			*code += (char)0x66;
+		}
+		long rex = (size == 8 ? 8 : 0) | (reg >> 3 & 1) << 2 | (index >> 3 & 1) << 1 | (base >> 3 & 1);
+		if (rex || byte_register) {
+			*code += (char)(0x40 | rex);
+		}
+	}
+
+	// Append an instruction taking a ModRM byte: it's prefixes, opcode bytes
+	// and the ModRM byte with reg in the reg field, which is a register of
+	// reg_size bytes or an opcode extension if reg_size is 0, followed by the
+	// SIB byte and displacement addressing rm, an operand of rm_size bytes.
+	void modrm(std::initializer_list<long> opcode, long size, long reg, long reg_size, x86_operand_t& rm, long rm_size) {
+		bool byte_register = (reg_size == 1 && reg >= 4) ||
+							 (rm.type == ot_register && rm_size == 1 && rm.reg >= 4);
+		if (rm.type == ot_register) {
+			prefixes(size, reg, 0, rm.reg, byte_register);
+			for (long byte : opcode) {
+				*code += (char)byte;
+			}
+			*code += (char)(0xc0 | (reg & 7) << 3 | (rm.reg & 7));
+			return;
+		} else if (rm.type != ot_memory || rm.slot >= 0 || rm.argument >= 0) {
+			internal_error("cannot encode operand");
+		}
+		prefixes(size, reg, rm.index >= 0 ? rm.index : 0, rm.reg >= 0 ? rm.reg : 0, byte_register);
+		for (long byte : opcode) {
+			*code += (char)byte;
+		}
+		long field = (reg & 7) << 3;
+		long displacement = rm.displacement;
+		if (!rm.symbol.empty()) {
+			// symbol(%rip)
+			*code += (char)(field | 5);
+			rip_field = code->size();
+			fragments.back().relocations.push_back({rip_field, rt_pc32, rm.symbol, displacement});
+			immediate(0, 4);
+			return;
+		} else if (rm.reg < 0) {
+			// displacement(,index,scale), or an absolute displacement
+			*code += (char)(field | 4);
+			*code += (char)(rm.index >= 0 ? scale_bits(rm.scale) | (rm.index & 7) << 3 | 5 : 0x25);
+			immediate(displacement, 4);
+			return;
+		}
+		// A base of %rbp or %r13 without a displacement would mean RIP or no
+		// base, so those get a zero displacement.
+		long mod = displacement == 0 && (rm.reg & 7) != 5 ? 0x00 : displacement == (signed char)displacement ? 0x40 : 0x80;
+		if (rm.index >= 0 || (rm.reg & 7) == 4) {
+			long index = rm.index >= 0 ? rm.index & 7 : 4;
+			*code += (char)(mod | field | 4);
+			*code += (char)(scale_bits(rm.index >= 0 ? rm.scale : 1) | index << 3 | (rm.reg & 7));
+		} else {
+			*code += (char)(mod | field | (rm.reg & 7));
+		}
+		if (mod == 0x40) {
+			immediate(displacement, 1);
+		} else if (mod == 0x80) {
+			immediate(displacement, 4);
+		}
+	}
+
+	// Check if an operand is the accumulator, which has short forms of the
+	// arithmetic instructions with an immediate.
+	bool accumulator(x86_operand_t& operand) {
+		return operand.type == ot_register && operand.reg == rg_rax;
+	}
+
+	// Get the scale field of a SIB byte.
+	long scale_bits(long scale) {
+		return scale == 1 ? 0x00 : scale == 2 ? 0x40 : scale == 4 ? 0x80 : 0xc0;
+	}
+};
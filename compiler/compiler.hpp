@@ -1,496 +1,1036 @@
 #pragma once
 #include <cstdio>
-#include <cstdarg>
-#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
-// A compiler.
+#include "../ir/ssa.hpp"
+#include "x86.hpp"
+#include "stack_allocator.hpp"
+#include "linear_scan.hpp"
+#include "graph_coloring.hpp"
+#include "peephole.hpp"
+#include "memory_folding.hpp"
+#include "division.hpp"
+#include "string_pool.hpp"
+#include "assembler.hpp"
+
+// A compiler. The compiler lowers IR to x86-64 assembly: instruction
+// selection produces x86-64 instructions over virtual registers, the register
+// allocator replaces the virtual registers with physical registers, and frame
+// lowering resolves frame slots and adds the prologue and epilogues. The
+// result is emitted as assembly or encoded into an object by an assembler.
 struct compiler_t {
-	std::FILE* outfile;
+	// The buffer assembly is emitted into, unless an assembler encodes the
+	// program instead.
+	output_buffer_t* output;
+	x86_assembler_t* assembler = nullptr;
 
 	// Default constructor.
-	compiler_t(program_t program, std::FILE* outfile) {
+	compiler_t(ir_program_t program, output_buffer_t* output, long optimization, bool stats, bool omit_frame_pointer) {
 		this->program = program;
-		this->outfile = outfile;
-	}
-
-	// Emit a line of assembly.
-	void emit(const char* fmt, ...) {
-		va_list args;
-		va_start(args, fmt);
-		std::vfprintf(outfile, fmt, args);
-		va_end(args);
-	}
-
-	// Compile an expression.
-	void compile_expression(expression_t* expression, symbol_table_t& symbols) {
-		if (expression->type == et_integer_literal) {
-			emit("    movq    $%s, %%rax\n", expression->integer_literal.c_str());
-		} else if (expression->type == et_string_literal) {
-			emit("    leaq    S%ld(%%rip), %%rax\n", expression->string_label);
-		} else if (expression->type == et_character_literal) {
-			emit("    movq    $%u, %%rax\n", expression->character_literal[0]);
-		} else if (expression->type == et_identifier) {
-			emit("    movq    %ld(%%rbp), %%rax\n", symbols.fetch(expression->identifier).offset);
-		} else if (expression->type == et_function_call) {
-			function_call_expression_t expr = expression->function_call;
-			if (expr.function == "sizeof") {
-				compile_expression(expr.arguments[0], symbols);
-				if (expr.arguments[0]->type == et_string_literal) {
-					emit("    movq    $%lu, %%rax\n", expr.arguments[0]->string_literal.size() * 8 + 8);
-				} else {
-					emit("    movq    $8, %%rax\n");
+		this->output = output;
+		this->optimization = optimization;
+		this->stats = stats;
+		this->omit_frame_pointer = omit_frame_pointer;
+	}
+
+	// Emit a switch to a section.
+	void emit_section(x86_section_kind_t kind) {
+		if (assembler) {
+			assembler->section(kind);
+			return;
+		}
+		#ifdef __APPLE__
+		const char* directives[sk_count] = {"    .text", "    .const", "    .data", "    .bss"};
+		#else
+		const char* directives[sk_count] = {"    .text", "    .section .rodata", "    .data", "    .bss"};
+		#endif
+		output->append(directives[kind]).end_line();
+	}
+
+	// Emit an alignment to 2^power bytes, unless that takes more than limit
+	// bytes of padding.
+	void emit_align(long power, long limit = 0) {
+		if (assembler) {
+			assembler->align(power, limit);
+			return;
+		}
+		output->append("    .p2align ").append_integer(power);
+		if (limit) {
+			output->append(",,").append_integer(limit);
+		}
+		output->end_line();
+	}
+
+	// Emit the declaration of a global symbol.
+	void emit_global(const std::string& symbol) {
+		if (assembler) {
+			assembler->global(symbol);
+			return;
+		}
+		output->append(".globl ").append(symbol).end_line();
+	}
+
+	// Emit a label definition.
+	void emit_label(const std::string& symbol) {
+		if (assembler) {
+			assembler->label(symbol);
+			return;
+		}
+		output->append(symbol).append(':').end_line();
+	}
+
+	// Emit an instruction.
+	void emit_instruction(x86_instruction_t& instruction) {
+		if (assembler) {
+			assembler->instruction(instruction);
+			return;
+		}
+		x86_write_instruction(*output, instruction);
+	}
+
+	// Emit a range of bytes of a string, optionally followed by a null
+	// terminator.
+	void emit_bytes(const std::string& data, long begin, long end, bool terminated) {
+		if (assembler) {
+			assembler->bytes(data, begin, end);
+			if (terminated) {
+				assembler->zero(1);
+			}
+			return;
+		}
+		output->append(terminated ? "    .asciz  " : "    .ascii  ");
+		x86_write_string(*output, data, begin, end);
+		output->end_line();
+	}
+
+	// Emit the 64-bit address of a symbol.
+	void emit_quad(const std::string& symbol) {
+		if (assembler) {
+			assembler->quad(symbol);
+			return;
+		}
+		output->append("    .quad   ").append(symbol).end_line();
+	}
+
+	// Emit the 32-bit offset of a label from a base label.
+	void emit_difference(long target, long base) {
+		if (assembler) {
+			assembler->difference("L" + std::to_string(target), "L" + std::to_string(base));
+			return;
+		}
+		output->append("    .long   L").append_integer(target);
+		output->append("-L").append_integer(base).end_line();
+	}
+
+	// Emit zero bytes.
+	void emit_zero(long count) {
+		if (assembler) {
+			assembler->zero(count);
+			return;
+		}
+		output->append("    .zero   ").append_integer(count).end_line();
+	}
+
+	// Append an instruction to the block being selected.
+	void append(x86_instruction_t instruction) {
+		function.blocks[block].instructions.push_back(instruction);
+	}
+
+	// Get the machine register holding an IR register.
+	long machine_register(long reg) {
+		return reg + x86_first_virtual;
+	}
+
+	// Select an operand that must be a register, materializing immediates.
+	x86_operand_t select_register(ir_operand_t operand) {
+		if (operand.type == io_register) {
+			return x86_reg(machine_register(operand.value));
+		}
+		long reg = function.create_register();
+		append(x86_make(xo_mov, 8, {x86_imm(operand.value), x86_reg(reg)}));
+		return x86_reg(reg);
+	}
+
+	// Select an operand that may be a register or a 32-bit immediate. An
+	// operation on 4 bytes only takes the lower half of an immediate.
+	x86_operand_t select_source(ir_operand_t operand, long size = 8) {
+		if (operand.type == io_immediate && size == 4) {
+			return x86_imm((int)operand.value);
+		} else if (operand.type == io_immediate && operand.value == (int)operand.value) {
+			return x86_imm(operand.value);
+		}
+		return select_register(operand);
+	}
+
+	// Get the condition code of an IR comparison.
+	x86_condition_t select_condition(ir_opcode_t opcode) {
+		if (opcode == ir_eq) {
+			return cc_e;
+		} else if (opcode == ir_ne) {
+			return cc_ne;
+		} else if (opcode == ir_lt) {
+			return cc_l;
+		} else if (opcode == ir_gt) {
+			return cc_g;
+		} else if (opcode == ir_le) {
+			return cc_le;
+		}
+		// ir_ge
+		return cc_ge;
+	}
+
+	// Select a jump to a block, omitting it if the block is next in line.
+	void select_jump(long target) {
+		if (target != block + 1) {
+			append(x86_make(xo_jmp, 8, {x86_label(function.blocks[target].label)}));
+		}
+	}
+
+	// Set the flags on a condition from the fused comparison or bit test, or
+	// else by comparing as many bytes of the condition as the size to zero,
+	// and return the condition code under which the condition holds.
+	x86_condition_t select_flags(ir_operand_t condition, long size) {
+		if (!fused) {
+			append(x86_make(xo_cmp, size, {x86_imm(0), select_register(condition)}));
+			return cc_ne;
+		}
+		ir_instruction_t* instruction = fused;
+		fused = nullptr;
+		if (instruction->opcode != ir_and) {
+			return select_compare(instruction->opcode, instruction->operands[0], instruction->operands[1], instruction->size);
+		}
+		ir_operand_t left = instruction->operands[0];
+		ir_operand_t right = instruction->operands[1];
+		if (left.type == io_immediate) {
+			std::swap(left, right);
+		}
+		append(x86_make(xo_test, instruction->size, {select_source(right, instruction->size), select_register(left)}));
+		return cc_ne;
+	}
+
+	// Select a select as a conditional move: the false value is moved into
+	// the destination first, since moves leave the flags alone, and the true
+	// value replaces it under the condition. A conditional move takes no
+	// immediate, so an immediate true value swaps places with the false
+	// value.
+	void select_select(ir_instruction_t& instruction, x86_operand_t destination) {
+		ir_operand_t if_true = instruction.operands[1];
+		ir_operand_t if_false = instruction.operands[2];
+		bool swapped = if_true.type == io_immediate && if_false.type != io_immediate;
+		if (swapped) {
+			std::swap(if_true, if_false);
+		}
+		x86_operand_t source = select_register(if_true);
+		append(x86_make(xo_mov, 8, {select_source(if_false), destination}));
+		x86_condition_t condition = select_flags(instruction.operands[0], instruction.size);
+		append(x86_make(xo_cmov, swapped ? x86_negate(condition) : condition, {source, destination}));
+	}
+
+	// Select a switch through a jump table. Subtracting the first value turns
+	// the range check into a single unsigned comparison, and the table holds
+	// 32-bit offsets from itself, so it needs no relocations.
+	void select_switch(ir_instruction_t& instruction) {
+		long index = function.create_register();
+		append(x86_make(xo_mov, 8, {select_source(instruction.operands[0]), x86_reg(index)}));
+		long first = instruction.operands[1].value;
+		if (first) {
+			append(x86_make(xo_sub, 8, {select_source(ir_immediate(first)), x86_reg(index)}));
+		}
+		x86_jump_table_t table;
+		table.label = label++;
+		for (int i = 1; i < instruction.targets.size(); i++) {
+			table.targets.push_back(function.blocks[instruction.targets[i]].label);
+		}
+		append(x86_make(xo_cmp, 8, {x86_imm(table.targets.size() - 1), x86_reg(index)}));
+		append(x86_make(xo_j, cc_a, {x86_label(function.blocks[instruction.targets[0]].label)}));
+		long base = function.create_register();
+		long offset = function.create_register();
+		append(x86_make(xo_lea, 8, {x86_rip("L" + std::to_string(table.label)), x86_reg(base)}));
+		append(x86_make(xo_movsl, 8, {x86_mem(base, index, 4), x86_reg(offset)}));
+		append(x86_make(xo_add, 8, {x86_reg(base), x86_reg(offset)}));
+		append(x86_make(xo_jmp, 8, {x86_reg(offset)}));
+		function.jump_tables.push_back(table);
+	}
+
+	// Select a comparison of two operands of a size, setting the flags, and
+	// return the condition code under which it holds. An immediate left
+	// operand is swapped to the right, where cmp accepts it.
+	x86_condition_t select_compare(ir_opcode_t opcode, ir_operand_t left, ir_operand_t right, long size) {
+		if (left.type == io_immediate && right.type != io_immediate) {
+			std::swap(left, right);
+			if (opcode == ir_lt) {
+				opcode = ir_gt;
+			} else if (opcode == ir_gt) {
+				opcode = ir_lt;
+			} else if (opcode == ir_le) {
+				opcode = ir_ge;
+			} else if (opcode == ir_ge) {
+				opcode = ir_le;
+			}
+		}
+		x86_operand_t left_register = select_register(left);
+		append(x86_make(xo_cmp, size, {select_source(right, size), left_register}));
+		return select_condition(opcode);
+	}
+
+	// Find the instruction of a block defining a register last before an
+	// index, or -1 if it is defined in another block.
+	long find_definition(std::vector<ir_instruction_t>& instructions, long before, long reg) {
+		for (long i = before - 1; i >= 0; i--) {
+			if (instructions[i].destination == reg) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	// Check if a register is defined by an instruction between two indices.
+	bool is_redefined(std::vector<ir_instruction_t>& instructions, long from, long to, long reg) {
+		for (long i = from + 1; i < to; i++) {
+			if (instructions[i].destination == reg) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Get the memory operand addressing the frame slot or symbol whose
+	// address an instruction computes.
+	x86_operand_t address_operand(ir_instruction_t& instruction) {
+		if (instruction.opcode == ir_slot_address) {
+			return x86_slot(instruction.operands[0].value);
+		}
+		return x86_rip(x86_mangle(instruction.symbol));
+	}
+
+	// Match the base register of an address to a memory operand valid at a
+	// later index of the block. A frame slot or a symbol whose address is
+	// taken in the block is addressed directly, a symbol only without an
+	// index register since RIP-relative operands take none, and the index of
+	// the address computation is added to the folded instructions when it
+	// has no other use. A constant added to the base only for this address,
+	// like the offset of a field, becomes part of the displacement. Any
+	// other base is addressed through it's register.
+	x86_operand_t match_base(std::vector<ir_instruction_t>& instructions, long before, long use, long base, bool indexed, std::vector<long>& folded) {
+		long definition = find_definition(instructions, before, base);
+		if (definition < 0) {
+			return x86_mem(machine_register(base));
+		}
+		ir_instruction_t& instruction = instructions[definition];
+		if (instruction.opcode == ir_add && instruction.size == 8 && use_counts[base] == 1 &&
+			instruction.operands[0].type == io_register && instruction.operands[1].type == io_immediate &&
+			instruction.operands[1].value == (int)instruction.operands[1].value &&
+			!is_redefined(instructions, definition, use, instruction.operands[0].value))
+		{
+			x86_operand_t address = match_base(instructions, definition, use, instruction.operands[0].value, indexed, folded);
+			address.displacement += instruction.operands[1].value;
+			folded.push_back(definition);
+			return address;
+		}
+		if (instruction.opcode != ir_slot_address && (instruction.opcode != ir_address || indexed)) {
+			return x86_mem(machine_register(base));
+		}
+		if (use_counts[base] == 1) {
+			folded.push_back(definition);
+		}
+		return address_operand(instruction);
+	}
+
+	// Match the addition at an index to a base + index * scale or base +
+	// displacement memory operand valid at a later index of the block. An
+	// index scaled by a shift is folded into the scale, and the index of the
+	// shift is added to the folded instructions when the shift has no other
+	// use. The base may be a frame slot or a symbol.
+	bool match_address(std::vector<ir_instruction_t>& instructions, long addition, long use, x86_operand_t& address, std::vector<long>& folded) {
+		ir_instruction_t& instruction = instructions[addition];
+		if (instruction.opcode != ir_add) {
+			return false;
+		}
+		// Try the operand scaled by a shift as the index first.
+		for (int pass = 0; pass < 2; pass++) {
+			for (int i = 0; i < 2; i++) {
+				ir_operand_t base = instruction.operands[i];
+				ir_operand_t index = instruction.operands[1 - i];
+				if (base.type != io_register || is_redefined(instructions, addition, use, base.value)) {
+					continue;
 				}
-			} else {
-				const char* registers[6] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
-				if (expr.arguments.size() <= 6) {
-					for (int i = 0; i < expr.arguments.size(); i++) {
-						compile_expression(expr.arguments[i], symbols);
-						emit("    pushq   %%rax\n");
-					}
-					for (int i = 0; i < expr.arguments.size(); i++) {
-						emit("    popq    %s\n", registers[expr.arguments.size() - 1 - i]);
-					}
-					#ifdef __APPLE__
-					emit("    callq   _%s\n", expr.function.c_str());
-					#else
-					emit("    callq   %s\n", expr.function.c_str());
-					#endif
-				} else {
-					for (int i = 0; i < 6; i++) {
-						compile_expression(expr.arguments[0], symbols);
-						emit("    pushq   %%rax\n");
+				if (pass == 1 && index.type == io_immediate && index.value == (int)index.value) {
+					address = match_base(instructions, addition, use, base.value, false, folded);
+					address.displacement += index.value;
+					return true;
+				} else if (index.type != io_register) {
+					continue;
+				}
+				long shift = find_definition(instructions, addition, index.value);
+				if (pass == 0 && shift >= 0) {
+					ir_instruction_t& scaled = instructions[shift];
+					if (scaled.opcode != ir_shl || scaled.operands[0].type != io_register ||
+						scaled.operands[1].type != io_immediate ||
+						scaled.operands[1].value < 0 || scaled.operands[1].value > 3 ||
+						is_redefined(instructions, shift, use, scaled.operands[0].value))
+					{
+						continue;
 					}
-					for (int i = 0; i < 6; i++) {
-						emit("    popq    %s\n", registers[5 - i]);
-						expr.arguments.erase(expr.arguments.begin());
+					if (use_counts[index.value] == 1) {
+						folded.push_back(shift);
 					}
-					for (int i = expr.arguments.size() - 1; i >= 0; i--) {
-						compile_expression(expr.arguments[i], symbols);
-						emit("    pushq   %%rax\n");
+					address = match_base(instructions, addition, use, base.value, true, folded);
+					address.index = machine_register(scaled.operands[0].value);
+					address.scale = 1l << scaled.operands[1].value;
+					return true;
+				} else if (pass == 1 && !is_redefined(instructions, addition, use, index.value)) {
+					address = match_base(instructions, addition, use, base.value, true, folded);
+					address.index = machine_register(index.value);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// Find the memory operands of the loads and stores of a block whose
+	// address is computed in the block, and the pointer additions scaling an
+	// index by a shift or offsetting a frame slot or symbol, which become a
+	// leaq. The instructions only used for these addresses are skipped; the
+	// address of a frame slot or symbol may be used by several loads and
+	// stores, like those of an increment, before it is.
+	void match_addresses(std::vector<ir_instruction_t>& instructions) {
+		addresses.clear();
+		skipped.clear();
+		std::unordered_map<long, long> absorbed;
+		for (long i = 0; i < instructions.size(); i++) {
+			ir_instruction_t& instruction = instructions[i];
+			std::vector<long> folded;
+			x86_operand_t address;
+			if (instruction.opcode == ir_load || instruction.opcode == ir_store) {
+				ir_operand_t pointer = instruction.operands[0];
+				if (pointer.type != io_register) {
+					continue;
+				}
+				long addition = find_definition(instructions, i, pointer.value);
+				if (addition < 0) {
+					continue;
+				} else if (instructions[addition].opcode == ir_slot_address || instructions[addition].opcode == ir_address) {
+					address = address_operand(instructions[addition]);
+					if (++absorbed[pointer.value] == use_counts[pointer.value]) {
+						folded.push_back(addition);
 					}
-					#ifdef __APPLE__
-					emit("    callq   _%s\n", expr.function.c_str());
-					#else
-					emit("    callq   %s\n", expr.function.c_str());
-					#endif
-					emit("    addq    $%ld, %%rsp\n", expr.arguments.size() * 8);
+				} else if (!match_address(instructions, addition, i, address, folded)) {
+					continue;
+				} else if (use_counts[pointer.value] == 1) {
+					folded.push_back(addition);
+				}
+			} else if (instruction.opcode == ir_add) {
+				if (!match_address(instructions, i, i, address, folded) || folded.empty()) {
+					continue;
 				}
+			} else {
+				continue;
+			}
+			addresses[&instruction] = address;
+			for (int j = 0; j < folded.size(); j++) {
+				skipped.insert(&instructions[folded[j]]);
 			}
-		} else if (expression->type == et_binary) {
-			binary_expression_t expr = expression->binary;
-			if (expr.binary_operator == bi_addition) {
-				if (expr.left_operand->return_type.pointer_depth > 0 ||
-					expr.right_operand->return_type.pointer_depth > 0)
+		}
+	}
+
+	// Select the memory operand addressed by the pointer operand of a load or
+	// store.
+	x86_operand_t select_address(ir_instruction_t& instruction) {
+		auto it = addresses.find(&instruction);
+		if (it != addresses.end()) {
+			return it->second;
+		}
+		return x86_mem(select_register(instruction.operands[0]).reg);
+	}
+
+	// Select a division or modulo by a constant other than zero without
+	// idivq. The quotient is computed by a multiplication with the magic
+	// number of the divisor, or by shifts for powers of two, and negated for
+	// negative divisors. The remainder is the dividend minus the quotient
+	// times the divisor. A 4-byte dividend is sign-extended and divided as 8
+	// bytes, which gives the same lower half.
+	void select_constant_division(ir_opcode_t opcode, ir_operand_t dividend, long divisor, long size, x86_operand_t destination) {
+		x86_operand_t value = select_register(dividend);
+		if (size == 4) {
+			x86_operand_t extended = x86_reg(function.create_register());
+			append(x86_make(xo_movsl, 8, {value, extended}));
+			value = extended;
+			divisor = (int)divisor;
+		}
+		x86_operand_t quotient = x86_reg(function.create_register());
+		unsigned long magnitude = divisor < 0 ? -(unsigned long)divisor : divisor;
+		long log = division_log2(magnitude);
+		if (log == 0) {
+			append(x86_make(xo_mov, 8, {value, quotient}));
+		} else if (log > 0) {
+			// Add the divisor minus one to negative dividends, so the shift
+			// rounds toward zero.
+			append(x86_make(xo_mov, 8, {value, quotient}));
+			append(x86_make(xo_sar, 8, {x86_imm(63), quotient}));
+			append(x86_make(xo_shr, 8, {x86_imm(64 - log), quotient}));
+			append(x86_make(xo_add, 8, {value, quotient}));
+			append(x86_make(xo_sar, 8, {x86_imm(log), quotient}));
+		} else {
+			division_magic_t magic = division_magic(magnitude);
+			x86_operand_t multiplier = x86_reg(function.create_register());
+			x86_operand_t sign = x86_reg(function.create_register());
+			append(x86_make(xo_mov, 8, {x86_imm(magic.multiplier), multiplier}));
+			append(x86_make(xo_mov, 8, {value, x86_reg(rg_rax)}));
+			append(x86_make(xo_imul, 8, {multiplier}));
+			append(x86_make(xo_mov, 8, {x86_reg(rg_rdx), quotient}));
+			if (magic.multiplier < 0) {
+				append(x86_make(xo_add, 8, {value, quotient}));
+			}
+			if (magic.shift) {
+				append(x86_make(xo_sar, 8, {x86_imm(magic.shift), quotient}));
+			}
+			append(x86_make(xo_mov, 8, {quotient, sign}));
+			append(x86_make(xo_shr, 8, {x86_imm(63), sign}));
+			append(x86_make(xo_add, 8, {sign, quotient}));
+		}
+		if (divisor < 0) {
+			append(x86_make(xo_neg, 8, {quotient}));
+		}
+		if (opcode == ir_div) {
+			append(x86_make(xo_mov, 8, {quotient, destination}));
+			return;
+		}
+		x86_operand_t product = x86_reg(function.create_register());
+		if (divisor == (int)divisor) {
+			append(x86_make(xo_imul, 8, {x86_imm(divisor), quotient, product}));
+		} else {
+			append(x86_make(xo_mov, 8, {x86_imm(divisor), product}));
+			append(x86_make(xo_imul, 8, {quotient, product}));
+		}
+		append(x86_make(xo_mov, 8, {value, destination}));
+		append(x86_make(xo_sub, 8, {product, destination}));
+	}
+
+	// Select a function call.
+	void select_call(ir_instruction_t& instruction, x86_operand_t destination) {
+		std::vector<ir_operand_t>& arguments = instruction.operands;
+		long stack_arguments = arguments.size() > 6 ? arguments.size() - 6 : 0;
+		long padding = stack_arguments % 2 ? 8 : 0;
+		// Arguments after the sixth are pushed in reverse order, keeping the
+		// stack 16-byte aligned at the call.
+		if (padding) {
+			append(x86_make(xo_sub, 8, {x86_imm(padding), x86_reg(rg_rsp)}));
+		}
+		for (long i = arguments.size() - 1; i >= 6; i--) {
+			append(x86_make(xo_push, 8, {select_source(arguments[i])}));
+		}
+		std::vector<x86_operand_t> sources;
+		for (int i = 0; i < arguments.size() && i < 6; i++) {
+			sources.push_back(select_source(arguments[i]));
+		}
+		for (int i = 0; i < sources.size(); i++) {
+			append(x86_make(xo_mov, 8, {sources[i], x86_reg(x86_argument_registers[i])}));
+		}
+		x86_instruction_t call = x86_make(xo_call, 8, {x86_symbol(x86_mangle(instruction.symbol))});
+		call.arguments = sources.size();
+		append(call);
+		if (stack_arguments) {
+			append(x86_make(xo_add, 8, {x86_imm(stack_arguments * 8 + padding), x86_reg(rg_rsp)}));
+		}
+		append(x86_make(xo_mov, 8, {x86_reg(rg_rax), destination}));
+	}
+
+	// Select a load of a number of bytes from memory. Chars are
+	// zero-extended and shorts sign-extended into the register.
+	void select_load(x86_operand_t memory, long size, x86_operand_t destination) {
+		if (size == 1) {
+			append(x86_make(xo_movzb, 8, {memory, destination}));
+		} else if (size == 2) {
+			append(x86_make(xo_movsw, 8, {memory, destination}));
+		} else {
+			append(x86_make(xo_mov, size, {memory, destination}));
+		}
+	}
+
+	// Select a store of a number of bytes to memory. A narrow store takes the
+	// low bytes of the value.
+	void select_store(ir_operand_t value, x86_operand_t memory, long size) {
+		if (value.type == io_immediate && size == 1) {
+			value.value = (unsigned char)value.value;
+		} else if (value.type == io_immediate && size == 2) {
+			value.value = (short)value.value;
+		}
+		append(x86_make(xo_mov, size, {select_source(value, size), memory}));
+	}
+
+	// Select an instruction.
+	void select_instruction(ir_instruction_t& instruction) {
+		ir_opcode_t opcode = instruction.opcode;
+		std::vector<ir_operand_t>& operands = instruction.operands;
+		long size = instruction.size;
+		x86_operand_t destination = x86_reg(machine_register(instruction.destination));
+		if (opcode == ir_constant || opcode == ir_copy) {
+			if (operands[0].type == io_immediate) {
+				append(x86_make(xo_mov, 8, {x86_imm(operands[0].value), destination}));
+			} else {
+				append(x86_make(xo_mov, 8, {select_register(operands[0]), destination}));
+			}
+		} else if (opcode == ir_parameter) {
+			long index = operands[0].value;
+			if (index < 6) {
+				append(x86_make(xo_mov, 8, {x86_reg(x86_argument_registers[index]), destination}));
+			} else {
+				append(x86_make(xo_mov, 8, {x86_argument(index - 6), destination}));
+			}
+		} else if (opcode == ir_address) {
+			append(x86_make(xo_lea, 8, {x86_rip(x86_mangle(instruction.symbol)), destination}));
+		} else if (opcode == ir_slot_address) {
+			append(x86_make(xo_lea, 8, {x86_slot(operands[0].value), destination}));
+		} else if (opcode == ir_load_slot) {
+			long slot = operands[0].value;
+			select_load(x86_slot(slot), function.slots[slot].size, destination);
+		} else if (opcode == ir_store_slot) {
+			long slot = operands[0].value;
+			select_store(operands[1], x86_slot(slot), function.slots[slot].size);
+		} else if (opcode == ir_load) {
+			select_load(select_address(instruction), instruction.size, destination);
+		} else if (opcode == ir_store) {
+			select_store(operands[1], select_address(instruction), instruction.size);
+		} else if (opcode == ir_extend) {
+			x86_opcode_t x86_opcode = instruction.size == 1 ? xo_movsb : instruction.size == 2 ? xo_movsw : xo_movsl;
+			append(x86_make(x86_opcode, 8, {select_register(operands[0]), destination}));
+		} else if (opcode == ir_add && addresses.count(&instruction)) {
+			append(x86_make(xo_lea, 8, {addresses[&instruction], destination}));
+		} else if ((opcode == ir_div || opcode == ir_mod) && operands[1].type == io_immediate && operands[1].value != 0) {
+			select_constant_division(opcode, operands[0], operands[1].value, size, destination);
+		} else if (opcode == ir_div || opcode == ir_mod) {
+			x86_operand_t divisor = select_register(operands[1]);
+			append(x86_make(xo_mov, size, {select_source(operands[0], size), x86_reg(rg_rax)}));
+			append(x86_make(size == 4 ? xo_cltd : xo_cqto, size));
+			append(x86_make(xo_idiv, size, {divisor}));
+			append(x86_make(xo_mov, size, {x86_reg(opcode == ir_div ? rg_rax : rg_rdx), destination}));
+		} else if (opcode == ir_shl || opcode == ir_sar) {
+			x86_opcode_t x86_opcode = opcode == ir_shl ? xo_sal : xo_sar;
+			if (operands[1].type == io_immediate) {
+				append(x86_make(xo_mov, size, {select_source(operands[0], size), destination}));
+				append(x86_make(x86_opcode, size, {x86_imm(operands[1].value & (size * 8 - 1)), destination}));
+			} else {
+				x86_operand_t count = select_register(operands[1]);
+				x86_operand_t value = select_source(operands[0], size);
+				append(x86_make(xo_mov, 8, {count, x86_reg(rg_rcx)}));
+				append(x86_make(xo_mov, size, {value, destination}));
+				append(x86_make(x86_opcode, size, {x86_reg(rg_rcx), destination}));
+			}
+		} else if (ir_is_comparison(opcode)) {
+			x86_condition_t condition = select_compare(opcode, operands[0], operands[1], size);
+			append(x86_make(xo_set, condition, {destination}));
+			append(x86_make(xo_movzb, 8, {destination, destination}));
+		} else if (ir_is_binary(opcode)) {
+			x86_opcode_t x86_opcode;
+			if (opcode == ir_add) {
+				x86_opcode = xo_add;
+			} else if (opcode == ir_sub) {
+				x86_opcode = xo_sub;
+			} else if (opcode == ir_mul) {
+				x86_opcode = xo_imul;
+			} else if (opcode == ir_and) {
+				x86_opcode = xo_and;
+			} else if (opcode == ir_or) {
+				x86_opcode = xo_or;
+			} else {
+				// ir_xor
+				x86_opcode = xo_xor;
+			}
+			// Commutative operators take an immediate on the right.
+			ir_operand_t left = operands[0];
+			ir_operand_t right = operands[1];
+			if (opcode != ir_sub && left.type == io_immediate && right.type != io_immediate) {
+				std::swap(left, right);
+			}
+			if (opcode == ir_mul && right.type == io_immediate && (size == 4 || right.value == (int)right.value)) {
+				append(x86_make(xo_imul, size, {select_source(right, size), select_register(left), destination}));
+			} else {
+				x86_operand_t source = opcode == ir_mul ? select_register(right) : select_source(right, size);
+				append(x86_make(xo_mov, size, {select_source(left, size), destination}));
+				append(x86_make(x86_opcode, size, {source, destination}));
+			}
+		} else if (opcode == ir_neg || opcode == ir_not) {
+			append(x86_make(xo_mov, size, {select_source(operands[0], size), destination}));
+			append(x86_make(opcode == ir_neg ? xo_neg : xo_not, size, {destination}));
+		} else if (opcode == ir_select) {
+			select_select(instruction, destination);
+		} else if (opcode == ir_call) {
+			select_call(instruction, destination);
+		} else if (opcode == ir_jump) {
+			select_jump(instruction.targets[0]);
+		} else if (opcode == ir_branch) {
+			x86_condition_t condition = select_flags(operands[0], size);
+			long if_true = instruction.targets[0];
+			long if_false = instruction.targets[1];
+			if (if_true == block + 1) {
+				append(x86_make(xo_j, x86_negate(condition), {x86_label(function.blocks[if_false].label)}));
+			} else {
+				append(x86_make(xo_j, condition, {x86_label(function.blocks[if_true].label)}));
+				select_jump(if_false);
+			}
+		} else if (opcode == ir_switch) {
+			select_switch(instruction);
+		} else if (opcode == ir_return) {
+			append(x86_make(xo_mov, 8, {select_source(operands[0]), x86_reg(rg_rax)}));
+			append(x86_make(xo_ret, 8));
+		}
+	}
+
+	// Select the instructions of a function, translating it out of SSA form
+	// first.
+	x86_function_t select_function(ir_function_t& ir_function) {
+		ir_ssa_destructor_t().run(ir_function);
+		function = x86_function_t();
+		function.identifier = ir_function.identifier;
+		function.register_count = machine_register(ir_function.register_count);
+		for (int i = 0; i < ir_function.slots.size(); i++) {
+			function.create_slot(ir_function.slots[i].size, ir_function.slots[i].alignment);
+		}
+		std::vector<long> loop_depths = ir_loop_depths(ir_function);
+		std::vector<bool> loop_headers = ir_loop_headers(ir_function);
+		for (int i = 0; i < ir_function.blocks.size(); i++) {
+			x86_block_t x86_block;
+			x86_block.label = label++;
+			x86_block.successors = ir_successors(ir_function.blocks[i]);
+			x86_block.loop_depth = loop_depths[i];
+			x86_block.loop_header = loop_headers[i];
+			function.blocks.push_back(x86_block);
+		}
+		// Count the uses of every register, to find the comparisons that are
+		// only used by the branch right after them and the address
+		// computations only used by a single load or store.
+		use_counts.assign(ir_function.register_count, 0);
+		for (int i = 0; i < ir_function.blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = ir_function.blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				std::vector<long> uses = ir_uses(instructions[j]);
+				for (int k = 0; k < uses.size(); k++) {
+					use_counts[uses[k]]++;
+				}
+			}
+		}
+		for (block = 0; block < ir_function.blocks.size(); block++) {
+			std::vector<ir_instruction_t>& instructions = ir_function.blocks[block].instructions;
+			long count = instructions.size();
+			match_addresses(instructions);
+			for (int i = 0; i < count; i++) {
+				if (skipped.count(&instructions[i])) {
+					continue;
+				}
+				// Fuse a comparison or a bit test into the branch or select
+				// using it, which sets the flags right before the conditional
+				// jump or move.
+				if (i + 1 < count && (ir_is_comparison(instructions[i].opcode) || instructions[i].opcode == ir_and) &&
+					(instructions[i + 1].opcode == ir_branch || instructions[i + 1].opcode == ir_select) &&
+					instructions[i + 1].operands[0].type == io_register &&
+					instructions[i + 1].operands[0].value == instructions[i].destination &&
+					use_counts[instructions[i].destination] == 1)
 				{
-					compile_expression(expr.left_operand, symbols);
-					if (expr.left_operand->return_type.pointer_depth == 0) {
-						emit("    salq    $3, %%rax\n");
+					fused = &instructions[i];
+					continue;
+				}
+				select_instruction(instructions[i]);
+			}
+		}
+		return function;
+	}
+
+	// Check if a function is a leaf function, which makes no calls.
+	bool is_leaf(x86_function_t& function) {
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<x86_instruction_t>& instructions = function.blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				if (instructions[j].opcode == xo_call) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Resolve a frame slot or incoming stack argument operand, relative to
+	// a base register. The incoming stack arguments start at an offset from
+	// the base register.
+	void lower_operand(x86_function_t& function, x86_operand_t& operand, long base, long arguments) {
+		if (operand.type != ot_memory) {
+			return;
+		}
+		if (operand.slot >= 0) {
+			operand.reg = base;
+			operand.displacement += function.slots[operand.slot].offset;
+			operand.slot = -1;
+		} else if (operand.argument >= 0) {
+			operand.reg = base;
+			operand.displacement += arguments + operand.argument * 8;
+			operand.argument = -1;
+		}
+	}
+
+	// Lay out the frame of a function, resolve frame operands and insert the
+	// prologue and epilogues. The callee-saved registers are pushed right
+	// below the saved frame pointer, above the frame slots. Leaf functions
+	// get no frame pointer unless it is requested: their slots are addressed
+	// from %rsp, in the red zone below it when they fit.
+	void lower_frame(x86_function_t& function) {
+		std::vector<long>& saved = function.saved_registers;
+		bool frame_pointer = !omit_frame_pointer || !is_leaf(function);
+		// The frame pointer is 16-byte aligned, while %rsp is 8 bytes off
+		// after the return address and every saved register pushed below it,
+		// so slots are aligned relative to that bias.
+		long bias = frame_pointer ? 0 : 8 + 8 * (long)saved.size();
+		long offset = frame_pointer ? -8 * (long)saved.size() : 0;
+		for (int i = 0; i < function.slots.size(); i++) {
+			offset -= (function.slots[i].size + 7) / 8 * 8;
+			offset = ((offset + bias) & -function.slots[i].alignment) - bias;
+			function.slots[i].offset = offset;
+		}
+		// The pushed registers are part of the frame.
+		long frame_size = (-offset + 15) / 16 * 16 - 8 * saved.size();
+		long base = rg_rbp;
+		long arguments = 16;
+		if (!frame_pointer) {
+			// Leaf functions never move %rsp after the prologue, and nothing
+			// but the red zone is needed below it.
+			frame_size = -offset <= x86_red_zone ? 0 : -offset;
+			for (int i = 0; i < function.slots.size(); i++) {
+				function.slots[i].offset += frame_size;
+			}
+			base = rg_rsp;
+			arguments = frame_size + 8 * saved.size() + 8;
+		}
+
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<x86_instruction_t> instructions;
+			if (i == 0) {
+				if (frame_pointer) {
+					instructions.push_back(x86_make(xo_push, 8, {x86_reg(rg_rbp)}));
+					instructions.push_back(x86_make(xo_mov, 8, {x86_reg(rg_rsp), x86_reg(rg_rbp)}));
+				}
+				for (int j = 0; j < saved.size(); j++) {
+					instructions.push_back(x86_make(xo_push, 8, {x86_reg(saved[j])}));
+				}
+				if (frame_pointer) {
+					instructions.push_back(x86_make(xo_sub, 8, {x86_imm(frame_size), x86_reg(rg_rsp)}));
+					instructions.push_back(x86_make(xo_and, 8, {x86_imm(-16), x86_reg(rg_rsp)}));
+				} else if (frame_size) {
+					instructions.push_back(x86_make(xo_sub, 8, {x86_imm(frame_size), x86_reg(rg_rsp)}));
+				}
+			}
+			for (int j = 0; j < function.blocks[i].instructions.size(); j++) {
+				x86_instruction_t instruction = function.blocks[i].instructions[j];
+				for (int k = 0; k < instruction.operands.size(); k++) {
+					lower_operand(function, instruction.operands[k], base, arguments);
+				}
+				if (instruction.opcode == xo_ret) {
+					if (!frame_pointer) {
+						if (frame_size) {
+							instructions.push_back(x86_make(xo_add, 8, {x86_imm(frame_size), x86_reg(rg_rsp)}));
+						}
+					} else if (saved.empty()) {
+						instructions.push_back(x86_make(xo_mov, 8, {x86_reg(rg_rbp), x86_reg(rg_rsp)}));
+					} else {
+						instructions.push_back(x86_make(xo_lea, 8, {x86_mem(rg_rbp, -8 * (long)saved.size()), x86_reg(rg_rsp)}));
 					}
-					emit("    pushq   %%rax\n");
-					compile_expression(expr.right_operand, symbols);
-					if (expr.right_operand->return_type.pointer_depth == 0) {
-						emit("    salq    $3, %%rax\n");
+					for (long k = saved.size() - 1; k >= 0; k--) {
+						instructions.push_back(x86_make(xo_pop, 8, {x86_reg(saved[k])}));
+					}
+					if (frame_pointer) {
+						instructions.push_back(x86_make(xo_pop, 8, {x86_reg(rg_rbp)}));
 					}
-					emit("    popq    %%rcx\n");
-					emit("    addq    %%rcx, %%rax\n");
-				} else {
-					compile_expression(expr.left_operand, symbols);
-					emit("    pushq   %%rax\n");
-					compile_expression(expr.right_operand, symbols);
-					emit("    popq    %%rcx\n");
-					emit("    addq    %%rcx, %%rax\n");
-				}
-			} else if (expr.binary_operator == bi_subtraction) {
-				compile_expression(expr.right_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.left_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    subq    %%rcx, %%rax\n");
-			} else if (expr.binary_operator == bi_multiplication) {
-				compile_expression(expr.left_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.right_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    imulq   %%rcx, %%rax\n");
-			} else if (expr.binary_operator == bi_division) {
-				compile_expression(expr.right_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.left_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    cqto\n");
-				emit("    idivq   %%rcx\n");
-			} else if (expr.binary_operator == bi_modulo) {
-				compile_expression(expr.right_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.left_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    cqto\n");
-				emit("    idivq   %%rcx\n");
-				emit("    movq    %%rdx, %%rax\n");
-			} else if (expr.binary_operator == bi_assignment) {
-				if (expr.left_operand->type == et_identifier) {
-					compile_expression(expr.right_operand, symbols);
-					emit("    movq    %%rax, %ld(%%rbp)\n", symbols.fetch(expr.left_operand->identifier).offset);
-				} else {
-					compile_expression(expr.right_operand, symbols);
-					emit("    pushq   %%rax\n");
-					compile_expression(expr.left_operand->unary.operand, symbols);
-					emit("    popq    %%rcx\n");
-					emit("    movq    %%rcx, (%%rax)\n");
-					emit("    movq    (%%rax), %%rax\n");
 				}
-			} else if (expr.binary_operator == bi_logical_and) {
-				long l0 = label++;
-				long l1 = label++;
-				compile_expression(expr.left_operand, symbols);
-				emit("    cmpq    $0, %%rax\n");
-				emit("    jne     L%ld\n", l0);
-				emit("    jmp     L%ld\n", l1);
-				emit("L%ld:\n", l0);
-				compile_expression(expr.right_operand, symbols);
-				emit("    cmpq    $0, %%rax\n");
-				emit("    movq    $0, %%rax\n");
-				emit("    setne   %%al\n");
-				emit("L%ld:\n", l1);
-			} else if (expr.binary_operator == bi_logical_or) {
-				long l0 = label++;
-				long l1 = label++;
-				compile_expression(expr.left_operand, symbols);
-				emit("    cmpq    $0, %%rax\n");
-				emit("    je      L%ld\n", l0);
-				emit("    movq    $1, %%rax\n");
-				emit("    jmp     L%ld\n", l1);
-				emit("L%ld:\n", l0);
-				compile_expression(expr.right_operand, symbols);
-				emit("    cmpq    $0, %%rax\n");
-				emit("    movq    $0, %%rax\n");
-				emit("    setne   %%al\n");
-				emit("L%ld:\n", l1);
-			} else if (expr.binary_operator == bi_relational_equal) {
-				compile_expression(expr.left_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.right_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    cmpq    %%rcx, %%rax\n");
-				emit("    sete    %%al\n");
-				emit("    movzbq  %%al, %%rax\n");
-			} else if (expr.binary_operator == bi_relational_non_equal) {
-				compile_expression(expr.left_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.right_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    cmpq    %%rcx, %%rax\n");
-				emit("    setne   %%al\n");
-				emit("    movzbq  %%al, %%rax\n");
-			} else if (expr.binary_operator == bi_relational_greater_than) {
-				compile_expression(expr.right_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.left_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    cmpq    %%rcx, %%rax\n");
-				emit("    setg    %%al\n");
-				emit("    movzbq  %%al, %%rax\n");
-			} else if (expr.binary_operator == bi_relational_lesser_than) {
-				compile_expression(expr.right_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.left_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    cmpq    %%rcx, %%rax\n");
-				emit("    setl    %%al\n");
-				emit("    movzbq  %%al, %%rax\n");
-			} else if (expr.binary_operator == bi_relational_greater_than_or_equal_to) {
-				compile_expression(expr.right_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.left_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    cmpq    %%rcx, %%rax\n");
-				emit("    setge   %%al\n");
-				emit("    movzbq  %%al, %%rax\n");
-			} else if (expr.binary_operator == bi_relational_lesser_than_or_equal_to) {
-				compile_expression(expr.right_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.left_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    cmpq    %%rcx, %%rax\n");
-				emit("    setle   %%al\n");
-				emit("    movzbq  %%al, %%rax\n");
-			} else if (expr.binary_operator == bi_binary_and) {
-				compile_expression(expr.left_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.right_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    andq    %%rcx, %%rax\n");
-			} else if (expr.binary_operator == bi_binary_or) {
-				compile_expression(expr.left_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.right_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    orq    %%rcx, %%rax\n");
-			} else if (expr.binary_operator == bi_binary_xor) {
-				compile_expression(expr.left_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.right_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    xorq    %%rcx, %%rax\n");
-			} else if (expr.binary_operator == bi_binary_left_shift) {
-				compile_expression(expr.right_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.left_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    salq    %%cl, %%rax\n");
-			} else if (expr.binary_operator == bi_binary_right_shift) {
-				compile_expression(expr.right_operand, symbols);
-				emit("    pushq   %%rax\n");
-				compile_expression(expr.left_operand, symbols);
-				emit("    popq    %%rcx\n");
-				emit("    sarq    %%cl, %%rax\n");
-			}
-		} else if (expression->type == et_unary) {
-			unary_expression_t expr = expression->unary;
-			if (expr.unary_operator == un_value_of) {
-				compile_expression(expr.operand, symbols);
-				emit("    movq    (%%rax), %%rax\n");
-			} else if (expr.unary_operator == un_arithmetic_negative) {
-				compile_expression(expr.operand, symbols);
-				emit("    negq    %%rax\n");
-			} else if (expr.unary_operator == un_address_of) {
-				emit("    leaq    %ld(%%rbp), %%rax\n", symbols.fetch(expr.operand->identifier).offset);
-			} else if (expr.unary_operator == un_logical_not) {
-				compile_expression(expr.operand, symbols);
-				emit("    cmpq    $0, %%rax\n");
-				emit("    movq    $0, %%rax\n");
-				emit("    sete    %%al\n");
-			} else if (expr.unary_operator == un_binary_not) {
-				compile_expression(expr.operand, symbols);
-				emit("    notq    %%rax\n");
-			}
-		}
-	}
-
-	// Compile a statement.
-	void compile_statement(statement_t* statement, symbol_table_t& symbols) {
-		if (statement->type == st_compound) {
-			compound_statement_t stmt = statement->compound_stmt;
-			symbol_table_t new_symbols(&symbols);
-			for (int i = 0; i < stmt.statements.size(); i++) {
-				compile_statement(stmt.statements[i], new_symbols);
-			}
-		} else if (statement->type == st_conditional) {
-			conditional_statement_t stmt = statement->conditional_stmt;
-			long l0 = label++;
-			compile_expression(stmt.condition, symbols);
-			emit("    cmpq    $0, %%rax\n");
-			emit("    je      L%ld\n", l0);
-			symbol_table_t new_symbols(&symbols);
-			compile_statement(stmt.body, new_symbols);
-			emit("L%ld:\n", l0);
-		} else if (statement->type == st_while) {
-			while_statement_t stmt = statement->while_stmt;
-			long l0 = label++;
-			long l1 = label++;
-			emit("L%ld:\n", l0);
-			compile_expression(stmt.condition, symbols);
-			emit("    cmpq    $0, %%rax\n");
-			emit("    je      L%ld\n", l1);
-			symbol_table_t new_symbols(&symbols);
-			new_symbols.loop_break_to = l1;
-			new_symbols.loop_continue_to = l0;
-			compile_statement(stmt.body, new_symbols);
-			emit("    jmp     L%ld\n", l0);
-			emit("L%ld:\n", l1);
-		} else if (statement->type == st_return) {
-			return_statement_t stmt = statement->return_stmt;
-			compile_expression(stmt.value, symbols);
-			emit("    movq    %%rbp, %%rsp\n");
-			emit("    popq    %%rbp\n");
-			emit("    retq\n");
-		} else if (statement->type == st_variable_declaration) {
-			variable_declaration_statement_t stmt = statement->variable_declaration_stmt;
-			symbols.add_symbol(symbol_t(stmt.type, stmt.identifier, symbols.offset -= 8));
-			if (stmt.initializer) {
-				compile_expression(stmt.initializer, symbols);
-				emit("    movq    %%rax, %ld(%%rbp)\n", symbols.fetch(stmt.identifier).offset);
-			}
-		} else if (statement->type == st_expression) {
-			expression_statement_t stmt = statement->expression_stmt;
-			compile_expression(stmt.expression, symbols);
-		} else if (statement->type == st_break) {
-			emit("    jmp     L%ld\n", symbols.loop_break_to);
-		} else if (statement->type == st_continue) {
-			emit("    jmp     L%ld\n", symbols.loop_continue_to);
-		}
-	}
-
-	// Compile a function.
-	void compile_function(function_t function, symbol_table_t& symbols) {
-		#ifdef __APPLE__
-		emit(".globl _%s\n", function.identifier.c_str());
-		emit("_%s:\n", function.identifier.c_str());
-		#else
-		emit(".globl %s\n", function.identifier.c_str());
-		emit("%s:\n", function.identifier.c_str());
-		#endif
+				instructions.push_back(instruction);
+			}
+			function.blocks[i].instructions = instructions;
+		}
+	}
 
-		emit("    pushq   %%rbp\n");
-		emit("    movq    %%rsp, %%rbp\n");
-		emit("    subq    $%ld, %%rsp\n", aligned_offset(function, symbols));
-		emit("    andq    $-16, %%rsp\n");
+	// Emit a function.
+	void emit_function(x86_function_t& function) {
+		std::string identifier = x86_mangle(function.identifier);
+		emit_global(identifier);
+		emit_label(identifier);
+		for (int i = 0; i < function.blocks.size(); i++) {
+			if (i) {
+				// Align loop headers, unless that costs more than ten bytes of
+				// padding.
+				if (function.blocks[i].loop_header && optimization >= 1) {
+					emit_align(4, 10);
+				}
+				emit_label("L" + std::to_string(function.blocks[i].label));
+			}
+			for (int j = 0; j < function.blocks[i].instructions.size(); j++) {
+				emit_instruction(function.blocks[i].instructions[j]);
+			}
+		}
+		for (int i = 0; i < function.jump_tables.size(); i++) {
+			x86_jump_table_t& table = function.jump_tables[i];
+			emit_section(sk_rodata);
+			emit_align(2);
+			emit_label("L" + std::to_string(table.label));
+			for (int j = 0; j < table.targets.size(); j++) {
+				emit_difference(table.targets[j], table.label);
+			}
+			emit_section(sk_text);
+		}
+	}
 
-		symbol_table_t new_symbols(&symbols);
-		const char* registers[6] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
-		for (int i = 0; i < function.parameters.size() && i < 6; i++) {
-			emit("    movq    %s, %d(%%rbp)\n", registers[i], i * -8 - 8);
-			new_symbols.add_symbol(symbol_t(
-				function.parameters[i].type,
-				function.parameters[i].identifier,
-				i * -8 - 8
-			));
-			new_symbols.offset -= 8;
+	// Emit the string pool into read-only data, after the code. Every string
+	// taking up space of it's own is emitted once, one byte per character
+	// followed by a null terminator, with the labels of the strings sharing
+	// it's tail placed inside it. Strings of 32 bytes or more are aligned to
+	// 16 bytes, so copying or scanning them starts on a whole vector; the
+	// rest are packed.
+	void emit_strings() {
+		if (program.strings.empty()) {
+			return;
 		}
-		if (function.parameters.size() > 6) {
-			for (int i = 6; i < function.parameters.size(); i++) {
-				new_symbols.add_symbol(symbol_t(
-					function.parameters[i].type,
-					function.parameters[i].identifier,
-					(i - 6) * 8 + 16
-				));
+		std::vector<std::string>& strings = program.strings;
+		std::vector<string_pool_entry_t> entries = string_pool_layout(strings);
+		std::vector<std::vector<long>> members(strings.size());
+		std::vector<long> owners;
+		for (int i = 0; i < strings.size(); i++) {
+			members[entries[i].owner].push_back(i);
+			if (entries[i].owner == i) {
+				owners.push_back(i);
 			}
 		}
-		for (int i = 0; i < function.body.size(); i++) {
-			compile_statement(function.body[i], new_symbols);
+		std::stable_sort(owners.begin(), owners.end(), [&](long a, long b) {
+			return strings[a].size() > strings[b].size();
+		});
+		emit_section(sk_rodata);
+		for (int i = 0; i < owners.size(); i++) {
+			std::string& string = strings[owners[i]];
+			std::vector<long>& labels = members[owners[i]];
+			std::stable_sort(labels.begin(), labels.end(), [&](long a, long b) {
+				return entries[a].offset < entries[b].offset;
+			});
+			if (string.size() + 1 >= 32) {
+				emit_align(4);
+			}
+			long emitted = 0;
+			for (int j = 0; j < labels.size(); j++) {
+				long offset = entries[labels[j]].offset;
+				if (offset > emitted) {
+					emit_bytes(string, emitted, offset, false);
+					emitted = offset;
+				}
+				emit_label(x86_mangle("S" + std::to_string(labels[j])));
+			}
+			emit_bytes(string, emitted, string.size(), true);
+		}
+	}
+
+	// Emit the global variables after the code. Initialized globals go into
+	// .data, as their bytes with the addresses of symbols stored over them
+	// and zeros for the rest, and zero-initialized ones into .bss, where they
+	// take no space in the object file.
+	void emit_globals() {
+		for (int i = 0; i < program.globals.size(); i++) {
+			ir_global_t& global = program.globals[i];
+			std::string identifier = x86_mangle(global.identifier);
+			long alignment = 0;
+			while ((1l << alignment) < global.alignment) {
+				alignment++;
+			}
+			emit_global(identifier);
+			if (global.data.empty()) {
+				#ifdef __APPLE__
+				output->append("    .zerofill __DATA,__bss,").append(identifier).append(',');
+				output->append_integer(global.size).append(',').append_integer(alignment).end_line();
+				#else
+				emit_section(sk_bss);
+				emit_align(alignment);
+				emit_label(identifier);
+				emit_zero(global.size);
+				#endif
+				continue;
+			}
+			emit_section(sk_data);
+			emit_align(alignment);
+			emit_label(identifier);
+			long emitted = 0;
+			for (int j = 0; j <= global.relocations.size(); j++) {
+				long offset = j < global.relocations.size() ? global.relocations[j].offset : global.data.size();
+				if (offset > emitted) {
+					emit_bytes(global.data, emitted, offset, false);
+				}
+				if (j < global.relocations.size()) {
+					emit_quad(x86_mangle(global.relocations[j].symbol));
+					offset += 8;
+				}
+				emitted = offset;
+			}
+			if (global.size > emitted) {
+				emit_zero(global.size - emitted);
+			}
 		}
 	}
 
 	// Compile the program.
 	void compile() {
-		pack_strings();
-		symbol_table_t symbols;
-		for (int i = 0; i < program.size(); i++) {
-			function_t function = program[i];
-			symbols.add_symbol(symbol_t(
-				function.type,
-				function.identifier,
-				function.parameters
-			));
-			compile_function(function, symbols);
-		}
-	}
-
-	// Pack all the strings in an expression.
-	void pack_strings(expression_t* expression) {
-		if (expression->type == et_string_literal) {
-			long string_label = label++;
-			expression->string_label = string_label;
-			emit("S%ld:\n", string_label);
-			for (int i = 0; i < expression->string_literal.size(); i++) {
-				emit("    .quad   %u\n", (unsigned char)expression->string_literal[i]);
-			}
-			emit("    .quad   0\n");
-		} else if (expression->type == et_function_call) {
-			function_call_expression_t expr = expression->function_call;
-			for (int i = 0; i < expr.arguments.size(); i++) {
-				pack_strings(expr.arguments[i]);
-			}
-		} else if (expression->type == et_binary) {
-			pack_strings(expression->binary.left_operand);
-			pack_strings(expression->binary.right_operand);
-		} else if (expression->type == et_unary) {
-			pack_strings(expression->unary.operand);
-		}
-	}
-
-	// Pack all the strings in a statement.
-	void pack_strings(statement_t* statement) {
-		if (statement->type == st_compound) {
-			compound_statement_t stmt = statement->compound_stmt;
-			for (int i = 0; i < stmt.statements.size(); i++) {
-				pack_strings(stmt.statements[i]);
-			}
-		} else if (statement->type == st_conditional) {
-			pack_strings(statement->conditional_stmt.condition);
-			pack_strings(statement->conditional_stmt.body);
-		} else if (statement->type == st_while) {
-			pack_strings(statement->while_stmt.condition);
-			pack_strings(statement->while_stmt.body);
-		} else if (statement->type == st_return) {
-			pack_strings(statement->return_stmt.value);
-		} else if (statement->type == st_variable_declaration) {
-			variable_declaration_statement_t stmt = statement->variable_declaration_stmt;
-			if (stmt.initializer) {
-				pack_strings(stmt.initializer);
-			}
-		} else if (statement->type == st_expression) {
-			pack_strings(statement->expression_stmt.expression);
-		}
-	}
-
-	// Pack all the strings in a function.
-	void pack_strings(function_t& function) {
-		for (int i = 0; i < function.body.size(); i++) {
-			pack_strings(function.body[i]);
-		}
-	}
-
-	// Pack all the strings in the program.
-	void pack_strings() {
-		for (int i = 0; i < program.size(); i++) {
-			pack_strings(program[i]);
-		}
-	}
-
-	// Find the absolute value of the lowest RBP offset used in a statement,
-	// rounded up to a multiple of 8.
-	void aligned_offset_statement(statement_t* statement, symbol_table_t& symbols, long& lowest_offset) {
-		if (statement->type == st_compound) {
-			compound_statement_t stmt = statement->compound_stmt;
-			symbol_table_t new_symbols(&symbols);
-			for (int i = 0; i < stmt.statements.size(); i++) {
-				aligned_offset_statement(stmt.statements[i], new_symbols, lowest_offset);
-			}
-		} else if (statement->type == st_conditional) {
-			conditional_statement_t stmt = statement->conditional_stmt;
-			symbol_table_t new_symbols(&symbols);
-			aligned_offset_statement(stmt.body, new_symbols, lowest_offset);
-		} else if (statement->type == st_while) {
-			while_statement_t stmt = statement->while_stmt;
-			symbol_table_t new_symbols(&symbols);
-			aligned_offset_statement(stmt.body, new_symbols, lowest_offset);
-		} else if (statement->type == st_variable_declaration) {
-			variable_declaration_statement_t stmt = statement->variable_declaration_stmt;
-			symbols.add_symbol(symbol_t(stmt.type, stmt.identifier, symbols.offset -= 8));
-			if (symbols.offset < lowest_offset) {
-				lowest_offset = symbols.offset;
-			}
-		}
-	}
-
-	// Find the absolute value of the lowest RBP offset used in a function,
-	// rounded up to a multiple of 8.
-	long aligned_offset(function_t function, symbol_table_t& symbols) {
-		symbol_table_t new_symbols(&symbols);
-		long lowest_offset = 0;
-		for (int i = 0; i < function.body.size(); i++) {
-			aligned_offset_statement(function.body[i], new_symbols, lowest_offset);
+		for (int i = 0; i < program.functions.size(); i++) {
+			x86_function_t function = select_function(program.functions[i]);
+			memory_folder_t().run(function);
+			if (optimization == 0) {
+				stack_allocator_t().allocate(function);
+			} else if (optimization == 1) {
+				linear_scan_allocator_t allocator;
+				allocator.allocate(function);
+				if (stats) {
+					fprintf(stderr, "%s: %ld registers spilled\n", function.identifier.c_str(), allocator.spill_count);
+				}
+			} else {
+				graph_coloring_allocator_t allocator;
+				allocator.allocate(function);
+				if (stats) {
+					fprintf(stderr, "%s: %ld registers spilled, %ld moves coalesced\n", function.identifier.c_str(), allocator.spill_count, allocator.coalesced_count);
+				}
+			}
+			lower_frame(function);
+			if (optimization >= 1) {
+				peephole.run(function);
+			}
+			emit_function(function);
 		}
-
-		long params_offset;
-		if (function.parameters.size() >= 6) {
-			params_offset = 48;
-		} else {
-			params_offset = function.parameters.size() * 8;
+		emit_strings();
+		emit_globals();
+		if (assembler) {
+			assembler->finish();
 		}
-
-		long highest_offset = -lowest_offset + params_offset;
-		int remainder = highest_offset % 8;
-		if (!remainder) {
-			return highest_offset;
+		if (stats && optimization >= 1) {
+			peephole.print_stats(stderr);
 		}
-		return highest_offset + 8 - remainder;
 	}
 
 private:
 	// The program to compile.
-	program_t program;
+	ir_program_t program;
+	// The optimization level.
+	long optimization = 0;
+	// Whether to print statistics to the standard error.
+	bool stats = false;
+	// Whether leaf functions may omit the frame pointer.
+	bool omit_frame_pointer = true;
+	// The peephole optimizer, shared by all functions to count rule hits.
+	peephole_t peephole;
 	// The current label number.
 	long label = 0;
-};
\ No newline at end of file
+	// The function being selected.
+	x86_function_t function;
+	// The index of the block being selected.
+	long block = 0;
+	// The comparison fused into the branch ending the block, if any.
+	ir_instruction_t* fused = nullptr;
+	// The number of uses of every register of the function being selected.
+	std::vector<long> use_counts;
+	// The memory operands matched for the loads, stores and additions of the
+	// block being selected.
+	std::unordered_map<ir_instruction_t*, x86_operand_t> addresses;
+	// The instructions of the block being selected that were folded into
+	// memory operands.
+	std::unordered_set<ir_instruction_t*> skipped;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+// The magic number and shift replacing a signed 64-bit division by a
+// constant with a multiplication, after Granlund and Montgomery: the quotient
+// of n / d is the high half of n * multiplier, plus n when the multiplier is
+// negative, shifted right by shift, plus one when that is negative.
+struct division_magic_t {
+	long	multiplier;
+	long	shift;
+};
+
+// Check if a divisor is a power of two, returning it's logarithm or -1.
+long division_log2(unsigned long divisor) {
+	if (divisor == 0 || (divisor & (divisor - 1))) {
+		return -1;
+	}
+	long log = 0;
+	while (divisor >>= 1) {
+		log++;
+	}
+	return log;
+}
+
+// Compute the magic number of a positive divisor that is not a power of two,
+// as in Hacker's Delight 10-1.
+division_magic_t division_magic(long divisor) {
+	const unsigned long two63 = 1ul << 63;
+	unsigned long d = divisor;
+	unsigned long anc = two63 - 1 - two63 % d;
+	long p = 63;
+	unsigned long q1 = two63 / anc;
+	unsigned long r1 = two63 - q1 * anc;
+	unsigned long q2 = two63 / d;
+	unsigned long r2 = two63 - q2 * d;
+	unsigned long delta;
+	do {
+		p++;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			q1++;
+			r1 -= anc;
+		}
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= d) {
+			q2++;
+			r2 -= d;
+		}
+		delta = d - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+	return {(long)(q2 + 1), p - 64};
+}
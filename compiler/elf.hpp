@@ -0,0 +1,231 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "assembler.hpp"
+
+// ELF64 section header types and flags.
+const long elf_sht_progbits = 1;
+const long elf_sht_symtab = 2;
+const long elf_sht_strtab = 3;
+const long elf_sht_rela = 4;
+const long elf_sht_nobits = 8;
+const long elf_shf_write = 0x1;
+const long elf_shf_alloc = 0x2;
+const long elf_shf_execinstr = 0x4;
+const long elf_shf_info_link = 0x40;
+
+// ELF64 symbol bindings and types.
+const long elf_stb_local = 0;
+const long elf_stb_global = 1;
+const long elf_stt_notype = 0;
+const long elf_stt_section = 3;
+
+// x86-64 relocation types, indexed by x86_relocation_type_t.
+const long elf_relocation_types[] = {2, 4, 1};
+
+// The names, types and flags of the sections the assembler lays out, indexed
+// by x86_section_kind_t.
+const char* elf_section_names[sk_count] = {".text", ".rodata", ".data", ".bss"};
+const long elf_section_types[sk_count] = {elf_sht_progbits, elf_sht_progbits, elf_sht_progbits, elf_sht_nobits};
+const long elf_section_flags[sk_count] = {
+	elf_shf_alloc | elf_shf_execinstr,
+	elf_shf_alloc,
+	elf_shf_alloc | elf_shf_write,
+	elf_shf_alloc | elf_shf_write
+};
+
+// A section header, before it's offset in the file is known.
+struct elf_section_t {
+	long		name;
+	long		type;
+	long		flags;
+	std::string	bytes;
+	long		size;
+	long		link = 0;
+	long		info = 0;
+	long		alignment;
+	long		entry_size = 0;
+};
+
+// An ELF64 relocatable object writer. The sections of an assembler are
+// written with a .rela section for each one with relocations, a symbol
+// table and the empty .note.GNU-stack section that marks the stack as not
+// executable. Relocations against a local symbol are made against the
+// symbol of it's section instead, so only global and undefined symbols
+// appear in the symbol table.
+struct elf_writer_t {
+	// Write the object file of an assembler, which must be finished.
+	std::string write(x86_assembler_t& assembler) {
+		// The null section, then one for every section of the assembler.
+		add_section(0, 0, 0, "", 0, 0);
+		for (int i = 0; i < sk_count; i++) {
+			x86_section_t& section = assembler.sections[i];
+			add_section(name(elf_section_names[i]), elf_section_types[i], elf_section_flags[i], section.bytes, section.size, section.alignment);
+		}
+
+		// The null symbol and the section symbols are local; the defined
+		// global symbols follow in definition order, then the undefined ones
+		// in the order they are referenced.
+		add_symbol(0, 0, 0, 0);
+		for (int i = 0; i < sk_count; i++) {
+			add_symbol(0, elf_stb_local << 4 | elf_stt_section, 1 + i, 0);
+		}
+		long first_global = symbol_count;
+		for (int i = 0; i < assembler.defined.size(); i++) {
+			std::string& symbol = assembler.defined[i];
+			if (assembler.globals.count(symbol)) {
+				x86_definition_t& definition = assembler.definitions[symbol];
+				symbols[symbol] = symbol_count;
+				add_symbol(string(symbol), elf_stb_global << 4 | elf_stt_notype, 1 + definition.section, definition.offset);
+			}
+		}
+
+		// The relocations of every section.
+		std::vector<long> rela_sections;
+		for (int i = 0; i < sk_count; i++) {
+			std::vector<x86_relocation_t>& relocations = assembler.sections[i].relocations;
+			if (relocations.empty()) {
+				continue;
+			}
+			std::string bytes;
+			for (int j = 0; j < relocations.size(); j++) {
+				x86_relocation_t& relocation = relocations[j];
+				long symbol = 0;
+				long addend = relocation.addend;
+				auto it = assembler.definitions.find(relocation.symbol);
+				if (it != assembler.definitions.end() && !assembler.globals.count(relocation.symbol)) {
+					symbol = 1 + it->second.section;
+					addend += it->second.offset;
+				} else if (symbols.count(relocation.symbol)) {
+					symbol = symbols[relocation.symbol];
+				} else {
+					symbol = symbol_count;
+					symbols[relocation.symbol] = symbol;
+					add_symbol(string(relocation.symbol), elf_stb_global << 4 | elf_stt_notype, 0, 0);
+				}
+				x86_append_le(bytes, relocation.offset, 8);
+				x86_append_le(bytes, symbol << 32 | elf_relocation_types[relocation.type], 8);
+				x86_append_le(bytes, addend, 8);
+			}
+			rela_sections.push_back(sections.size());
+			add_section(name(std::string(".rela") + elf_section_names[i]), elf_sht_rela, elf_shf_info_link, bytes, bytes.size(), 8);
+			sections.back().info = 1 + i;
+			sections.back().entry_size = 24;
+		}
+		add_section(name(".note.GNU-stack"), elf_sht_progbits, 0, "", 0, 1);
+
+		// The symbol table, followed by the string tables.
+		long symtab = sections.size();
+		for (int i = 0; i < rela_sections.size(); i++) {
+			sections[rela_sections[i]].link = symtab;
+		}
+		add_section(name(".symtab"), elf_sht_symtab, 0, symbol_bytes, symbol_bytes.size(), 8);
+		sections.back().link = symtab + 1;
+		sections.back().info = first_global;
+		sections.back().entry_size = 24;
+		add_section(name(".strtab"), elf_sht_strtab, 0, strings, strings.size(), 1);
+		long shstrtab = name(".shstrtab");
+		add_section(shstrtab, elf_sht_strtab, 0, section_names, section_names.size(), 1);
+
+		// The file header, the contents of the sections and the section
+		// header table.
+		std::string file(64, '\0');
+		std::vector<long> offsets;
+		for (int i = 0; i < sections.size(); i++) {
+			elf_section_t& section = sections[i];
+			long alignment = std::max(section.alignment, 1l);
+			file.append((alignment - file.size() % alignment) % alignment, '\0');
+			offsets.push_back(file.size());
+			file += section.bytes;
+		}
+		file.append((8 - file.size() % 8) % 8, '\0');
+		long header_offset = file.size();
+		for (int i = 0; i < sections.size(); i++) {
+			elf_section_t& section = sections[i];
+			x86_append_le(file, section.name, 4);
+			x86_append_le(file, section.type, 4);
+			x86_append_le(file, section.flags, 8);
+			x86_append_le(file, 0, 8);
+			x86_append_le(file, i ? offsets[i] : 0, 8);
+			x86_append_le(file, section.size, 8);
+			x86_append_le(file, section.link, 4);
+			x86_append_le(file, section.info, 4);
+			x86_append_le(file, section.alignment, 8);
+			x86_append_le(file, section.entry_size, 8);
+		}
+		std::string header = "\x7f" "ELF";
+		// ELFCLASS64, ELFDATA2LSB, EV_CURRENT and the System V ABI.
+		header += "\x02\x01\x01";
+		header.append(9, '\0');
+		// ET_REL, EM_X86_64 and EV_CURRENT.
+		x86_append_le(header, 1, 2);
+		x86_append_le(header, 62, 2);
+		x86_append_le(header, 1, 4);
+		// No entry point or program headers.
+		x86_append_le(header, 0, 8);
+		x86_append_le(header, 0, 8);
+		x86_append_le(header, header_offset, 8);
+		x86_append_le(header, 0, 4);
+		x86_append_le(header, 64, 2);
+		x86_append_le(header, 0, 2);
+		x86_append_le(header, 0, 2);
+		x86_append_le(header, 64, 2);
+		x86_append_le(header, sections.size(), 2);
+		x86_append_le(header, sections.size() - 1, 2);
+		file.replace(0, header.size(), header);
+		return file;
+	}
+
+private:
+	// The section headers.
+	std::vector<elf_section_t> sections;
+	// The section name string table, starting with the empty name.
+	std::string section_names = std::string(1, '\0');
+	// The symbol table and string table.
+	std::string symbol_bytes;
+	long symbol_count = 0;
+	std::string strings = std::string(1, '\0');
+	// The indices of the global and undefined symbols.
+	std::unordered_map<std::string, long> symbols;
+
+	// Add a section name, returning it's offset.
+	long name(std::string name) {
+		long offset = section_names.size();
+		section_names += name;
+		section_names += '\0';
+		return offset;
+	}
+
+	// Add a symbol name, returning it's offset.
+	long string(std::string name) {
+		long offset = strings.size();
+		strings += name;
+		strings += '\0';
+		return offset;
+	}
+
+	// Add a section header.
+	void add_section(long name, long type, long flags, std::string bytes, long size, long alignment) {
+		elf_section_t section;
+		section.name = name;
+		section.type = type;
+		section.flags = flags;
+		section.bytes = type == elf_sht_nobits ? "" : bytes;
+		section.size = size;
+		section.alignment = alignment;
+		sections.push_back(section);
+	}
+
+	// Add a symbol.
+	void add_symbol(long name, long info, long section, long value) {
+		x86_append_le(symbol_bytes, name, 4);
+		x86_append_le(symbol_bytes, info, 1);
+		x86_append_le(symbol_bytes, 0, 1);
+		x86_append_le(symbol_bytes, section, 2);
+		x86_append_le(symbol_bytes, value, 8);
+		x86_append_le(symbol_bytes, 0, 8);
+		symbol_count++;
+	}
+};
@@ -0,0 +1,492 @@
+#pragma once
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+
+#include "x86.hpp"
+#include "liveness.hpp"
+#include "spiller.hpp"
+
+// All states a node of the interference graph can be in.
+enum graph_coloring_node_state_t {
+	ns_precolored,
+	ns_initial,
+	ns_simplify,
+	ns_freeze,
+	ns_spill,
+	ns_spilled,
+	ns_coalesced,
+	ns_colored,
+	ns_selected
+};
+
+// All states a move can be in.
+enum graph_coloring_move_state_t {
+	ms_worklist,
+	ms_active,
+	ms_coalesced,
+	ms_constrained,
+	ms_frozen
+};
+
+// A graph coloring register allocator with iterated register coalescing
+// (George and Appel), used at -O2. Physical registers are precolored nodes,
+// so the moves into the argument registers before a call and out of %rax
+// after it are coalesced whenever the conservative tests allow. Spill
+// candidates are chosen by their use count weighted by 10 to the power of the
+// loop depth, divided by their degree.
+struct graph_coloring_allocator_t {
+	// The number of colors.
+	long colors = x86_allocatable.size();
+	// The number of virtual registers spilled, over all rounds.
+	long spill_count = 0;
+	// The number of moves coalesced in the final round.
+	long coalesced_count = 0;
+
+	// The interference graph.
+	long node_count = 0;
+	std::unordered_set<long> adjacency_set;
+	std::vector<std::vector<long>> adjacency_list;
+	std::vector<long> degree;
+	std::vector<graph_coloring_node_state_t> state;
+	std::vector<long> alias;
+	std::vector<long> color;
+	std::vector<double> cost;
+	std::vector<bool> unspillable;
+
+	// The moves, as destination and source pairs.
+	std::vector<std::pair<long, long>> moves;
+	std::vector<graph_coloring_move_state_t> move_state;
+	std::vector<std::vector<long>> move_list;
+
+	// The worklists.
+	std::set<long> simplify_worklist;
+	std::set<long> freeze_worklist;
+	std::set<long> spill_worklist;
+	std::set<long> worklist_moves;
+	std::vector<long> select_stack;
+	std::vector<long> spilled_nodes;
+
+	// Add an interference edge. The stack and frame pointers are never
+	// allocated, so they interfere with nothing.
+	void add_edge(long u, long v) {
+		if (u == v || u == rg_rsp || u == rg_rbp || v == rg_rsp || v == rg_rbp) {
+			return;
+		}
+		if (adjacency_set.count(u * node_count + v)) {
+			return;
+		}
+		adjacency_set.insert(u * node_count + v);
+		adjacency_set.insert(v * node_count + u);
+		if (state[u] != ns_precolored) {
+			adjacency_list[u].push_back(v);
+			degree[u]++;
+		}
+		if (state[v] != ns_precolored) {
+			adjacency_list[v].push_back(u);
+			degree[v]++;
+		}
+	}
+
+	// Check if an instruction is a move between two registers.
+	bool is_move(x86_instruction_t& instruction) {
+		return instruction.opcode == xo_mov && instruction.size >= 4 &&
+			   instruction.operands[0].type == ot_register &&
+			   instruction.operands[1].type == ot_register;
+	}
+
+	// Build the interference graph of a function.
+	void build(x86_function_t& function) {
+		node_count = function.register_count;
+		adjacency_set.clear();
+		adjacency_list.assign(node_count, {});
+		degree.assign(node_count, 0);
+		state.assign(node_count, ns_initial);
+		alias.assign(node_count, -1);
+		color.assign(node_count, -1);
+		cost.assign(node_count, 0);
+		moves.clear();
+		move_state.clear();
+		move_list.assign(node_count, {});
+		for (long reg = 0; reg < x86_first_virtual; reg++) {
+			state[reg] = ns_precolored;
+			color[reg] = reg;
+		}
+		virtual_liveness_t liveness(function);
+		for (int i = 0; i < function.blocks.size(); i++) {
+			x86_block_t& block = function.blocks[i];
+			double weight = 1;
+			for (int j = 0; j < block.loop_depth; j++) {
+				weight *= 10;
+			}
+			std::set<long> live;
+			for (long reg = x86_first_virtual; reg < node_count; reg++) {
+				if (liveness.live_out[i][reg]) {
+					live.insert(reg);
+				}
+			}
+			for (long j = block.instructions.size() - 1; j >= 0; j--) {
+				x86_instruction_t& instruction = block.instructions[j];
+				std::vector<long> uses;
+				std::vector<long> defs;
+				x86_uses_defs(instruction, uses, defs);
+				if (is_move(instruction)) {
+					for (int k = 0; k < uses.size(); k++) {
+						live.erase(uses[k]);
+					}
+					long move = moves.size();
+					moves.push_back({instruction.operands[1].reg, instruction.operands[0].reg});
+					move_state.push_back(ms_worklist);
+					move_list[instruction.operands[0].reg].push_back(move);
+					if (instruction.operands[1].reg != instruction.operands[0].reg) {
+						move_list[instruction.operands[1].reg].push_back(move);
+					}
+					worklist_moves.insert(move);
+				}
+				for (int k = 0; k < defs.size(); k++) {
+					live.insert(defs[k]);
+				}
+				for (int k = 0; k < defs.size(); k++) {
+					for (long reg : live) {
+						add_edge(reg, defs[k]);
+					}
+				}
+				for (int k = 0; k < defs.size(); k++) {
+					live.erase(defs[k]);
+				}
+				for (int k = 0; k < uses.size(); k++) {
+					live.insert(uses[k]);
+				}
+				uses.insert(uses.end(), defs.begin(), defs.end());
+				for (int k = 0; k < uses.size(); k++) {
+					cost[uses[k]] += weight;
+				}
+			}
+		}
+	}
+
+	// Get the neighbours of a node that are still in the graph.
+	std::vector<long> adjacent(long node) {
+		std::vector<long> nodes;
+		for (int i = 0; i < adjacency_list[node].size(); i++) {
+			long other = adjacency_list[node][i];
+			if (state[other] != ns_selected && state[other] != ns_coalesced) {
+				nodes.push_back(other);
+			}
+		}
+		return nodes;
+	}
+
+	// Get the moves of a node that may still be coalesced.
+	std::vector<long> node_moves(long node) {
+		std::vector<long> result;
+		for (int i = 0; i < move_list[node].size(); i++) {
+			long move = move_list[node][i];
+			if (move_state[move] == ms_active || move_state[move] == ms_worklist) {
+				result.push_back(move);
+			}
+		}
+		return result;
+	}
+
+	// Check if a node takes part in a move that may still be coalesced.
+	bool move_related(long node) {
+		return !node_moves(node).empty();
+	}
+
+	// Move a node to a worklist.
+	void set_state(long node, graph_coloring_node_state_t new_state) {
+		if (state[node] == ns_simplify) {
+			simplify_worklist.erase(node);
+		} else if (state[node] == ns_freeze) {
+			freeze_worklist.erase(node);
+		} else if (state[node] == ns_spill) {
+			spill_worklist.erase(node);
+		}
+		state[node] = new_state;
+		if (new_state == ns_simplify) {
+			simplify_worklist.insert(node);
+		} else if (new_state == ns_freeze) {
+			freeze_worklist.insert(node);
+		} else if (new_state == ns_spill) {
+			spill_worklist.insert(node);
+		}
+	}
+
+	// Put every virtual register on the worklist matching it's degree.
+	void make_worklist() {
+		for (long reg = x86_first_virtual; reg < node_count; reg++) {
+			if (degree[reg] >= colors) {
+				set_state(reg, ns_spill);
+			} else if (move_related(reg)) {
+				set_state(reg, ns_freeze);
+			} else {
+				set_state(reg, ns_simplify);
+			}
+		}
+	}
+
+	// Make the moves of some nodes candidates for coalescing again.
+	void enable_moves(std::vector<long> nodes) {
+		for (int i = 0; i < nodes.size(); i++) {
+			std::vector<long> node_moves = this->node_moves(nodes[i]);
+			for (int j = 0; j < node_moves.size(); j++) {
+				if (move_state[node_moves[j]] == ms_active) {
+					move_state[node_moves[j]] = ms_worklist;
+					worklist_moves.insert(node_moves[j]);
+				}
+			}
+		}
+	}
+
+	// Decrement the degree of a node, which may make it colorable.
+	void decrement_degree(long node) {
+		if (state[node] == ns_precolored) {
+			return;
+		}
+		long old_degree = degree[node]--;
+		if (old_degree == colors) {
+			std::vector<long> nodes = adjacent(node);
+			nodes.push_back(node);
+			enable_moves(nodes);
+			set_state(node, move_related(node) ? ns_freeze : ns_simplify);
+		}
+	}
+
+	// Remove a node of low degree from the graph.
+	void simplify() {
+		long node = *simplify_worklist.begin();
+		set_state(node, ns_selected);
+		select_stack.push_back(node);
+		std::vector<long> nodes = adjacent(node);
+		for (int i = 0; i < nodes.size(); i++) {
+			decrement_degree(nodes[i]);
+		}
+	}
+
+	// Get the node a coalesced node was merged into.
+	long get_alias(long node) {
+		while (state[node] == ns_coalesced) {
+			node = alias[node];
+		}
+		return node;
+	}
+
+	// Move a node that is no longer move related to the simplify worklist.
+	void add_worklist(long node) {
+		if (state[node] != ns_precolored && !move_related(node) && degree[node] < colors) {
+			set_state(node, ns_simplify);
+		}
+	}
+
+	// The George test: merging a node into precolored register r is safe if
+	// every neighbour t of the node has low degree, is precolored or already
+	// interferes with r.
+	bool ok(long t, long r) {
+		return degree[t] < colors || state[t] == ns_precolored || adjacency_set.count(t * node_count + r);
+	}
+
+	// The Briggs test: merging is safe if the merged node has fewer than
+	// colors neighbours of significant degree.
+	bool conservative(std::vector<long> nodes) {
+		std::sort(nodes.begin(), nodes.end());
+		nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+		long significant = 0;
+		for (int i = 0; i < nodes.size(); i++) {
+			if (state[nodes[i]] == ns_precolored || degree[nodes[i]] >= colors) {
+				significant++;
+			}
+		}
+		return significant < colors;
+	}
+
+	// Merge node v into node u.
+	void combine(long u, long v) {
+		set_state(v, ns_coalesced);
+		alias[v] = u;
+		move_list[u].insert(move_list[u].end(), move_list[v].begin(), move_list[v].end());
+		enable_moves({v});
+		std::vector<long> nodes = adjacent(v);
+		for (int i = 0; i < nodes.size(); i++) {
+			add_edge(nodes[i], u);
+			decrement_degree(nodes[i]);
+		}
+		if (degree[u] >= colors && state[u] == ns_freeze) {
+			set_state(u, ns_spill);
+		}
+	}
+
+	// Try to coalesce a move.
+	void coalesce() {
+		long move = *worklist_moves.begin();
+		worklist_moves.erase(move);
+		long x = get_alias(moves[move].first);
+		long y = get_alias(moves[move].second);
+		long u = x;
+		long v = y;
+		if (state[y] == ns_precolored) {
+			u = y;
+			v = x;
+		}
+		if (u == v) {
+			move_state[move] = ms_coalesced;
+			add_worklist(u);
+		} else if (state[v] == ns_precolored || adjacency_set.count(u * node_count + v) ||
+				   v == rg_rsp || v == rg_rbp || u == rg_rsp || u == rg_rbp) {
+			move_state[move] = ms_constrained;
+			add_worklist(u);
+			add_worklist(v);
+		} else {
+			bool safe;
+			if (state[u] == ns_precolored) {
+				safe = true;
+				std::vector<long> nodes = adjacent(v);
+				for (int i = 0; i < nodes.size(); i++) {
+					if (!ok(nodes[i], u)) {
+						safe = false;
+						break;
+					}
+				}
+			} else {
+				std::vector<long> nodes = adjacent(u);
+				std::vector<long> v_nodes = adjacent(v);
+				nodes.insert(nodes.end(), v_nodes.begin(), v_nodes.end());
+				safe = conservative(nodes);
+			}
+			if (safe) {
+				move_state[move] = ms_coalesced;
+				combine(u, v);
+				add_worklist(u);
+			} else {
+				move_state[move] = ms_active;
+			}
+		}
+	}
+
+	// Give up coalescing the moves of a node.
+	void freeze_moves(long node) {
+		std::vector<long> node_moves = this->node_moves(node);
+		for (int i = 0; i < node_moves.size(); i++) {
+			long move = node_moves[i];
+			long x = get_alias(moves[move].first);
+			long y = get_alias(moves[move].second);
+			long v = y == get_alias(node) ? x : y;
+			worklist_moves.erase(move);
+			move_state[move] = ms_frozen;
+			if (state[v] == ns_freeze && !move_related(v) && degree[v] < colors) {
+				set_state(v, ns_simplify);
+			}
+		}
+	}
+
+	// Freeze the moves of a move related node of low degree.
+	void freeze() {
+		long node = *freeze_worklist.begin();
+		set_state(node, ns_simplify);
+		freeze_moves(node);
+	}
+
+	// Choose a node to spill, the one with the lowest weighted cost per
+	// neighbour. Temporaries created by the spiller are never chosen unless
+	// nothing else is left.
+	void select_spill() {
+		long chosen = -1;
+		double best = 0;
+		for (long node : spill_worklist) {
+			double priority = cost[node] / degree[node];
+			if (unspillable[node]) {
+				priority = 1e300;
+			}
+			if (chosen < 0 || priority < best) {
+				chosen = node;
+				best = priority;
+			}
+		}
+		set_state(chosen, ns_simplify);
+		freeze_moves(chosen);
+	}
+
+	// Pop the nodes off the select stack and give each a color that none of
+	// it's neighbours has.
+	void assign_colors() {
+		while (!select_stack.empty()) {
+			long node = select_stack.back();
+			select_stack.pop_back();
+			std::vector<bool> used(x86_first_virtual, false);
+			for (int i = 0; i < adjacency_list[node].size(); i++) {
+				long other = get_alias(adjacency_list[node][i]);
+				if (state[other] == ns_colored || state[other] == ns_precolored) {
+					used[color[other]] = true;
+				}
+			}
+			state[node] = ns_spilled;
+			for (int i = 0; i < x86_allocatable.size(); i++) {
+				if (!used[x86_allocatable[i]]) {
+					state[node] = ns_colored;
+					color[node] = x86_allocatable[i];
+					break;
+				}
+			}
+			if (state[node] == ns_spilled) {
+				if (unspillable[node]) {
+					fprintf(stderr, "internal compiler error: no register for a spill temporary\n");
+					exit(4);
+				}
+				spilled_nodes.push_back(node);
+			}
+		}
+		for (long reg = x86_first_virtual; reg < node_count; reg++) {
+			if (state[reg] == ns_coalesced) {
+				color[reg] = color[get_alias(reg)];
+			}
+		}
+	}
+
+	// Allocate the registers of a function.
+	void allocate(x86_function_t& function) {
+		spiller_t spiller;
+		unspillable.assign(function.register_count, false);
+		while (true) {
+			simplify_worklist.clear();
+			freeze_worklist.clear();
+			spill_worklist.clear();
+			worklist_moves.clear();
+			select_stack.clear();
+			spilled_nodes.clear();
+			build(function);
+			make_worklist();
+			while (true) {
+				if (!simplify_worklist.empty()) {
+					simplify();
+				} else if (!worklist_moves.empty()) {
+					coalesce();
+				} else if (!freeze_worklist.empty()) {
+					freeze();
+				} else if (!spill_worklist.empty()) {
+					select_spill();
+				} else {
+					break;
+				}
+			}
+			assign_colors();
+			if (spilled_nodes.empty()) {
+				break;
+			}
+			spill_count += spilled_nodes.size();
+			std::vector<long> slots(function.register_count, -1);
+			for (int i = 0; i < spilled_nodes.size(); i++) {
+				slots[spilled_nodes[i]] = function.create_slot(8);
+			}
+			spiller.rewrite(function, slots);
+			unspillable.resize(function.register_count, false);
+			for (int i = 0; i < spiller.temporaries.size(); i++) {
+				unspillable[spiller.temporaries[i]] = true;
+			}
+		}
+		coalesced_count = std::count(move_state.begin(), move_state.end(), ms_coalesced);
+		x86_assign_registers(function, color);
+	}
+};
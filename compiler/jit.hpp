@@ -0,0 +1,129 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <cstdint>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "assembler.hpp"
+
+// The size of a stub through which code calls a function outside of it:
+// jmpq *address(%rip), two bytes of padding and the 8-byte address.
+const long jit_stub_size = 16;
+
+// A loader that runs an assembled program in-process. The sections of the
+// assembler are copied into one anonymous mapping, each starting on a page
+// of it's own, and relocated there. Symbols the program does not define are
+// looked up in the process with dlsym, which finds libc; since those may be
+// further away than a 32-bit offset reaches, calls to them go through stubs
+// placed after the code. Once relocated, the code is made executable and
+// the read-only data read-only, so no page is ever writable and executable
+// at the same time.
+struct jit_loader_t {
+	// Load a finished assembler and call it's main function, returning what
+	// it returns.
+	int run(x86_assembler_t& assembler, int argc, char** argv) {
+		long page = sysconf(_SC_PAGESIZE);
+
+		// The stubs of the functions outside the program.
+		std::vector<std::string> externals;
+		std::unordered_map<std::string, long> stubs;
+		for (int i = 0; i < sk_count; i++) {
+			std::vector<x86_relocation_t>& relocations = assembler.sections[i].relocations;
+			for (int j = 0; j < relocations.size(); j++) {
+				std::string& symbol = relocations[j].symbol;
+				if (!assembler.definitions.count(symbol) && relocations[j].type != rt_abs64 && !stubs.count(symbol)) {
+					stubs[symbol] = externals.size();
+					externals.push_back(symbol);
+				}
+			}
+		}
+
+		// Lay out the sections.
+		long text_size = assembler.sections[sk_text].size;
+		long stubs_offset = (text_size + 15) / 16 * 16;
+		long offsets[sk_count];
+		long size = 0;
+		for (int i = 0; i < sk_count; i++) {
+			offsets[i] = size;
+			long section_size = i == sk_text ? stubs_offset + externals.size() * jit_stub_size : assembler.sections[i].size;
+			size += (section_size + page - 1) / page * page;
+		}
+		if (size == 0) {
+			size = page;
+		}
+		char* memory = (char*)mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) {
+			error("could not map memory for the program");
+		}
+		for (int i = 0; i < sk_count; i++) {
+			x86_section_t& section = assembler.sections[i];
+			std::copy(section.bytes.begin(), section.bytes.end(), memory + offsets[i]);
+		}
+		for (int i = 0; i < externals.size(); i++) {
+			char* stub = memory + offsets[sk_text] + stubs_offset + i * jit_stub_size;
+			void* address = resolve(externals[i]);
+			std::string code = "\xff\x25";
+			x86_append_le(code, 2, 4);
+			code.append(2, '\0');
+			x86_append_le(code, (uintptr_t)address, 8);
+			std::copy(code.begin(), code.end(), stub);
+		}
+
+		// Relocate the sections.
+		for (int i = 0; i < sk_count; i++) {
+			std::vector<x86_relocation_t>& relocations = assembler.sections[i].relocations;
+			for (int j = 0; j < relocations.size(); j++) {
+				x86_relocation_t& relocation = relocations[j];
+				char* field = memory + offsets[i] + relocation.offset;
+				uintptr_t target;
+				auto it = assembler.definitions.find(relocation.symbol);
+				if (it != assembler.definitions.end()) {
+					target = (uintptr_t)(memory + offsets[it->second.section] + it->second.offset);
+				} else if (relocation.type == rt_abs64) {
+					target = (uintptr_t)resolve(relocation.symbol);
+				} else {
+					target = (uintptr_t)(memory + offsets[sk_text] + stubs_offset + stubs[relocation.symbol] * jit_stub_size);
+				}
+				std::string value;
+				if (relocation.type == rt_abs64) {
+					x86_append_le(value, target + relocation.addend, 8);
+				} else {
+					x86_append_le(value, target + relocation.addend - (uintptr_t)field, 4);
+				}
+				std::copy(value.begin(), value.end(), field);
+			}
+		}
+
+		// Protect the code and read-only data, then call main.
+		if (mprotect(memory + offsets[sk_text], offsets[sk_rodata] - offsets[sk_text], PROT_READ | PROT_EXEC) < 0 ||
+			mprotect(memory + offsets[sk_rodata], offsets[sk_data] - offsets[sk_rodata], PROT_READ) < 0)
+		{
+			error("could not protect the memory of the program");
+		}
+		auto it = assembler.definitions.find(x86_mangle("main"));
+		if (it == assembler.definitions.end() || it->second.section != sk_text) {
+			error("undefined reference to 'main'");
+		}
+		int (*entry)(int, char**) = (int (*)(int, char**))(memory + offsets[sk_text] + it->second.offset);
+		return entry(argc, argv);
+	}
+
+private:
+	// Report an error and exit.
+	void error(std::string message) {
+		std::cerr << "error: " << message << std::endl;
+		exit(1);
+	}
+
+	// Look up a symbol outside the program.
+	void* resolve(const std::string& symbol) {
+		void* address = dlsym(RTLD_DEFAULT, symbol.c_str());
+		if (!address) {
+			error("undefined reference to '" + symbol + "'");
+		}
+		return address;
+	}
+};
@@ -0,0 +1,250 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include "x86.hpp"
+#include "liveness.hpp"
+#include "spiller.hpp"
+
+// A live interval. Instruction n reads it's operands at position 2n and
+// writes it's results at position 2n + 1, so a register that dies at an
+// instruction may be reused for the register it defines.
+struct linear_scan_interval_t {
+	long	reg;
+	long	start;
+	long	end;
+};
+
+// A linear scan register allocator, used at -O1. Every virtual register gets
+// a single interval from it's first definition to it's last use, without
+// holes. The physical registers used by the instruction selector (argument
+// registers, the registers of a division and the registers clobbered by
+// calls) are fixed ranges that an interval may not overlap, so the values
+// live across a call end up in callee-saved registers. When no register is
+// free the interval that ends last is spilled everywhere through the spiller,
+// and the allocation is repeated until nothing more is spilled.
+struct linear_scan_allocator_t {
+	// The intervals of the virtual registers, by register.
+	std::vector<linear_scan_interval_t> intervals;
+	// The merged ranges during which each physical register is fixed.
+	std::vector<std::vector<std::pair<long, long>>> fixed;
+	// The registers each virtual register would like to be assigned, taken
+	// from the moves it takes part in.
+	std::vector<std::vector<long>> hints;
+	// The temporaries created by the spiller, which may never be spilled.
+	std::vector<bool> unspillable;
+	// The number of virtual registers spilled, over all rounds.
+	long spill_count = 0;
+
+	// Add a fixed range to a physical register.
+	void add_fixed(long reg, long start, long end) {
+		if (reg != rg_rsp && reg != rg_rbp) {
+			fixed[reg].push_back({start, end});
+		}
+	}
+
+	// Extend the interval of a virtual register to cover a position.
+	void extend(long reg, long position) {
+		linear_scan_interval_t& interval = intervals[reg];
+		if (interval.start < 0 || position < interval.start) {
+			interval.start = position;
+		}
+		if (position > interval.end) {
+			interval.end = position;
+		}
+	}
+
+	// Build the intervals, the fixed ranges and the hints of a function.
+	void build(x86_function_t& function) {
+		virtual_liveness_t liveness(function);
+		intervals.assign(function.register_count, {0, -1, -1});
+		for (long reg = 0; reg < function.register_count; reg++) {
+			intervals[reg].reg = reg;
+		}
+		fixed.assign(x86_first_virtual, {});
+		hints.assign(function.register_count, {});
+		long first = 0;
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<x86_instruction_t>& instructions = function.blocks[i].instructions;
+			long block_start = 2 * first;
+			long block_end = 2 * (first + instructions.size()) - 1;
+			for (long reg = x86_first_virtual; reg < function.register_count; reg++) {
+				if (liveness.live_in[i][reg]) {
+					extend(reg, block_start);
+				}
+				if (liveness.live_out[i][reg]) {
+					extend(reg, block_end);
+				}
+			}
+			// Physical registers never live across blocks, so a backward scan
+			// finds their ranges.
+			std::vector<long> live_until(x86_first_virtual, -1);
+			for (long j = instructions.size() - 1; j >= 0; j--) {
+				x86_instruction_t& instruction = instructions[j];
+				long use = 2 * (first + j);
+				long def = use + 1;
+				std::vector<long> uses;
+				std::vector<long> defs;
+				x86_uses_defs(instruction, uses, defs);
+				for (int k = 0; k < defs.size(); k++) {
+					if (x86_is_virtual(defs[k])) {
+						extend(defs[k], def);
+					} else {
+						add_fixed(defs[k], def, live_until[defs[k]] < 0 ? def : live_until[defs[k]]);
+						live_until[defs[k]] = -1;
+					}
+				}
+				for (int k = 0; k < uses.size(); k++) {
+					if (x86_is_virtual(uses[k])) {
+						extend(uses[k], use);
+					} else if (live_until[uses[k]] < 0) {
+						live_until[uses[k]] = use;
+					}
+				}
+				if (instruction.opcode == xo_mov &&
+					instruction.operands[0].type == ot_register &&
+					instruction.operands[1].type == ot_register) {
+					long source = instruction.operands[0].reg;
+					long destination = instruction.operands[1].reg;
+					if (x86_is_virtual(source)) {
+						hints[source].push_back(destination);
+					}
+					if (x86_is_virtual(destination)) {
+						hints[destination].push_back(source);
+					}
+				}
+			}
+			for (long reg = 0; reg < x86_first_virtual; reg++) {
+				if (live_until[reg] >= 0) {
+					add_fixed(reg, block_start, live_until[reg]);
+				}
+			}
+			first += instructions.size();
+		}
+		// Sort and merge the fixed ranges, so their ends are increasing.
+		for (long reg = 0; reg < x86_first_virtual; reg++) {
+			std::vector<std::pair<long, long>>& ranges = fixed[reg];
+			std::sort(ranges.begin(), ranges.end());
+			std::vector<std::pair<long, long>> merged;
+			for (int i = 0; i < ranges.size(); i++) {
+				if (!merged.empty() && ranges[i].first <= merged.back().second) {
+					merged.back().second = std::max(merged.back().second, ranges[i].second);
+				} else {
+					merged.push_back(ranges[i]);
+				}
+			}
+			ranges = merged;
+		}
+	}
+
+	// Check if a physical register is fixed anywhere in an interval.
+	bool is_fixed(long reg, linear_scan_interval_t& interval) {
+		std::vector<std::pair<long, long>>& ranges = fixed[reg];
+		auto it = std::lower_bound(ranges.begin(), ranges.end(), interval.start, [](const std::pair<long, long>& range, long start) {
+			return range.second < start;
+		});
+		return it != ranges.end() && it->first <= interval.end;
+	}
+
+	// Assign physical registers to the intervals in order of their start,
+	// returning the spilled virtual registers.
+	std::vector<long> scan(std::vector<long>& assignment) {
+		std::vector<linear_scan_interval_t> order;
+		for (long reg = x86_first_virtual; reg < intervals.size(); reg++) {
+			if (intervals[reg].start >= 0) {
+				order.push_back(intervals[reg]);
+			}
+		}
+		std::sort(order.begin(), order.end(), [](const linear_scan_interval_t& a, const linear_scan_interval_t& b) {
+			return a.start < b.start || (a.start == b.start && a.reg < b.reg);
+		});
+		std::vector<long> spilled;
+		std::vector<long> active;
+		std::vector<long> holder(x86_first_virtual, -1);
+		for (int i = 0; i < order.size(); i++) {
+			linear_scan_interval_t& current = order[i];
+			// Expire the intervals that ended before this one starts.
+			for (int j = active.size() - 1; j >= 0; j--) {
+				if (intervals[active[j]].end < current.start) {
+					holder[assignment[active[j]]] = -1;
+					active.erase(active.begin() + j);
+				}
+			}
+			// Try the hinted registers first, then every allocatable register.
+			std::vector<long> candidates;
+			std::vector<long>& hinted = hints[current.reg];
+			for (int j = 0; j < hinted.size(); j++) {
+				long reg = x86_is_virtual(hinted[j]) ? assignment[hinted[j]] : hinted[j];
+				if (reg >= 0) {
+					candidates.push_back(reg);
+				}
+			}
+			candidates.insert(candidates.end(), x86_allocatable.begin(), x86_allocatable.end());
+			long chosen = -1;
+			for (int j = 0; j < candidates.size(); j++) {
+				long reg = candidates[j];
+				if (reg != rg_rsp && reg != rg_rbp && holder[reg] < 0 && !is_fixed(reg, current)) {
+					chosen = reg;
+					break;
+				}
+			}
+			if (chosen < 0) {
+				// Spill the active interval that ends last among those holding a
+				// register this interval could use, unless this one ends later.
+				long victim = -1;
+				for (int j = 0; j < active.size(); j++) {
+					long other = active[j];
+					if (unspillable[other] || is_fixed(assignment[other], current)) {
+						continue;
+					}
+					if (victim < 0 || intervals[other].end > intervals[victim].end) {
+						victim = other;
+					}
+				}
+				if (victim >= 0 && (intervals[victim].end > current.end || unspillable[current.reg])) {
+					chosen = assignment[victim];
+					assignment[victim] = -1;
+					active.erase(std::find(active.begin(), active.end(), victim));
+					spilled.push_back(victim);
+				} else if (!unspillable[current.reg]) {
+					spilled.push_back(current.reg);
+					continue;
+				} else {
+					fprintf(stderr, "internal compiler error: no register for a spill temporary\n");
+					exit(4);
+				}
+			}
+			assignment[current.reg] = chosen;
+			holder[chosen] = current.reg;
+			active.push_back(current.reg);
+		}
+		return spilled;
+	}
+
+	// Allocate the registers of a function.
+	void allocate(x86_function_t& function) {
+		spiller_t spiller;
+		unspillable.assign(function.register_count, false);
+		while (true) {
+			build(function);
+			std::vector<long> assignment(function.register_count, -1);
+			std::vector<long> spilled = scan(assignment);
+			if (spilled.empty()) {
+				x86_assign_registers(function, assignment);
+				return;
+			}
+			spill_count += spilled.size();
+			std::vector<long> slots(function.register_count, -1);
+			for (int i = 0; i < spilled.size(); i++) {
+				slots[spilled[i]] = function.create_slot(8);
+			}
+			spiller.rewrite(function, slots);
+			unspillable.resize(function.register_count, false);
+			for (int i = 0; i < spiller.temporaries.size(); i++) {
+				unspillable[spiller.temporaries[i]] = true;
+			}
+		}
+	}
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <vector>
+
+#include "x86.hpp"
+
+// A set of physical registers, one bit per register.
+typedef unsigned long x86_register_set_t;
+
+// Make a set of the physical registers in a list of registers.
+x86_register_set_t x86_register_set(std::vector<long> registers) {
+	x86_register_set_t set = 0;
+	for (int i = 0; i < registers.size(); i++) {
+		if (!x86_is_virtual(registers[i])) {
+			set |= 1ul << registers[i];
+		}
+	}
+	return set;
+}
+
+// Physical register liveness within a block. Physical registers are never
+// live across block boundaries: the instruction selector only uses them
+// between an argument setup and a call, around a division, or between the
+// function entry and the copies of incoming parameters.
+struct physical_liveness_t {
+	std::vector<x86_register_set_t> live_in;
+	std::vector<x86_register_set_t> live_out;
+	// The physical registers referenced by each instruction.
+	std::vector<x86_register_set_t> referenced;
+
+	// Compute the physical register liveness of a block.
+	physical_liveness_t(x86_block_t& block) {
+		long count = block.instructions.size();
+		live_in.resize(count);
+		live_out.resize(count);
+		referenced.resize(count);
+		x86_register_set_t live = 0;
+		for (long i = count - 1; i >= 0; i--) {
+			std::vector<long> uses;
+			std::vector<long> defs;
+			x86_uses_defs(block.instructions[i], uses, defs);
+			x86_register_set_t use_set = x86_register_set(uses);
+			x86_register_set_t def_set = x86_register_set(defs);
+			live_out[i] = live;
+			live = (live & ~def_set) | use_set;
+			live_in[i] = live;
+			referenced[i] = use_set | def_set;
+		}
+	}
+
+	// Get the physical registers that are unavailable to a temporary that
+	// lives from instruction first to instruction last inclusive.
+	x86_register_set_t busy(long first, long last) {
+		x86_register_set_t set = 0;
+		for (long i = first; i <= last; i++) {
+			set |= live_in[i] | live_out[i] | referenced[i];
+		}
+		return set;
+	}
+};
+
+// Virtual register liveness across the blocks of a function, computed by
+// iterating the backward dataflow equations to a fixed point.
+struct virtual_liveness_t {
+	std::vector<std::vector<bool>> live_in;
+	std::vector<std::vector<bool>> live_out;
+
+	// Compute the virtual register liveness of a function.
+	virtual_liveness_t(x86_function_t& function) {
+		long count = function.blocks.size();
+		long registers = function.register_count;
+		// The registers each block reads before writing them, and the
+		// registers it writes.
+		std::vector<std::vector<bool>> gen(count, std::vector<bool>(registers, false));
+		std::vector<std::vector<bool>> kill(count, std::vector<bool>(registers, false));
+		for (long i = 0; i < count; i++) {
+			std::vector<x86_instruction_t>& instructions = function.blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				std::vector<long> uses;
+				std::vector<long> defs;
+				x86_uses_defs(instructions[j], uses, defs);
+				for (int k = 0; k < uses.size(); k++) {
+					if (x86_is_virtual(uses[k]) && !kill[i][uses[k]]) {
+						gen[i][uses[k]] = true;
+					}
+				}
+				for (int k = 0; k < defs.size(); k++) {
+					if (x86_is_virtual(defs[k])) {
+						kill[i][defs[k]] = true;
+					}
+				}
+			}
+		}
+		live_in = gen;
+		live_out.assign(count, std::vector<bool>(registers, false));
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (long i = count - 1; i >= 0; i--) {
+				std::vector<long>& successors = function.blocks[i].successors;
+				for (int j = 0; j < successors.size(); j++) {
+					std::vector<bool>& successor_in = live_in[successors[j]];
+					for (long reg = x86_first_virtual; reg < registers; reg++) {
+						if (successor_in[reg] && !live_out[i][reg]) {
+							live_out[i][reg] = true;
+							if (!kill[i][reg]) {
+								live_in[i][reg] = true;
+							}
+							changed = true;
+						}
+					}
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,182 @@
+#pragma once
+#include <vector>
+
+#include "x86.hpp"
+
+// A memory operand folder. Instruction selection loads every value from
+// memory into a virtual register of it's own; when that register has a
+// single use the load is folded into the instruction using it, and a load,
+// an operation and a store back to the same location become a single
+// read-modify-write instruction. The folder runs before register allocation,
+// so a folded instruction never needs a register at all.
+struct memory_folder_t {
+	// The number of references to each virtual register.
+	std::vector<long> references;
+
+	// Check if a memory operand is addressed through a register.
+	static bool addresses_with(x86_operand_t& operand, long reg) {
+		return operand.type == ot_memory && (operand.reg == reg || operand.index == reg);
+	}
+
+	// Get the index of the memory operand of an instruction, or -1.
+	static long memory_index(x86_instruction_t& instruction) {
+		for (int i = 0; i < instruction.operands.size(); i++) {
+			if (instruction.operands[i].type == ot_memory) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	// Check if an instruction may write memory. Only loads, address
+	// computations and comparisons are known not to.
+	static bool may_write_memory(x86_instruction_t& instruction) {
+		x86_opcode_t opcode = instruction.opcode;
+		if (opcode == xo_call) {
+			return true;
+		}
+		long index = memory_index(instruction);
+		if (index < 0) {
+			return false;
+		}
+		return !(opcode == xo_cmp || opcode == xo_test || opcode == xo_lea || opcode == xo_push ||
+				 ((opcode == xo_mov || opcode == xo_movzb || opcode == xo_movsb || opcode == xo_movsw ||
+				   opcode == xo_movsl || opcode == xo_imul || opcode == xo_cmov) && index == 0) ||
+				 (opcode == xo_imul && index == 1));
+	}
+
+	// Check if a register is a virtual register referenced a number of times.
+	bool referenced(long reg, long count) {
+		return x86_is_virtual(reg) && references[reg] == count;
+	}
+
+	// Check if an instruction is a load of 4 or 8 bytes of a memory operand
+	// into a virtual register, where the memory operand is not addressed
+	// through it.
+	bool is_load(x86_instruction_t& instruction) {
+		if (instruction.opcode != xo_mov || instruction.size < 4 ||
+			instruction.operands[0].type != ot_memory || instruction.operands[1].type != ot_register)
+		{
+			return false;
+		}
+		long reg = instruction.operands[1].reg;
+		return x86_is_virtual(reg) && !addresses_with(instruction.operands[0], reg);
+	}
+
+	// movq M, %b; op S, %b; movq %b, M => op S, M
+	// The operation may be narrower than the load and store, since it only
+	// changes the lower bytes of the value.
+	bool fold_read_modify_write(std::vector<x86_instruction_t>& instructions, long i) {
+		if (i + 2 >= instructions.size() || !is_load(instructions[i])) {
+			return false;
+		}
+		x86_instruction_t& load = instructions[i];
+		x86_instruction_t& operation = instructions[i + 1];
+		x86_instruction_t& store = instructions[i + 2];
+		x86_operand_t memory = load.operands[0];
+		long reg = load.operands[1].reg;
+		if (!referenced(reg, 3) || store.opcode != xo_mov || store.size != load.size ||
+			store.operands[0].type != ot_register || store.operands[0].reg != reg ||
+			!x86_same_operand(store.operands[1], memory) || operation.size > load.size)
+		{
+			return false;
+		}
+		x86_opcode_t opcode = operation.opcode;
+		std::vector<x86_operand_t>& operands = operation.operands;
+		if (opcode == xo_neg || opcode == xo_not) {
+			if (operands[0].type != ot_register || operands[0].reg != reg) {
+				return false;
+			}
+		} else if (opcode == xo_add || opcode == xo_sub || opcode == xo_and || opcode == xo_or ||
+				   opcode == xo_xor || opcode == xo_sal || opcode == xo_sar || opcode == xo_shr)
+		{
+			if (operands[0].type == ot_memory || operands[1].type != ot_register || operands[1].reg != reg) {
+				return false;
+			}
+		} else {
+			return false;
+		}
+		operands.back() = memory;
+		x86_instruction_t folded = operation;
+		instructions.erase(instructions.begin() + i, instructions.begin() + i + 3);
+		instructions.insert(instructions.begin() + i, folded);
+		return true;
+	}
+
+	// movq M, %v; ...; op %v, X => op M, X
+	// The use may not read more bytes than the load, which could run past
+	// the end of the memory.
+	bool fold_load(std::vector<x86_instruction_t>& instructions, long i) {
+		if (!is_load(instructions[i])) {
+			return false;
+		}
+		x86_operand_t memory = instructions[i].operands[0];
+		long reg = instructions[i].operands[1].reg;
+		if (!referenced(reg, 2)) {
+			return false;
+		}
+		// Find the use, making sure the memory operand keeps it's value and
+		// address on the way.
+		for (long j = i + 1; j < instructions.size(); j++) {
+			x86_instruction_t& instruction = instructions[j];
+			for (int k = 0; k < instruction.operands.size(); k++) {
+				x86_operand_t& operand = instruction.operands[k];
+				if (addresses_with(operand, reg)) {
+					return false;
+				} else if (operand.type != ot_register || operand.reg != reg) {
+					continue;
+				}
+				if (x86_operand_access(instruction, k) != ac_read || !x86_allows_memory(instruction, k) ||
+					x86_operand_size(instruction, k) > instructions[i].size || memory_index(instruction) >= 0)
+				{
+					return false;
+				}
+				operand = memory;
+				instructions.erase(instructions.begin() + i);
+				return true;
+			}
+			if (may_write_memory(instruction)) {
+				return false;
+			}
+			std::vector<long> uses;
+			std::vector<long> defs;
+			x86_uses_defs(instruction, uses, defs);
+			for (int k = 0; k < defs.size(); k++) {
+				if (defs[k] == memory.reg || defs[k] == memory.index) {
+					return false;
+				}
+			}
+		}
+		return false;
+	}
+
+	// Fold the memory operands of a function.
+	void run(x86_function_t& function) {
+		references.assign(function.register_count, 0);
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<x86_instruction_t>& instructions = function.blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				std::vector<x86_operand_t>& operands = instructions[j].operands;
+				for (int k = 0; k < operands.size(); k++) {
+					if (operands[k].type == ot_register) {
+						references[operands[k].reg]++;
+					} else if (operands[k].type == ot_memory) {
+						if (operands[k].reg >= 0) {
+							references[operands[k].reg]++;
+						}
+						if (operands[k].index >= 0) {
+							references[operands[k].index]++;
+						}
+					}
+				}
+			}
+		}
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<x86_instruction_t>& instructions = function.blocks[i].instructions;
+			for (long j = 0; j < instructions.size(); j++) {
+				while (fold_read_modify_write(instructions, j) || fold_load(instructions, j)) {
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include <string>
+#include <cerrno>
+#include <unistd.h>
+
+// The number of bytes an output buffer collects before writing them out.
+const long output_flush_threshold = 1 << 16;
+
+// An output buffer. Text is appended to it piece by piece, with integers
+// formatted by hand instead of through format strings. A buffer writing to a
+// file descriptor writes it's contents out in large chunks at the end of a
+// line, while a buffer without one keeps all of it in memory, to be handed
+// to an assembler.
+struct output_buffer_t {
+	std::string data;
+	int fd;
+	// The error of the first write that failed, or 0.
+	int error = 0;
+
+	// Default constructor.
+	output_buffer_t(int fd = -1) {
+		this->fd = fd;
+		if (fd >= 0) {
+			data.reserve(output_flush_threshold + output_flush_threshold / 4);
+		}
+	}
+
+	// Append a string.
+	output_buffer_t& append(const std::string& text) {
+		data += text;
+		return *this;
+	}
+
+	// Append a null-terminated string.
+	output_buffer_t& append(const char* text) {
+		data += text;
+		return *this;
+	}
+
+	// Append a character.
+	output_buffer_t& append(char ch) {
+		data += ch;
+		return *this;
+	}
+
+	// Append a character a number of times.
+	output_buffer_t& append(long count, char ch) {
+		data.append(count, ch);
+		return *this;
+	}
+
+	// Append an integer in decimal. The digits are produced from the lowest
+	// up, on the magnitude as an unsigned value so the most negative long
+	// has one.
+	output_buffer_t& append_integer(long value) {
+		char digits[20];
+		int count = 0;
+		unsigned long magnitude = value < 0 ? -(unsigned long)value : value;
+		do {
+			digits[count++] = '0' + magnitude % 10;
+			magnitude /= 10;
+		} while (magnitude);
+		if (value < 0) {
+			data += '-';
+		}
+		while (count) {
+			data += digits[--count];
+		}
+		return *this;
+	}
+
+	// End a line, writing the contents out once enough have collected.
+	void end_line() {
+		data += '\n';
+		if (fd >= 0 && data.size() >= output_flush_threshold) {
+			flush();
+		}
+	}
+
+	// Write the contents out to the file descriptor, if there is one,
+	// retrying short and interrupted writes. Once a write fails, the error is
+	// kept and the rest of the output is dropped, so a reader that went away
+	// early can still be waited for.
+	void flush() {
+		if (fd < 0) {
+			return;
+		}
+		const char* bytes = data.data();
+		size_t left = data.size();
+		while (left && !error) {
+			ssize_t written = write(fd, bytes, left);
+			if (written < 0 && errno == EINTR) {
+				continue;
+			} else if (written < 0) {
+				error = errno;
+				break;
+			}
+			bytes += written;
+			left -= written;
+		}
+		data.clear();
+	}
+};
@@ -0,0 +1,223 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+
+#include "x86.hpp"
+
+// The context a peephole rule runs in.
+struct peephole_context_t {
+	// The labels control reaches by falling through the end of the block:
+	// the label of the next block, and of the blocks after it as long as the
+	// blocks in between are empty.
+	std::vector<long> fallthrough;
+};
+
+// Check if the flags are dead after the instruction at an index. The flags
+// are never live across blocks.
+bool peephole_flags_dead(std::vector<x86_instruction_t>& instructions, long index) {
+	for (long i = index + 1; i < instructions.size(); i++) {
+		if (x86_reads_flags(instructions[i])) {
+			return false;
+		} else if (x86_writes_flags(instructions[i])) {
+			return true;
+		}
+	}
+	return true;
+}
+
+// Check if an instruction is a move of a certain size.
+bool peephole_is_move(x86_instruction_t& instruction, long size) {
+	return instruction.opcode == xo_mov && instruction.size == size;
+}
+
+// pushq X; popq Y => movq X, Y
+bool peephole_push_pop(peephole_context_t& context, std::vector<x86_instruction_t>& instructions, long i) {
+	if (i + 1 >= instructions.size() || instructions[i].opcode != xo_push || instructions[i + 1].opcode != xo_pop) {
+		return false;
+	}
+	x86_operand_t source = instructions[i].operands[0];
+	x86_operand_t destination = instructions[i + 1].operands[0];
+	if (source.type == ot_memory && destination.type == ot_memory) {
+		return false;
+	}
+	instructions.erase(instructions.begin() + i, instructions.begin() + i + 2);
+	if (!x86_same_operand(source, destination)) {
+		instructions.insert(instructions.begin() + i, x86_make(xo_mov, 8, {source, destination}));
+	}
+	return true;
+}
+
+// movq R, M; movq M, S => movq R, M; movq R, S
+bool peephole_store_reload(peephole_context_t& context, std::vector<x86_instruction_t>& instructions, long i) {
+	if (i + 1 >= instructions.size() || !peephole_is_move(instructions[i], 8) || !peephole_is_move(instructions[i + 1], 8)) {
+		return false;
+	}
+	x86_instruction_t& store = instructions[i];
+	x86_instruction_t& reload = instructions[i + 1];
+	if (store.operands[0].type != ot_register || store.operands[1].type != ot_memory ||
+		!x86_same_operand(store.operands[1], reload.operands[0]) ||
+		reload.operands[1].type != ot_register)
+	{
+		return false;
+	}
+	// The register the address is computed from may not be overwritten.
+	if (store.operands[1].reg == store.operands[0].reg || store.operands[1].index == store.operands[0].reg) {
+		return false;
+	}
+	if (reload.operands[1].reg == store.operands[0].reg) {
+		instructions.erase(instructions.begin() + i + 1);
+	} else {
+		reload.operands[0] = store.operands[0];
+	}
+	return true;
+}
+
+// movq R, R =>
+// movl R, R =>
+bool peephole_self_move(peephole_context_t& context, std::vector<x86_instruction_t>& instructions, long i) {
+	x86_instruction_t& instruction = instructions[i];
+	if ((!peephole_is_move(instruction, 8) && !peephole_is_move(instruction, 4)) || instruction.operands[0].type != ot_register ||
+		!x86_same_operand(instruction.operands[0], instruction.operands[1]))
+	{
+		return false;
+	}
+	instructions.erase(instructions.begin() + i);
+	return true;
+}
+
+// jmp L; L: =>
+bool peephole_jump_to_next(peephole_context_t& context, std::vector<x86_instruction_t>& instructions, long i) {
+	x86_instruction_t& instruction = instructions[i];
+	if (instruction.opcode != xo_jmp || i + 1 != instructions.size()) {
+		return false;
+	}
+	for (int j = 0; j < context.fallthrough.size(); j++) {
+		if (instruction.operands[0].label == context.fallthrough[j]) {
+			instructions.erase(instructions.begin() + i);
+			return true;
+		}
+	}
+	return false;
+}
+
+// jcc L1; jmp L2; L1: => jncc L2
+bool peephole_branch_over_jump(peephole_context_t& context, std::vector<x86_instruction_t>& instructions, long i) {
+	if (i + 2 != instructions.size() || instructions[i].opcode != xo_j || instructions[i + 1].opcode != xo_jmp) {
+		return false;
+	}
+	for (int j = 0; j < context.fallthrough.size(); j++) {
+		if (instructions[i].operands[0].label == context.fallthrough[j]) {
+			instructions[i].condition = x86_negate(instructions[i].condition);
+			instructions[i].operands[0] = instructions[i + 1].operands[0];
+			instructions.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+// movq $0, R => xorl R, R
+bool peephole_zero_register(peephole_context_t& context, std::vector<x86_instruction_t>& instructions, long i) {
+	x86_instruction_t& instruction = instructions[i];
+	if (instruction.opcode != xo_mov || (instruction.size != 8 && instruction.size != 4) ||
+		instruction.operands[0].type != ot_immediate || instruction.operands[0].displacement != 0 ||
+		instruction.operands[1].type != ot_register || !peephole_flags_dead(instructions, i))
+	{
+		return false;
+	}
+	// Writing the 32-bit register clears the upper half as well.
+	x86_operand_t reg = instruction.operands[1];
+	instruction = x86_make(xo_xor, 4, {reg, reg});
+	return true;
+}
+
+// cmpq $0, R => testq R, R
+bool peephole_compare_zero(peephole_context_t& context, std::vector<x86_instruction_t>& instructions, long i) {
+	x86_instruction_t& instruction = instructions[i];
+	if (instruction.opcode != xo_cmp || instruction.operands[0].type != ot_immediate ||
+		instruction.operands[0].displacement != 0 || instruction.operands[1].type != ot_register)
+	{
+		return false;
+	}
+	x86_operand_t reg = instruction.operands[1];
+	instruction = x86_make(xo_test, instruction.size, {reg, reg});
+	return true;
+}
+
+// addq $0, X => (when the flags are dead)
+bool peephole_add_zero(peephole_context_t& context, std::vector<x86_instruction_t>& instructions, long i) {
+	x86_instruction_t& instruction = instructions[i];
+	if ((instruction.opcode != xo_add && instruction.opcode != xo_sub) ||
+		instruction.operands[0].type != ot_immediate || instruction.operands[0].displacement != 0 ||
+		!peephole_flags_dead(instructions, i))
+	{
+		return false;
+	}
+	instructions.erase(instructions.begin() + i);
+	return true;
+}
+
+// A peephole rule. A rule matches the instructions of a block starting at an
+// index and rewrites them in place, returning whether it changed anything.
+struct peephole_rule_t {
+	const char* name;
+	bool (*apply)(peephole_context_t&, std::vector<x86_instruction_t>&, long);
+};
+
+// All peephole rules, in the order they are tried.
+const peephole_rule_t peephole_rules[] = {
+	{"push-pop", peephole_push_pop},
+	{"store-reload", peephole_store_reload},
+	{"self-move", peephole_self_move},
+	{"jump-to-next", peephole_jump_to_next},
+	{"branch-over-jump", peephole_branch_over_jump},
+	{"zero-register", peephole_zero_register},
+	{"compare-zero", peephole_compare_zero},
+	{"add-zero", peephole_add_zero}
+};
+
+// The number of peephole rules.
+const long peephole_rule_count = sizeof(peephole_rules) / sizeof(peephole_rules[0]);
+
+// A peephole optimizer. The optimizer slides a window over the instructions
+// of every block, trying each rule at each position, and repeats until no
+// rule applies anymore. It runs on the final instructions, after frame
+// lowering.
+struct peephole_t {
+	// The number of times each rule applied.
+	std::vector<long> hits = std::vector<long>(peephole_rule_count, 0);
+
+	// Optimize a function.
+	void run(x86_function_t& function) {
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int i = 0; i < function.blocks.size(); i++) {
+				peephole_context_t context;
+				for (int j = i + 1; j < function.blocks.size(); j++) {
+					context.fallthrough.push_back(function.blocks[j].label);
+					if (!function.blocks[j].instructions.empty()) {
+						break;
+					}
+				}
+				std::vector<x86_instruction_t>& instructions = function.blocks[i].instructions;
+				for (long j = 0; j < instructions.size(); j++) {
+					for (long k = 0; k < peephole_rule_count; k++) {
+						if (peephole_rules[k].apply(context, instructions, j)) {
+							hits[k]++;
+							changed = true;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Print the number of times each rule applied.
+	void print_stats(std::FILE* file) {
+		for (long i = 0; i < peephole_rule_count; i++) {
+			fprintf(file, "peephole %s: %ld\n", peephole_rules[i].name, hits[i]);
+		}
+	}
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+
+#include "x86.hpp"
+
+// A spiller. The spiller rewrites every reference to a spilled virtual
+// register into a reference to it's frame slot. Where x86-64 does not allow a
+// memory operand the spilled register is instead reloaded into (and stored
+// back from) a fresh temporary register that lives only around the rewritten
+// instruction.
+struct spiller_t {
+	// The temporary registers created by the last rewrite.
+	std::vector<long> temporaries;
+
+	// Create a temporary register.
+	long create_temporary(x86_function_t& function) {
+		long temporary = function.create_register();
+		temporaries.push_back(temporary);
+		return temporary;
+	}
+
+	// Rewrite a function. The slots vector maps every virtual register to
+	// it's frame slot, or -1 if it is not spilled.
+	void rewrite(x86_function_t& function, std::vector<long>& slots) {
+		temporaries.clear();
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<x86_instruction_t> instructions;
+			for (int j = 0; j < function.blocks[i].instructions.size(); j++) {
+				x86_instruction_t instruction = function.blocks[i].instructions[j];
+				std::vector<x86_instruction_t> before;
+				std::vector<x86_instruction_t> after;
+				std::vector<x86_access_t> access;
+				bool has_memory = false;
+				for (int k = 0; k < instruction.operands.size(); k++) {
+					access.push_back(x86_operand_access(instruction, k));
+					if (instruction.operands[k].type == ot_memory) {
+						has_memory = true;
+					}
+				}
+				for (int k = 0; k < instruction.operands.size(); k++) {
+					x86_operand_t& operand = instruction.operands[k];
+					if (operand.type == ot_register && is_spilled(operand.reg, slots)) {
+						long slot = slots[operand.reg];
+						if (!has_memory && x86_allows_memory(instruction, k)) {
+							operand = x86_slot(slot);
+							has_memory = true;
+						} else {
+							operand.reg = create_temporary(function);
+							if (access[k] & ac_read) {
+								before.push_back(x86_make(xo_mov, 8, {x86_slot(slot), x86_reg(operand.reg)}));
+							}
+							if (access[k] & ac_write) {
+								after.push_back(x86_make(xo_mov, 8, {x86_reg(operand.reg), x86_slot(slot)}));
+							}
+						}
+					} else if (operand.type == ot_memory) {
+						if (is_spilled(operand.reg, slots)) {
+							long slot = slots[operand.reg];
+							operand.reg = create_temporary(function);
+							before.push_back(x86_make(xo_mov, 8, {x86_slot(slot), x86_reg(operand.reg)}));
+						}
+						if (is_spilled(operand.index, slots)) {
+							long slot = slots[operand.index];
+							operand.index = create_temporary(function);
+							before.push_back(x86_make(xo_mov, 8, {x86_slot(slot), x86_reg(operand.index)}));
+						}
+					}
+				}
+				instructions.insert(instructions.end(), before.begin(), before.end());
+				instructions.push_back(instruction);
+				instructions.insert(instructions.end(), after.begin(), after.end());
+			}
+			function.blocks[i].instructions = instructions;
+		}
+	}
+
+	// Check if a register is a spilled virtual register.
+	static bool is_spilled(long reg, std::vector<long>& slots) {
+		return x86_is_virtual(reg) && reg < slots.size() && slots[reg] >= 0;
+	}
+};
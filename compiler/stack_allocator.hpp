@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include "x86.hpp"
+#include "liveness.hpp"
+#include "spiller.hpp"
+
+// The scratch registers available to the stack allocator. Only caller-saved
+// registers are used, so the prologue never has to save any registers.
+const std::vector<long> stack_allocator_scratch = {rg_rax, rg_rcx, rg_rdx, rg_rsi, rg_rdi, rg_r8, rg_r9, rg_r10, rg_r11};
+
+// The scratch registers holding expression temporaries. %rax is left out so
+// it stays free for return values and divisions, and %r10 and %r11 so the
+// spiller always has registers for an instruction whose address and
+// destination are both spilled, even while the argument registers of a call
+// are live.
+const std::vector<long> stack_allocator_pool = {rg_rcx, rg_rdx, rg_rsi, rg_rdi, rg_r8, rg_r9};
+
+// A stack register allocator, used at -O0. Expression temporaries, the
+// virtual registers referenced within a single block, are kept in a pool of
+// scratch registers. A temporary only gets a frame slot when the pool is
+// exhausted or when it lives across a call, as does every other virtual
+// register. The temporaries created by the spiller are then assigned scratch
+// registers that are free around the instruction that uses them.
+struct stack_allocator_t {
+	// Assign registers from a list to the eligible virtual registers of a
+	// block, in order of their first reference. Virtual registers that find
+	// no free register keep an assignment of -1.
+	void assign_block(x86_block_t& block, std::vector<long>& assignment, std::vector<bool>& eligible, const std::vector<long>& registers) {
+		physical_liveness_t liveness(block);
+		// Find the first and last instruction referencing each register.
+		std::vector<long> first(assignment.size(), -1);
+		std::vector<long> last(assignment.size(), -1);
+		std::vector<long> seen;
+		for (int i = 0; i < block.instructions.size(); i++) {
+			std::vector<long> uses;
+			std::vector<long> defs;
+			x86_uses_defs(block.instructions[i], uses, defs);
+			uses.insert(uses.end(), defs.begin(), defs.end());
+			for (int j = 0; j < uses.size(); j++) {
+				if (x86_is_virtual(uses[j]) && eligible[uses[j]]) {
+					if (first[uses[j]] < 0) {
+						first[uses[j]] = i;
+						seen.push_back(uses[j]);
+					}
+					last[uses[j]] = i;
+				}
+			}
+		}
+		// Assign registers in order of first reference.
+		std::vector<std::pair<long, long>> order;
+		for (int i = 0; i < seen.size(); i++) {
+			order.push_back({first[seen[i]], seen[i]});
+		}
+		std::sort(order.begin(), order.end());
+		std::vector<long> held_until(16, -1);
+		for (int i = 0; i < order.size(); i++) {
+			long reg = order[i].second;
+			x86_register_set_t busy = liveness.busy(first[reg], last[reg]);
+			for (int j = 0; j < registers.size(); j++) {
+				long scratch = registers[j];
+				if (!(busy & (1ul << scratch)) && held_until[scratch] < first[reg]) {
+					assignment[reg] = scratch;
+					held_until[scratch] = last[reg];
+					break;
+				}
+			}
+		}
+	}
+
+	// Allocate the registers of a function.
+	void allocate(x86_function_t& function) {
+		// Find the block referencing each virtual register, or -2 if several
+		// blocks do.
+		std::vector<long> home(function.register_count, -1);
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<x86_instruction_t>& instructions = function.blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				std::vector<long> uses;
+				std::vector<long> defs;
+				x86_uses_defs(instructions[j], uses, defs);
+				uses.insert(uses.end(), defs.begin(), defs.end());
+				for (int k = 0; k < uses.size(); k++) {
+					long& block = home[uses[k]];
+					if (x86_is_virtual(uses[k]) && block != i) {
+						block = block == -1 ? i : -2;
+					}
+				}
+			}
+		}
+		// Keep the expression temporaries in the pool.
+		std::vector<long> assignment(function.register_count, -1);
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<bool> eligible(function.register_count, false);
+			for (long reg = x86_first_virtual; reg < function.register_count; reg++) {
+				eligible[reg] = home[reg] == i;
+			}
+			assign_block(function.blocks[i], assignment, eligible, stack_allocator_pool);
+		}
+		x86_assign_registers(function, assignment);
+		// Give every other virtual register it's own frame slot.
+		std::vector<long> slots(function.register_count, -1);
+		for (long reg = x86_first_virtual; reg < function.register_count; reg++) {
+			if (home[reg] != -1 && assignment[reg] < 0) {
+				slots[reg] = function.create_slot(8);
+			}
+		}
+		spiller_t spiller;
+		spiller.rewrite(function, slots);
+		std::vector<long> temporaries(function.register_count, -1);
+		std::vector<bool> eligible(function.register_count, false);
+		for (int i = 0; i < spiller.temporaries.size(); i++) {
+			eligible[spiller.temporaries[i]] = true;
+		}
+		for (int i = 0; i < function.blocks.size(); i++) {
+			assign_block(function.blocks[i], temporaries, eligible, stack_allocator_scratch);
+		}
+		for (int i = 0; i < spiller.temporaries.size(); i++) {
+			if (temporaries[spiller.temporaries[i]] < 0) {
+				fprintf(stderr, "internal compiler error: no register for a spill temporary\n");
+				exit(4);
+			}
+		}
+		x86_assign_registers(function, temporaries);
+	}
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// The place of a string literal in the string pool: the string whose bytes
+// it shares, and the offset it starts at in that string.
+struct string_pool_entry_t {
+	long	owner;
+	long	offset;
+};
+
+// Lay out a string pool. A string that is a suffix of another string,
+// including an identical one, shares the tail of it and it's null
+// terminator, so only the strings that are no suffix of any other take up
+// space of their own. Sorted by their reversed characters, every string is
+// followed by the strings ending in it, the first of which ends in all
+// strings it's owner ends in.
+std::vector<string_pool_entry_t> string_pool_layout(std::vector<std::string>& strings) {
+	std::vector<std::string> reversed;
+	std::vector<long> order;
+	for (int i = 0; i < strings.size(); i++) {
+		reversed.push_back(std::string(strings[i].rbegin(), strings[i].rend()));
+		order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&](long a, long b) {
+		return reversed[a] < reversed[b];
+	});
+	std::vector<string_pool_entry_t> entries(strings.size());
+	for (long i = (long)order.size() - 1; i >= 0; i--) {
+		long string = order[i];
+		entries[string] = {string, 0};
+		if (i + 1 < order.size()) {
+			std::string& next = reversed[order[i + 1]];
+			if (next.compare(0, reversed[string].size(), reversed[string]) == 0) {
+				long owner = entries[order[i + 1]].owner;
+				entries[string] = {owner, (long)(strings[owner].size() - strings[string].size())};
+			}
+		}
+	}
+	return entries;
+}
@@ -0,0 +1,702 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "output_buffer.hpp"
+
+// All x86-64 general purpose registers, in encoding order.
+enum x86_register_t {
+	rg_rax,
+	rg_rcx,
+	rg_rdx,
+	rg_rbx,
+	rg_rsp,
+	rg_rbp,
+	rg_rsi,
+	rg_rdi,
+	rg_r8,
+	rg_r9,
+	rg_r10,
+	rg_r11,
+	rg_r12,
+	rg_r13,
+	rg_r14,
+	rg_r15
+};
+
+// The first virtual register. Register numbers below this are physical
+// registers, register numbers above it are virtual registers that must be
+// replaced by the register allocator.
+const long x86_first_virtual = 16;
+
+// All general purpose register names, indexed by operand size (1, 2, 4 and 8
+// bytes) and register.
+std::string x86_register_str[4][16] = {
+	{"%al", "%cl", "%dl", "%bl", "%spl", "%bpl", "%sil", "%dil", "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b"},
+	{"%ax", "%cx", "%dx", "%bx", "%sp", "%bp", "%si", "%di", "%r8w", "%r9w", "%r10w", "%r11w", "%r12w", "%r13w", "%r14w", "%r15w"},
+	{"%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi", "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"},
+	{"%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi", "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"}
+};
+
+// The System V AMD64 ABI integer argument registers.
+const long x86_argument_registers[6] = {rg_rdi, rg_rsi, rg_rdx, rg_rcx, rg_r8, rg_r9};
+
+// The System V AMD64 ABI caller-saved registers.
+const std::vector<long> x86_caller_saved = {rg_rax, rg_rcx, rg_rdx, rg_rsi, rg_rdi, rg_r8, rg_r9, rg_r10, rg_r11};
+
+// The System V AMD64 ABI callee-saved registers, except for %rbp which always
+// holds the frame pointer.
+const std::vector<long> x86_callee_saved = {rg_rbx, rg_r12, rg_r13, rg_r14, rg_r15};
+
+// The registers available to the register allocators, caller-saved first so
+// they are preferred over registers that must be saved in the prologue.
+const std::vector<long> x86_allocatable = {rg_rax, rg_rcx, rg_rdx, rg_rsi, rg_rdi, rg_r8, rg_r9, rg_r10, rg_r11, rg_rbx, rg_r12, rg_r13, rg_r14, rg_r15};
+
+// The size of the red zone, the area below %rsp that signal handlers leave
+// alone and leaf functions may use without moving %rsp.
+const long x86_red_zone = 128;
+
+// All x86-64 opcodes used by the compiler.
+enum x86_opcode_t {
+	xo_mov,
+	xo_movzb,
+	xo_movsb,
+	xo_movsw,
+	xo_movsl,
+	xo_lea,
+	xo_add,
+	xo_sub,
+	xo_imul,
+	xo_idiv,
+	xo_cqto,
+	xo_cltd,
+	xo_neg,
+	xo_not,
+	xo_and,
+	xo_or,
+	xo_xor,
+	xo_sal,
+	xo_sar,
+	xo_shr,
+	xo_cmp,
+	xo_test,
+	xo_set,
+	xo_cmov,
+	xo_jmp,
+	xo_j,
+	xo_call,
+	xo_ret,
+	xo_push,
+	xo_pop
+};
+
+// All x86-64 opcodes as mnemonic stems.
+std::string x86_opcode_str[] = {
+	"mov",
+	"movzb",
+	"movsb",
+	"movsw",
+	"movsl",
+	"lea",
+	"add",
+	"sub",
+	"imul",
+	"idiv",
+	"cqto",
+	"cltd",
+	"neg",
+	"not",
+	"and",
+	"or",
+	"xor",
+	"sal",
+	"sar",
+	"shr",
+	"cmp",
+	"test",
+	"set",
+	"cmov",
+	"jmp",
+	"j",
+	"call",
+	"ret",
+	"push",
+	"pop"
+};
+
+// All x86-64 condition codes, in encoding order. The negation of a condition
+// code is the condition code with the lowest bit flipped.
+enum x86_condition_t {
+	cc_o,
+	cc_no,
+	cc_b,
+	cc_ae,
+	cc_e,
+	cc_ne,
+	cc_be,
+	cc_a,
+	cc_s,
+	cc_ns,
+	cc_p,
+	cc_np,
+	cc_l,
+	cc_ge,
+	cc_le,
+	cc_g
+};
+
+// All x86-64 condition codes as mnemonic suffixes.
+std::string x86_condition_str[] = {
+	"o",
+	"no",
+	"b",
+	"ae",
+	"e",
+	"ne",
+	"be",
+	"a",
+	"s",
+	"ns",
+	"p",
+	"np",
+	"l",
+	"ge",
+	"le",
+	"g"
+};
+
+// Negate a condition code.
+x86_condition_t x86_negate(x86_condition_t condition) {
+	return x86_condition_t(condition ^ 1);
+}
+
+// All operand types.
+enum x86_operand_type_t {
+	ot_none,
+	ot_register,
+	ot_immediate,
+	ot_memory,
+	ot_label,
+	ot_symbol
+};
+
+// An operand. A memory operand addresses either base + index * scale +
+// displacement, a frame slot, an incoming stack argument or a RIP-relative
+// symbol, plus the displacement. Frame slots and incoming stack arguments are
+// resolved to base registers during frame lowering.
+struct x86_operand_t {
+	x86_operand_type_t	type = ot_none;
+	long				reg = -1;
+	long				index = -1;
+	long				scale = 1;
+	long				displacement = 0;
+	long				slot = -1;
+	long				argument = -1;
+	long				label = -1;
+	std::string			symbol;
+};
+
+// Make a register operand.
+x86_operand_t x86_reg(long reg) {
+	x86_operand_t operand;
+	operand.type = ot_register;
+	operand.reg = reg;
+	return operand;
+}
+
+// Make an immediate operand.
+x86_operand_t x86_imm(long value) {
+	x86_operand_t operand;
+	operand.type = ot_immediate;
+	operand.displacement = value;
+	return operand;
+}
+
+// Make a memory operand addressing base + displacement.
+x86_operand_t x86_mem(long base, long displacement = 0) {
+	x86_operand_t operand;
+	operand.type = ot_memory;
+	operand.reg = base;
+	operand.displacement = displacement;
+	return operand;
+}
+
+// Make a memory operand addressing base + index * scale.
+x86_operand_t x86_mem(long base, long index, long scale) {
+	x86_operand_t operand = x86_mem(base);
+	operand.index = index;
+	operand.scale = scale;
+	return operand;
+}
+
+// Make a memory operand addressing a frame slot.
+x86_operand_t x86_slot(long slot) {
+	x86_operand_t operand;
+	operand.type = ot_memory;
+	operand.slot = slot;
+	return operand;
+}
+
+// Make a memory operand addressing an incoming stack argument.
+x86_operand_t x86_argument(long argument) {
+	x86_operand_t operand;
+	operand.type = ot_memory;
+	operand.argument = argument;
+	return operand;
+}
+
+// Make a memory operand addressing a symbol relative to RIP.
+x86_operand_t x86_rip(std::string symbol) {
+	x86_operand_t operand;
+	operand.type = ot_memory;
+	operand.symbol = symbol;
+	return operand;
+}
+
+// Make a label operand.
+x86_operand_t x86_label(long label) {
+	x86_operand_t operand;
+	operand.type = ot_label;
+	operand.label = label;
+	return operand;
+}
+
+// Make a symbol operand.
+x86_operand_t x86_symbol(std::string symbol) {
+	x86_operand_t operand;
+	operand.type = ot_symbol;
+	operand.symbol = symbol;
+	return operand;
+}
+
+// Mangle an external symbol name for the target platform.
+std::string x86_mangle(std::string symbol) {
+	#ifdef __APPLE__
+	return "_" + symbol;
+	#else
+	return symbol;
+	#endif
+}
+
+// An instruction. Operands are stored in AT&T order, so the destination
+// operand is always the last operand.
+struct x86_instruction_t {
+	x86_opcode_t				opcode;
+	x86_condition_t				condition = cc_e;
+	long						size = 8;
+	std::vector<x86_operand_t>	operands;
+	// The number of arguments passed in registers, only used by calls.
+	long						arguments = 0;
+};
+
+// Make an instruction.
+x86_instruction_t x86_make(x86_opcode_t opcode, long size, std::vector<x86_operand_t> operands = {}) {
+	x86_instruction_t instruction;
+	instruction.opcode = opcode;
+	instruction.size = size;
+	instruction.operands = operands;
+	return instruction;
+}
+
+// Make an instruction that depends on a condition code.
+x86_instruction_t x86_make(x86_opcode_t opcode, x86_condition_t condition, std::vector<x86_operand_t> operands) {
+	x86_instruction_t instruction = x86_make(opcode, 8, operands);
+	instruction.condition = condition;
+	return instruction;
+}
+
+// A basic block. Successors are block indices. Loop headers are aligned
+// when emitted.
+struct x86_block_t {
+	long							label;
+	std::vector<x86_instruction_t>	instructions;
+	std::vector<long>				successors;
+	long							loop_depth = 0;
+	bool							loop_header = false;
+};
+
+// A frame slot, aligned to a number of bytes. The offset is assigned during
+// frame lowering.
+struct x86_slot_t {
+	long	size;
+	long	alignment = 8;
+	long	offset = 0;
+};
+
+// A jump table of 32-bit offsets from the table to the labels of it's
+// targets.
+struct x86_jump_table_t {
+	long				label;
+	std::vector<long>	targets;
+};
+
+// A function.
+struct x86_function_t {
+	identifier_t				identifier;
+	std::vector<x86_block_t>	blocks;
+	std::vector<x86_slot_t>		slots;
+	long						register_count = x86_first_virtual;
+	// The callee-saved registers the prologue must save.
+	std::vector<long>			saved_registers;
+	// The jump tables emitted after the function.
+	std::vector<x86_jump_table_t>	jump_tables;
+
+	// Create a new virtual register.
+	long create_register() {
+		return register_count++;
+	}
+
+	// Create a new frame slot and return it's index.
+	long create_slot(long size, long alignment = 8) {
+		x86_slot_t slot;
+		slot.size = size;
+		slot.alignment = alignment;
+		slots.push_back(slot);
+		return slots.size() - 1;
+	}
+};
+
+// Check if a register number refers to a virtual register.
+bool x86_is_virtual(long reg) {
+	return reg >= x86_first_virtual;
+}
+
+// Replace the virtual registers in a function by the physical registers
+// assigned to them, leaving the registers assigned -1 alone. Moves of a
+// register onto itself are removed, and the callee-saved registers that are
+// assigned are recorded for the prologue.
+void x86_assign_registers(x86_function_t& function, std::vector<long>& assignment) {
+	std::vector<bool> assigned(x86_first_virtual, false);
+	for (int i = 0; i < function.blocks.size(); i++) {
+		std::vector<x86_instruction_t>& instructions = function.blocks[i].instructions;
+		std::vector<x86_instruction_t> kept;
+		for (int j = 0; j < instructions.size(); j++) {
+			for (int k = 0; k < instructions[j].operands.size(); k++) {
+				x86_operand_t& operand = instructions[j].operands[k];
+				if (operand.type != ot_register && operand.type != ot_memory) {
+					continue;
+				}
+				if (x86_is_virtual(operand.reg) && assignment[operand.reg] >= 0) {
+					operand.reg = assignment[operand.reg];
+					assigned[operand.reg] = true;
+				}
+				if (x86_is_virtual(operand.index) && assignment[operand.index] >= 0) {
+					operand.index = assignment[operand.index];
+					assigned[operand.index] = true;
+				}
+			}
+			x86_instruction_t& instruction = instructions[j];
+			if (instruction.opcode == xo_mov && instruction.size >= 4 &&
+				instruction.operands[0].type == ot_register &&
+				instruction.operands[1].type == ot_register &&
+				instruction.operands[0].reg == instruction.operands[1].reg) {
+				continue;
+			}
+			kept.push_back(instruction);
+		}
+		instructions = kept;
+	}
+	function.saved_registers.clear();
+	for (int i = 0; i < x86_callee_saved.size(); i++) {
+		if (assigned[x86_callee_saved[i]]) {
+			function.saved_registers.push_back(x86_callee_saved[i]);
+		}
+	}
+}
+
+// All ways an instruction can access a register operand.
+enum x86_access_t {
+	ac_none = 0,
+	ac_read = 1,
+	ac_write = 2,
+	ac_read_write = 3
+};
+
+// Get the way an instruction accesses it's register operand at the specified
+// index. Registers used to address memory operands are always read.
+x86_access_t x86_operand_access(x86_instruction_t& instruction, long index) {
+	x86_opcode_t opcode = instruction.opcode;
+	if (instruction.operands[index].type != ot_register) {
+		return ac_none;
+	}
+	if (instruction.operands.size() == 3) {
+		// imulq $k, source, destination
+		return index == 2 ? ac_write : ac_read;
+	} else if (instruction.operands.size() == 2) {
+		if (index == 0 || opcode == xo_cmp || opcode == xo_test) {
+			return ac_read;
+		} else if (opcode == xo_mov || opcode == xo_movzb || opcode == xo_movsb || opcode == xo_movsw ||
+				   opcode == xo_movsl || opcode == xo_lea)
+		{
+			return ac_write;
+		}
+		return ac_read_write;
+	}
+	if (opcode == xo_neg || opcode == xo_not) {
+		return ac_read_write;
+	} else if (opcode == xo_set || opcode == xo_pop) {
+		return ac_write;
+	}
+	return ac_read;
+}
+
+// Check if the operand at the specified index may be a memory operand.
+// x86-64 allows at most one memory operand per instruction, which is not
+// checked here.
+bool x86_allows_memory(x86_instruction_t& instruction, long index) {
+	x86_opcode_t opcode = instruction.opcode;
+	if (opcode == xo_imul && instruction.operands.size() == 3) {
+		return index == 1;
+	} else if (opcode == xo_movzb || opcode == xo_movsb || opcode == xo_movsw || opcode == xo_movsl ||
+			   opcode == xo_imul || opcode == xo_lea || opcode == xo_cmov)
+	{
+		return index == 0;
+	} else if (opcode == xo_sal || opcode == xo_sar || opcode == xo_shr) {
+		return index == 1;
+	} else if (opcode == xo_mov && instruction.operands[0].type == ot_immediate) {
+		long value = instruction.operands[0].displacement;
+		return value == (int)value;
+	}
+	return true;
+}
+
+// Get the physical registers implicitly read by an instruction.
+std::vector<long> x86_implicit_uses(x86_instruction_t& instruction) {
+	if (instruction.opcode == xo_cqto || instruction.opcode == xo_cltd || instruction.opcode == xo_ret) {
+		return {rg_rax};
+	} else if (instruction.opcode == xo_idiv) {
+		return {rg_rax, rg_rdx};
+	} else if (instruction.opcode == xo_imul && instruction.operands.size() == 1) {
+		return {rg_rax};
+	} else if (instruction.opcode == xo_call) {
+		return std::vector<long>(x86_argument_registers, x86_argument_registers + instruction.arguments);
+	}
+	return {};
+}
+
+// Get the physical registers implicitly written by an instruction.
+std::vector<long> x86_implicit_defs(x86_instruction_t& instruction) {
+	if (instruction.opcode == xo_cqto || instruction.opcode == xo_cltd) {
+		return {rg_rdx};
+	} else if (instruction.opcode == xo_idiv) {
+		return {rg_rax, rg_rdx};
+	} else if (instruction.opcode == xo_imul && instruction.operands.size() == 1) {
+		return {rg_rax, rg_rdx};
+	} else if (instruction.opcode == xo_call) {
+		return x86_caller_saved;
+	}
+	return {};
+}
+
+// Get the registers read and written by an instruction, including implicit
+// registers and registers used to address memory.
+void x86_uses_defs(x86_instruction_t& instruction, std::vector<long>& uses, std::vector<long>& defs) {
+	uses = x86_implicit_uses(instruction);
+	defs = x86_implicit_defs(instruction);
+	for (int i = 0; i < instruction.operands.size(); i++) {
+		x86_operand_t& operand = instruction.operands[i];
+		if (operand.type == ot_register) {
+			x86_access_t access = x86_operand_access(instruction, i);
+			if (access & ac_read) {
+				uses.push_back(operand.reg);
+			}
+			if (access & ac_write) {
+				defs.push_back(operand.reg);
+			}
+		} else if (operand.type == ot_memory) {
+			if (operand.reg >= 0) {
+				uses.push_back(operand.reg);
+			}
+			if (operand.index >= 0) {
+				uses.push_back(operand.index);
+			}
+		}
+	}
+}
+
+// Get the size of the register operand at the specified index.
+long x86_operand_size(x86_instruction_t& instruction, long index) {
+	if (instruction.opcode == xo_set) {
+		return 1;
+	} else if (index == 0 && instruction.opcode == xo_movsl) {
+		return 4;
+	} else if (index == 0 && instruction.opcode == xo_movsw) {
+		return 2;
+	} else if (index == 0 && (instruction.opcode == xo_movzb ||
+							  instruction.opcode == xo_movsb ||
+							  instruction.opcode == xo_sal ||
+							  instruction.opcode == xo_sar ||
+							  instruction.opcode == xo_shr))
+	{
+		return 1;
+	}
+	return instruction.size;
+}
+
+// Check if two operands are the same.
+bool x86_same_operand(x86_operand_t& a, x86_operand_t& b) {
+	return a.type == b.type &&
+		   a.reg == b.reg &&
+		   a.index == b.index &&
+		   a.scale == b.scale &&
+		   a.displacement == b.displacement &&
+		   a.slot == b.slot &&
+		   a.argument == b.argument &&
+		   a.label == b.label &&
+		   a.symbol == b.symbol;
+}
+
+// Check if an instruction reads the flags.
+bool x86_reads_flags(x86_instruction_t& instruction) {
+	return instruction.opcode == xo_j || instruction.opcode == xo_set || instruction.opcode == xo_cmov;
+}
+
+// Check if an instruction always overwrites the flags. Shifts by %cl leave
+// the flags alone when the count is zero, so they do not count.
+bool x86_writes_flags(x86_instruction_t& instruction) {
+	x86_opcode_t opcode = instruction.opcode;
+	return opcode == xo_add ||
+		   opcode == xo_sub ||
+		   opcode == xo_imul ||
+		   opcode == xo_idiv ||
+		   opcode == xo_neg ||
+		   opcode == xo_and ||
+		   opcode == xo_or ||
+		   opcode == xo_xor ||
+		   opcode == xo_cmp ||
+		   opcode == xo_test;
+}
+
+// Append the AT&T name of a register. Every virtual register must have been
+// assigned a physical one by now.
+void x86_write_register(output_buffer_t& out, long reg, long size) {
+	if (x86_is_virtual(reg)) {
+		fprintf(stderr, "internal compiler error: virtual register %ld was never assigned\n", reg - x86_first_virtual);
+		exit(4);
+	}
+	long row = size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3;
+	out.append(x86_register_str[row][reg]);
+}
+
+// Append the AT&T syntax of an operand.
+void x86_write_operand(output_buffer_t& out, x86_operand_t& operand, long size) {
+	if (operand.type == ot_register) {
+		x86_write_register(out, operand.reg, size);
+		return;
+	} else if (operand.type == ot_immediate) {
+		out.append('$').append_integer(operand.displacement);
+		return;
+	} else if (operand.type == ot_label) {
+		out.append('L').append_integer(operand.label);
+		return;
+	} else if (operand.type == ot_symbol) {
+		out.append(operand.symbol);
+		return;
+	}
+	// ot_memory
+	if (!operand.symbol.empty()) {
+		out.append(operand.symbol);
+		if (operand.displacement > 0) {
+			out.append('+');
+		}
+		if (operand.displacement) {
+			out.append_integer(operand.displacement);
+		}
+		out.append("(%rip)");
+		return;
+	} else if (operand.slot >= 0 || operand.argument >= 0) {
+		if (operand.slot >= 0) {
+			out.append("slot").append_integer(operand.slot);
+		} else {
+			out.append("arg").append_integer(operand.argument);
+		}
+		if (operand.displacement) {
+			out.append('+').append_integer(operand.displacement);
+		}
+		return;
+	}
+	if (operand.displacement) {
+		out.append_integer(operand.displacement);
+	}
+	out.append('(');
+	if (operand.reg >= 0) {
+		x86_write_register(out, operand.reg, 8);
+	}
+	if (operand.index >= 0) {
+		out.append(',');
+		x86_write_register(out, operand.index, 8);
+		out.append(',').append_integer(operand.scale);
+	}
+	out.append(')');
+}
+
+// Append the assembler syntax of a range of a string, quoted. Unprintable
+// characters are written as three-digit octal escapes, which never run into
+// the next character.
+void x86_write_string(output_buffer_t& out, const std::string& string, long begin, long end) {
+	out.append('"');
+	for (long i = begin; i < end; i++) {
+		unsigned char ch = string[i];
+		if (ch == '"' || ch == '\\') {
+			out.append('\\').append((char)ch);
+		} else if (ch < ' ' || ch > '~') {
+			out.append('\\');
+			out.append((char)('0' + (ch >> 6)));
+			out.append((char)('0' + (ch >> 3 & 7)));
+			out.append((char)('0' + (ch & 7)));
+		} else {
+			out.append((char)ch);
+		}
+	}
+	out.append('"');
+}
+
+// Get the size suffix of an instruction.
+char x86_suffix(long size) {
+	return size == 1 ? 'b' : size == 2 ? 'w' : size == 4 ? 'l' : 'q';
+}
+
+// Append the AT&T mnemonic of an instruction, returning it's length.
+long x86_write_mnemonic(output_buffer_t& out, x86_instruction_t& instruction) {
+	long start = out.data.size();
+	x86_opcode_t opcode = instruction.opcode;
+	if (opcode == xo_mov &&
+		instruction.operands[0].type == ot_immediate &&
+		instruction.operands[1].type == ot_register &&
+		instruction.operands[0].displacement != (int)instruction.operands[0].displacement)
+	{
+		out.append("movabsq");
+		return out.data.size() - start;
+	}
+	out.append(x86_opcode_str[opcode]);
+	if (opcode == xo_set || opcode == xo_j) {
+		out.append(x86_condition_str[instruction.condition]);
+	} else if (opcode == xo_cmov) {
+		out.append(x86_condition_str[instruction.condition]).append(x86_suffix(instruction.size));
+	} else if (opcode == xo_call || opcode == xo_ret) {
+		out.append('q');
+	} else if (opcode != xo_jmp && opcode != xo_cqto && opcode != xo_cltd) {
+		out.append(x86_suffix(instruction.size));
+	}
+	return out.data.size() - start;
+}
+
+// Append the AT&T syntax of an instruction, as a line.
+void x86_write_instruction(output_buffer_t& out, x86_instruction_t& instruction) {
+	out.append("    ");
+	long length = x86_write_mnemonic(out, instruction);
+	for (int i = 0; i < instruction.operands.size(); i++) {
+		if (i == 0) {
+			out.append(length < 8 ? 8 - length : 1, ' ');
+		} else {
+			out.append(", ");
+		}
+		// Indirect jumps go through a register or memory.
+		if (instruction.opcode == xo_jmp && instruction.operands[i].type != ot_label) {
+			out.append('*');
+		}
+		x86_write_operand(out, instruction.operands[i], x86_operand_size(instruction, i));
+	}
+	out.end_line();
+}
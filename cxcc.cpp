@@ -1,40 +1,192 @@
-#include <ctime>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
 #include <iostream>
-#include <sstream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
 
 #include "parser/parser.hpp"
 #include "semantic/semantic_analyzer.hpp"
+#include "ir/generator.hpp"
+#include "ir/verifier.hpp"
+#include "ir/ssa.hpp"
+#include "ir/dump.hpp"
 #include "compiler/compiler.hpp"
+#include "compiler/elf.hpp"
+#include "compiler/jit.hpp"
+
+// The environment, passed on to gcc.
+extern char** environ;
 
 // Print the usage text and exit.
 void usage(char* exe) {
-	std::cerr << "Usage: " << exe << " <in> [out [-o]]" << std::endl;
+	std::cerr << "Usage: " << exe << " <in> [out [-o]] [options]" << std::endl;
 	std::cerr << "    Compiles C source <in> to x86-64 assembly and stores the    " << std::endl;
 	std::cerr << "    output in [out]. If no value for [out] is provided, the     " << std::endl;
 	std::cerr << "    output is stored in the file <in>.s. If the option -o is    " << std::endl;
-	std::cerr << "    provided, gcc is used to assemble [out] and store the image " << std::endl;
-	std::cerr << "    in [out].                                                   " << std::endl;
+	std::cerr << "    provided, the assembly is piped into gcc, which assembles   " << std::endl;
+	std::cerr << "    and links it into the image [out].                          " << std::endl;
+	std::cerr << "Options:                                                        " << std::endl;
+	std::cerr << "    -O<level>    Set the optimization level, from 0 to 2. The   " << std::endl;
+	std::cerr << "                 default is 1. From -O1 on, locals whose address" << std::endl;
+	std::cerr << "                 is never taken are promoted to SSA values and  " << std::endl;
+	std::cerr << "                 registers are allocated by linear scan. At -O2 " << std::endl;
+	std::cerr << "                 registers are allocated by graph coloring with " << std::endl;
+	std::cerr << "                 iterated coalescing instead.                   " << std::endl;
+	std::cerr << "    -c           Encode the program into an ELF64 relocatable   " << std::endl;
+	std::cerr << "                 object with the integrated assembler instead of" << std::endl;
+	std::cerr << "                 emitting assembly; [out] defaults to <in>.o.   " << std::endl;
+	std::cerr << "                 With -o, gcc only links the object.            " << std::endl;
+	std::cerr << "    --run        Compile the program into memory and run it in  " << std::endl;
+	std::cerr << "                 this process, exiting with the status main     " << std::endl;
+	std::cerr << "                 returns. The arguments after --run are passed  " << std::endl;
+	std::cerr << "                 to main.                                       " << std::endl;
+	std::cerr << "    --dump-ir    Print the intermediate representation to the   " << std::endl;
+	std::cerr << "                 standard output instead of compiling.          " << std::endl;
+	std::cerr << "    --stats      Print per-function compilation statistics to   " << std::endl;
+	std::cerr << "                 the standard error.                            " << std::endl;
+	std::cerr << "    -fno-omit-frame-pointer                                     " << std::endl;
+	std::cerr << "                 Keep the frame pointer in leaf functions, which" << std::endl;
+	std::cerr << "                 otherwise address their locals from %rsp.      " << std::endl;
+	std::cerr << "    -Wpadded     Warn about the padding in the layout of struct " << std::endl;
+	std::cerr << "                 types, and note the bytes reordering their     " << std::endl;
+	std::cerr << "                 fields would save.                             " << std::endl;
 	exit(1);
 }
 
+// Start gcc with the specified arguments. If input is given, gcc reads it's
+// standard input from a pipe whose other end is stored there. Returns the
+// process id of gcc, or -1 if it could not be started.
+pid_t spawn_gcc(std::vector<std::string> arguments, int* input) {
+	int ends[2] = {-1, -1};
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if (input) {
+		// Neither end may leak into gcc or the assembler it starts, or the
+		// read end would never see the end of the input.
+		if (pipe(ends) < 0) {
+			posix_spawn_file_actions_destroy(&actions);
+			return -1;
+		}
+		fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+		fcntl(ends[1], F_SETFD, FD_CLOEXEC);
+		posix_spawn_file_actions_adddup2(&actions, ends[0], STDIN_FILENO);
+	}
+	std::vector<char*> argv = {(char*)"gcc"};
+	for (int i = 0; i < arguments.size(); i++) {
+		argv.push_back((char*)arguments[i].c_str());
+	}
+	argv.push_back(nullptr);
+	pid_t pid;
+	int error = posix_spawnp(&pid, "gcc", &actions, nullptr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	if (input) {
+		close(ends[0]);
+		if (error) {
+			close(ends[1]);
+		} else {
+			*input = ends[1];
+		}
+	}
+	if (error) {
+		errno = error;
+		return -1;
+	}
+	return pid;
+}
+
+// Wait for a process, returning it's exit status, or 128 plus the number of
+// the signal that ended it.
+int wait_status(pid_t pid) {
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			return 1;
+		}
+	}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// Create a uniquely named temporary file in $TMPDIR, or /tmp if it is not
+// set, storing it's path and returning an open file descriptor.
+int temporary_file(std::string& path) {
+	const char* directory = getenv("TMPDIR");
+	path = std::string(directory && *directory ? directory : "/tmp") + "/cxccXXXXXX";
+	std::vector<char> name(path.begin(), path.end());
+	name.push_back('\0');
+	int fd = mkstemp(name.data());
+	if (fd < 0) {
+		std::cerr << "Could not create a temporary file in \"" << path.substr(0, path.size() - 11) << "\": " << std::strerror(errno) << std::endl;
+		exit(1);
+	}
+	path = name.data();
+	return fd;
+}
+
 // Entry point.
 int main(int argc, char** argv) {
-	if (argc != 2 && argc != 3 && argc != 4) {
-		usage(argv[0]);
-	} else if (argc == 4) {
-		if (std::string(argv[3]) != "-o") {
+	// Parse the arguments.
+	std::vector<std::string> positional;
+	bool assemble = false;
+	bool object = false;
+	bool run = false;
+	std::vector<char*> run_arguments;
+	bool dump_ir = false;
+	long optimization = 1;
+	bool stats = false;
+	bool omit_frame_pointer = true;
+	bool warn_padded = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-o") {
+			assemble = true;
+		} else if (arg == "-c") {
+			object = true;
+		} else if (arg == "--run") {
+			// The remaining arguments are the program's.
+			run = true;
+			run_arguments.assign(argv + i + 1, argv + argc);
+			break;
+		} else if (arg == "--dump-ir") {
+			dump_ir = true;
+		} else if (arg == "--stats") {
+			stats = true;
+		} else if (arg == "-fno-omit-frame-pointer") {
+			omit_frame_pointer = false;
+		} else if (arg == "-Wpadded") {
+			warn_padded = true;
+		} else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+			optimization = arg[2] - '0';
+		} else if (arg.size() > 1 && arg[0] == '-') {
 			usage(argv[0]);
+		} else {
+			positional.push_back(arg);
 		}
 	}
+	if (positional.size() < 1 || positional.size() > 2 || (assemble && positional.size() != 2) ||
+		(run && (positional.size() != 1 || assemble || object)))
+	{
+		usage(argv[0]);
+	}
+	std::string infile = positional[0];
+	#ifdef __APPLE__
+	if (object || run) {
+		std::cerr << "The integrated assembler only targets ELF, which macOS does not use." << std::endl;
+		exit(1);
+	}
+	#endif
 
 	// Open the file.
-	std::ifstream file_stream(argv[1]);
+	std::ifstream file_stream(infile);
 	if (!file_stream.is_open()) {
-		std::cerr << "Could not open file \"" << argv[1] << "\"." << std::endl;
+		std::cerr << "Could not open file \"" << infile << "\"." << std::endl;
 		exit(1);
 	}
 
@@ -45,41 +197,103 @@ int main(int argc, char** argv) {
 	);
 	file_stream.close();
 
-	// Parse the second argument.
-	std::string outfile;
-	if (argc == 3) {
-		outfile = argv[2];
-	} else if (argc == 4) {
-		outfile = "tmp" + std::to_string(time(NULL)) + ".s";
-	} else {
-		outfile = std::string(argv[1]) + ".s";
-	}
-
-	// Open the output file.
-	std::FILE* output_file = fopen(outfile.c_str(), "w");
-
 	// Parse the file (implicity lexes the file).
-	program_t program = parser_t(argv[1], file_content).parse();
+	program_t program = parser_t(infile, file_content).parse();
 
 	// Validate the program.
-	semantic_analyzer_t semantic_analyzer(argv[1], file_content);
+	semantic_analyzer_t semantic_analyzer(infile, file_content);
+	semantic_analyzer.warn_padded = warn_padded;
 	semantic_analyzer.validate(program);
 
-	// Compile the program.
-	compiler_t compiler(program, output_file);
+	// Generate and verify the intermediate representation.
+	ir_program_t ir_program = ir_generator_t().generate(program);
+	ir_verifier_t().verify(ir_program);
+
+	// Promote locals to SSA values.
+	if (optimization >= 1) {
+		ir_mem2reg_t().run(ir_program);
+		ir_verifier_t(true).verify(ir_program);
+	}
+	if (dump_ir) {
+		std::cout << ir_dump_program(ir_program);
+		exit(EXIT_SUCCESS);
+	}
+
+	// Run the program in-process.
+	if (run) {
+		x86_assembler_t assembler;
+		compiler_t compiler(ir_program, nullptr, optimization, stats, omit_frame_pointer);
+		compiler.assembler = &assembler;
+		compiler.compile();
+		run_arguments.insert(run_arguments.begin(), (char*)infile.c_str());
+		run_arguments.push_back(nullptr);
+		exit(jit_loader_t().run(assembler, run_arguments.size() - 1, run_arguments.data()));
+	}
+
+	// Open the output. With -o, assembly is streamed into the standard input
+	// of gcc through a pipe; an object file, or assembly when gcc can't be
+	// started that way, goes into a temporary file gcc reads afterwards.
+	std::string outfile;
+	std::string temporary;
+	int output_fd = -1;
+	pid_t gcc = -1;
+	if (assemble) {
+		outfile = positional[1];
+		signal(SIGPIPE, SIG_IGN);
+		if (!object) {
+			gcc = spawn_gcc({"-x", "assembler", "-", "-o", outfile}, &output_fd);
+		}
+		if (gcc < 0) {
+			output_fd = temporary_file(temporary);
+		}
+	} else {
+		outfile = positional.size() == 2 ? positional[1] : infile + (object ? ".o" : ".s");
+		output_fd = open(outfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (output_fd < 0) {
+			std::cerr << "Could not open file \"" << outfile << "\"." << std::endl;
+			exit(1);
+		}
+	}
+
+	// Compile the program, writing the assembly or object file out through a
+	// buffer.
+	output_buffer_t output(output_fd);
+	compiler_t compiler(ir_program, &output, optimization, stats, omit_frame_pointer);
+	x86_assembler_t assembler;
+	if (object) {
+		compiler.assembler = &assembler;
+	}
 	compiler.compile();
-	fclose(output_file);
-
-	// Optionally assembly the output using gcc.
-	if (argc == 4) {
-		// Assemble the output.
-		std::stringstream gcc_cmd;
-		gcc_cmd << "gcc " << outfile << " -o " << argv[2];
-		system(gcc_cmd.str().c_str());
-		// Remove the temporary file.
-		std::stringstream rm_cmd;
-		rm_cmd << "rm -f " << outfile;
-		system(rm_cmd.str().c_str());
+	if (object) {
+		output.append(elf_writer_t().write(assembler));
+	}
+	output.flush();
+	close(output_fd);
+
+	// Optionally assemble or link the output using gcc, exiting with it's
+	// status if it fails.
+	if (assemble) {
+		if (gcc < 0 && !output.error) {
+			if (object) {
+				gcc = spawn_gcc({temporary, "-o", outfile}, nullptr);
+			} else {
+				gcc = spawn_gcc({"-x", "assembler", temporary, "-o", outfile}, nullptr);
+			}
+			if (gcc < 0) {
+				std::cerr << "Could not run gcc: " << std::strerror(errno) << std::endl;
+			}
+		}
+		int status = gcc < 0 ? 1 : wait_status(gcc);
+		if (!temporary.empty()) {
+			unlink(temporary.c_str());
+		}
+		if (status) {
+			exit(status);
+		}
+	}
+	if (output.error) {
+		std::cerr << "Could not write output: " << std::strerror(output.error) << std::endl;
+		exit(1);
 	}
 
 	// Exit successfully.
@@ -0,0 +1,173 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "ir.hpp"
+
+// An IR builder. Instructions are appended to the end of the current block.
+struct ir_builder_t {
+	ir_function_t* function = nullptr;
+	long block = -1;
+
+	// Default constructor.
+	ir_builder_t(ir_function_t* function = nullptr) {
+		this->function = function;
+	}
+
+	// Create a new, empty block and return it's index.
+	long create_block() {
+		function->blocks.push_back(ir_block_t());
+		return function->blocks.size() - 1;
+	}
+
+	// Set the block that instructions are appended to.
+	void set_block(long block) {
+		this->block = block;
+	}
+
+	// Check if the current block already ends with a terminator.
+	bool terminated() {
+		std::vector<ir_instruction_t>& instructions = function->blocks[block].instructions;
+		return !instructions.empty() && ir_is_terminator(instructions.back().opcode);
+	}
+
+	// Create a new virtual register.
+	long create_register() {
+		return function->register_count++;
+	}
+
+	// Create a new stack slot and return it's index.
+	long create_slot(identifier_t identifier, long size, long alignment = 8) {
+		function->slots.push_back({identifier, size, alignment});
+		return function->slots.size() - 1;
+	}
+
+	// Append an instruction to the current block.
+	void append(ir_instruction_t instruction) {
+		function->blocks[block].instructions.push_back(instruction);
+	}
+
+	// Append an instruction that defines a new virtual register and return
+	// the register as an operand.
+	ir_operand_t build_value(ir_opcode_t opcode, std::vector<ir_operand_t> operands, std::string symbol = "") {
+		ir_instruction_t instruction;
+		instruction.opcode = opcode;
+		instruction.destination = create_register();
+		instruction.operands = operands;
+		instruction.symbol = symbol;
+		append(instruction);
+		return ir_register(instruction.destination);
+	}
+
+	// Append an instruction that does not define a value.
+	void build_effect(ir_opcode_t opcode, std::vector<ir_operand_t> operands, std::vector<long> targets = {}) {
+		ir_instruction_t instruction;
+		instruction.opcode = opcode;
+		instruction.operands = operands;
+		instruction.targets = targets;
+		append(instruction);
+	}
+
+	// Build a constant.
+	ir_operand_t build_constant(long value) {
+		return build_value(ir_constant, {ir_immediate(value)});
+	}
+
+	// Build a reference to an incoming parameter.
+	ir_operand_t build_parameter(long index) {
+		return build_value(ir_parameter, {ir_immediate(index)});
+	}
+
+	// Build a copy of a value.
+	ir_operand_t build_copy(ir_operand_t value) {
+		return build_value(ir_copy, {value});
+	}
+
+	// Build the address of a symbol.
+	ir_operand_t build_address(std::string symbol) {
+		return build_value(ir_address, {}, symbol);
+	}
+
+	// Build the address of a stack slot.
+	ir_operand_t build_slot_address(long slot) {
+		return build_value(ir_slot_address, {ir_slot(slot)});
+	}
+
+	// Build a load from a stack slot.
+	ir_operand_t build_load_slot(long slot) {
+		return build_value(ir_load_slot, {ir_slot(slot)});
+	}
+
+	// Build a store to a stack slot.
+	void build_store_slot(long slot, ir_operand_t value) {
+		build_effect(ir_store_slot, {ir_slot(slot), value});
+	}
+
+	// Build a load of a number of bytes from an address.
+	ir_operand_t build_load(ir_operand_t address, long size = 8) {
+		ir_operand_t value = build_value(ir_load, {address});
+		function->blocks[block].instructions.back().size = size;
+		return value;
+	}
+
+	// Build a store of a number of bytes to an address.
+	void build_store(ir_operand_t address, ir_operand_t value, long size = 8) {
+		build_effect(ir_store, {address, value});
+		function->blocks[block].instructions.back().size = size;
+	}
+
+	// Build a binary operation on operands of a size.
+	ir_operand_t build_binary(ir_opcode_t opcode, ir_operand_t left, ir_operand_t right, long size = 8) {
+		ir_operand_t value = build_value(opcode, {left, right});
+		function->blocks[block].instructions.back().size = size;
+		return value;
+	}
+
+	// Build a unary operation on an operand of a size.
+	ir_operand_t build_unary(ir_opcode_t opcode, ir_operand_t operand, long size = 8) {
+		ir_operand_t value = build_value(opcode, {operand});
+		function->blocks[block].instructions.back().size = size;
+		return value;
+	}
+
+	// Build a sign extension of the lower bytes of a value.
+	ir_operand_t build_extend(ir_operand_t value, long size) {
+		return build_unary(ir_extend, value, size);
+	}
+
+	// Build a select of one of two values by a condition.
+	ir_operand_t build_select(ir_operand_t condition, ir_operand_t if_true, ir_operand_t if_false, long size = 8) {
+		ir_operand_t value = build_value(ir_select, {condition, if_true, if_false});
+		function->blocks[block].instructions.back().size = size;
+		return value;
+	}
+
+	// Build a function call.
+	ir_operand_t build_call(std::string function, std::vector<ir_operand_t> arguments) {
+		return build_value(ir_call, arguments, function);
+	}
+
+	// Build an unconditional jump.
+	void build_jump(long target) {
+		build_effect(ir_jump, {}, {target});
+	}
+
+	// Build a conditional branch, taken to if_true when the condition is
+	// non-zero.
+	void build_branch(ir_operand_t condition, long if_true, long if_false, long size = 8) {
+		build_effect(ir_branch, {condition}, {if_true, if_false});
+		function->blocks[block].instructions.back().size = size;
+	}
+
+	// Build a switch through a jump table starting at a value, with one
+	// target per value.
+	void build_switch(ir_operand_t value, long first, long default_target, std::vector<long> table) {
+		table.insert(table.begin(), default_target);
+		build_effect(ir_switch, {value, ir_immediate(first)}, table);
+	}
+
+	// Build a return.
+	void build_return(ir_operand_t value) {
+		build_effect(ir_return, {value});
+	}
+};
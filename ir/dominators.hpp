@@ -0,0 +1,179 @@
+#pragma once
+#include <vector>
+
+#include "ir.hpp"
+
+// A dominator tree, computed with the algorithm of Cooper, Harvey and
+// Kennedy. Every block of the function must be reachable from the entry
+// block and the predecessors must be up to date.
+struct ir_dominator_tree_t {
+	// The blocks in reverse postorder.
+	std::vector<long> order;
+	// The immediate dominator of each block. The entry block is it's own
+	// immediate dominator.
+	std::vector<long> idom;
+	// The blocks immediately dominated by each block.
+	std::vector<std::vector<long>> children;
+	// The dominance frontier of each block.
+	std::vector<std::vector<long>> frontier;
+	// The preorder and postorder numbers of each block in the dominator tree.
+	std::vector<long> preorder;
+	std::vector<long> postorder;
+
+	// Compute the dominator tree of a function.
+	ir_dominator_tree_t(ir_function_t& function) {
+		long count = function.blocks.size();
+		order = ir_reverse_postorder(function);
+		std::vector<long> rank(count, -1);
+		for (int i = 0; i < order.size(); i++) {
+			rank[order[i]] = i;
+		}
+		// Iterate to a fixed point, intersecting the dominators of the
+		// processed predecessors of each block.
+		idom.assign(count, -1);
+		idom[0] = 0;
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int i = 1; i < order.size(); i++) {
+				long block = order[i];
+				long dominator = -1;
+				std::vector<long>& predecessors = function.blocks[block].predecessors;
+				for (int j = 0; j < predecessors.size(); j++) {
+					long predecessor = predecessors[j];
+					if (idom[predecessor] < 0) {
+						continue;
+					}
+					if (dominator < 0) {
+						dominator = predecessor;
+						continue;
+					}
+					while (dominator != predecessor) {
+						while (rank[dominator] > rank[predecessor]) {
+							dominator = idom[dominator];
+						}
+						while (rank[predecessor] > rank[dominator]) {
+							predecessor = idom[predecessor];
+						}
+					}
+				}
+				if (idom[block] != dominator) {
+					idom[block] = dominator;
+					changed = true;
+				}
+			}
+		}
+		children.resize(count);
+		for (int i = 1; i < order.size(); i++) {
+			children[idom[order[i]]].push_back(order[i]);
+		}
+		// Number the tree so dominance queries take constant time.
+		preorder.assign(count, -1);
+		postorder.assign(count, -1);
+		long pre = 0;
+		long post = 0;
+		std::vector<std::pair<long, long>> stack;
+		stack.push_back({0, 0});
+		preorder[0] = pre++;
+		while (!stack.empty()) {
+			long block = stack.back().first;
+			if (stack.back().second < children[block].size()) {
+				long child = children[block][stack.back().second++];
+				preorder[child] = pre++;
+				stack.push_back({child, 0});
+			} else {
+				postorder[block] = post++;
+				stack.pop_back();
+			}
+		}
+		// Walk up from the predecessors of every join point until reaching
+		// it's immediate dominator.
+		frontier.resize(count);
+		for (int i = 0; i < count; i++) {
+			std::vector<long>& predecessors = function.blocks[i].predecessors;
+			if (predecessors.size() < 2) {
+				continue;
+			}
+			for (int j = 0; j < predecessors.size(); j++) {
+				long runner = predecessors[j];
+				while (runner != idom[i]) {
+					std::vector<long>& runner_frontier = frontier[runner];
+					if (runner_frontier.empty() || runner_frontier.back() != i) {
+						runner_frontier.push_back(i);
+					}
+					runner = idom[runner];
+				}
+			}
+		}
+	}
+
+	// Check if block a dominates block b.
+	bool dominates(long a, long b) {
+		return preorder[a] <= preorder[b] && postorder[b] <= postorder[a];
+	}
+};
+
+// Find the loop headers of a function, the blocks targeted by a back edge.
+std::vector<bool> ir_loop_headers(ir_function_t& function) {
+	ir_dominator_tree_t tree(function);
+	std::vector<bool> headers(function.blocks.size(), false);
+	for (int i = 0; i < function.blocks.size(); i++) {
+		std::vector<long> successors = ir_successors(function.blocks[i]);
+		for (int j = 0; j < successors.size(); j++) {
+			if (tree.dominates(successors[j], i)) {
+				headers[successors[j]] = true;
+			}
+		}
+	}
+	return headers;
+}
+
+// Compute the loop nesting depth of every block. Each back edge, an edge to a
+// block that dominates it's source, belongs to the natural loop of that
+// header, made of the header and every block reaching a back edge source
+// without passing the header.
+std::vector<long> ir_loop_depths(ir_function_t& function) {
+	ir_dominator_tree_t tree(function);
+	long count = function.blocks.size();
+	std::vector<std::vector<long>> sources(count);
+	for (int i = 0; i < count; i++) {
+		std::vector<long> successors = ir_successors(function.blocks[i]);
+		for (int j = 0; j < successors.size(); j++) {
+			if (tree.dominates(successors[j], i)) {
+				sources[successors[j]].push_back(i);
+			}
+		}
+	}
+	std::vector<long> depths(count, 0);
+	for (int header = 0; header < count; header++) {
+		if (sources[header].empty()) {
+			continue;
+		}
+		std::vector<bool> body(count, false);
+		body[header] = true;
+		std::vector<long> worklist;
+		for (int i = 0; i < sources[header].size(); i++) {
+			if (!body[sources[header][i]]) {
+				body[sources[header][i]] = true;
+				worklist.push_back(sources[header][i]);
+			}
+		}
+		while (!worklist.empty()) {
+			long block = worklist.back();
+			worklist.pop_back();
+			std::vector<long>& predecessors = function.blocks[block].predecessors;
+			for (int i = 0; i < predecessors.size(); i++) {
+				if (!body[predecessors[i]]) {
+					body[predecessors[i]] = true;
+					worklist.push_back(predecessors[i]);
+				}
+			}
+		}
+		for (int i = 0; i < count; i++) {
+			if (body[i]) {
+				depths[i]++;
+			}
+		}
+	}
+	return depths;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <string>
+#include <sstream>
+
+#include "ir.hpp"
+
+// Dump an operand.
+std::string ir_dump_operand(ir_operand_t operand) {
+	if (operand.type == io_register) {
+		return "%" + std::to_string(operand.value);
+	} else if (operand.type == io_immediate) {
+		return std::to_string(operand.value);
+	} else if (operand.type == io_slot) {
+		return "$" + std::to_string(operand.value);
+	}
+	return "?";
+}
+
+// Dump a block label.
+std::string ir_dump_label(long block) {
+	return "L" + std::to_string(block);
+}
+
+// Dump an instruction.
+std::string ir_dump_instruction(ir_instruction_t& instruction) {
+	std::stringstream out;
+	if (instruction.destination >= 0) {
+		out << "%" << instruction.destination << " = ";
+	}
+	out << ir_opcode_str[instruction.opcode];
+	// Instructions of other sizes than 8 bytes are suffixed with their size
+	// in bits.
+	if (instruction.size != 8) {
+		out << instruction.size * 8;
+	}
+	if (instruction.opcode == ir_call) {
+		out << " " << instruction.symbol << "(";
+		for (int i = 0; i < instruction.operands.size(); i++) {
+			out << (i ? ", " : "") << ir_dump_operand(instruction.operands[i]);
+		}
+		out << ")";
+		return out.str();
+	} else if (instruction.opcode == ir_phi) {
+		for (int i = 0; i < instruction.operands.size(); i++) {
+			out << (i ? ", [" : " [") << ir_dump_operand(instruction.operands[i]) << ", " << ir_dump_label(instruction.targets[i]) << "]";
+		}
+		return out.str();
+	} else if (instruction.opcode == ir_address) {
+		out << " " << instruction.symbol;
+	}
+	for (int i = 0; i < instruction.operands.size(); i++) {
+		out << (i ? ", " : " ") << ir_dump_operand(instruction.operands[i]);
+	}
+	for (int i = 0; i < instruction.targets.size(); i++) {
+		out << (i || instruction.operands.size() ? ", " : " ") << ir_dump_label(instruction.targets[i]);
+	}
+	return out.str();
+}
+
+// Dump a string literal, escaping unprintable characters.
+std::string ir_dump_string(std::string string) {
+	std::stringstream out;
+	out << '"';
+	for (int i = 0; i < string.size(); i++) {
+		unsigned char ch = string[i];
+		if (ch == '"' || ch == '\\') {
+			out << '\\' << ch;
+		} else if (ch == '\n') {
+			out << "\\n";
+		} else if (ch == '\t') {
+			out << "\\t";
+		} else if (ch < ' ' || ch > '~') {
+			out << "\\x" << std::hex << int(ch) << std::dec;
+		} else {
+			out << ch;
+		}
+	}
+	out << '"';
+	return out.str();
+}
+
+// Dump a function.
+std::string ir_dump_function(ir_function_t& function) {
+	std::stringstream out;
+	out << "function " << function.identifier << "(" << function.parameter_count << ") {" << std::endl;
+	for (int i = 0; i < function.slots.size(); i++) {
+		out << "    $" << i << " " << function.slots[i].identifier << ": " << function.slots[i].size;
+		if (function.slots[i].alignment != 8) {
+			out << ", align " << function.slots[i].alignment;
+		}
+		out << std::endl;
+	}
+	for (int i = 0; i < function.blocks.size(); i++) {
+		out << ir_dump_label(i) << ":" << std::endl;
+		for (int j = 0; j < function.blocks[i].instructions.size(); j++) {
+			out << "    " << ir_dump_instruction(function.blocks[i].instructions[j]) << std::endl;
+		}
+	}
+	out << "}" << std::endl;
+	return out.str();
+}
+
+// Dump a global variable, with the symbols stored at it's relocations.
+std::string ir_dump_global(ir_global_t& global) {
+	std::stringstream out;
+	out << "global " << global.identifier << ": " << global.size << ", align " << global.alignment;
+	if (!global.data.empty()) {
+		out << " = " << ir_dump_string(global.data);
+	}
+	out << std::endl;
+	for (int i = 0; i < global.relocations.size(); i++) {
+		out << "    +" << global.relocations[i].offset << " " << global.relocations[i].symbol << std::endl;
+	}
+	return out.str();
+}
+
+// Dump a program.
+std::string ir_dump_program(ir_program_t& program) {
+	std::stringstream out;
+	for (int i = 0; i < program.globals.size(); i++) {
+		out << ir_dump_global(program.globals[i]);
+	}
+	for (int i = 0; i < program.strings.size(); i++) {
+		out << "S" << i << " = " << ir_dump_string(program.strings[i]) << std::endl;
+	}
+	for (int i = 0; i < program.functions.size(); i++) {
+		if (i || program.strings.size() || program.globals.size()) {
+			out << std::endl;
+		}
+		out << ir_dump_function(program.functions[i]);
+	}
+	return out.str();
+}
@@ -0,0 +1,1028 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_map>
+
+#include "ir.hpp"
+#include "builder.hpp"
+
+// The most operations an arm of a ternary expression or conditional
+// assignment may take to still be evaluated unconditionally and selected
+// without a branch.
+const long ir_select_budget = 2;
+
+// The size in bytes above which a local array with an initializer is cleared
+// by memset before it's nonzero bytes are stored.
+const long ir_clear_threshold = 64;
+
+// An IR generator. The generator lowers a semantically valid, expanded
+// abstract syntax tree into IR. Every variable lives in it's own stack slot
+// and is accessed through explicit loads and stores.
+struct ir_generator_t {
+	ir_program_t output;
+	ir_builder_t builder;
+	// The Sethi-Ullman number of every expression numbered so far.
+	std::unordered_map<expression_t*, long> numbers;
+	// The block of every case and default label of the switch statements
+	// generated so far.
+	std::unordered_map<statement_t*, long> label_blocks;
+	// The return type of the function being generated.
+	type_t return_type;
+	// Every function of the program by it's identifier.
+	std::unordered_map<identifier_t, function_t*> functions;
+	// The index of every distinct string literal generated so far.
+	std::unordered_map<std::string, long> string_indices;
+	// The file-scope variables of the program.
+	symbol_table_t global_symbols;
+
+	// Get the Sethi-Ullman number of an expression, the number of registers
+	// needed to evaluate it without spilling. Literals become immediate
+	// operands and need no register.
+	long number(expression_t* expression) {
+		auto it = numbers.find(expression);
+		if (it != numbers.end()) {
+			return it->second;
+		}
+		long result = 1;
+		if (expression->type == et_integer_literal || expression->type == et_character_literal) {
+			result = 0;
+		} else if (expression->type == et_function_call) {
+			for (int i = 0; i < expression->function_call.arguments.size(); i++) {
+				result = std::max(result, number(expression->function_call.arguments[i]));
+			}
+		} else if (expression->type == et_binary) {
+			long left = number(expression->binary.left_operand);
+			long right = number(expression->binary.right_operand);
+			result = std::max(1l, left == right ? left + 1 : std::max(left, right));
+		} else if (expression->type == et_unary && expression->unary.unary_operator != un_address_of) {
+			result = std::max(1l, number(expression->unary.operand));
+		} else if (expression->type == et_member) {
+			result = std::max(1l, number(expression->member.object));
+		} else if (expression->type == et_ternary) {
+			result = std::max(number(expression->ternary.condition),
+							  std::max(number(expression->ternary.if_true), number(expression->ternary.if_false)) + 1);
+		}
+		numbers[expression] = result;
+		return result;
+	}
+
+	// Check if a unary operator increments or decrements it's operand.
+	static bool is_increment(unary_operator_t op) {
+		return op == un_pre_increment || op == un_pre_decrement || op == un_post_increment || op == un_post_decrement;
+	}
+
+	// Check if an expression may have side effects, so it's evaluation may
+	// not be moved across another expression.
+	bool has_side_effects(expression_t* expression) {
+		if (expression->type == et_function_call) {
+			return expression->function_call.function != "sizeof";
+		} else if (expression->type == et_binary) {
+			return expression->binary.binary_operator == bi_assignment ||
+				   has_side_effects(expression->binary.left_operand) ||
+				   has_side_effects(expression->binary.right_operand);
+		} else if (expression->type == et_unary) {
+			return is_increment(expression->unary.unary_operator) ||
+				   has_side_effects(expression->unary.operand);
+		} else if (expression->type == et_member) {
+			return has_side_effects(expression->member.object);
+		} else if (expression->type == et_ternary) {
+			return has_side_effects(expression->ternary.condition) ||
+				   has_side_effects(expression->ternary.if_true) ||
+				   has_side_effects(expression->ternary.if_false);
+		}
+		return false;
+	}
+
+	// Check if the right operand of a binary expression should be evaluated
+	// first: it needs more registers than the left one, and neither operand
+	// has side effects.
+	bool right_first(binary_expression_t& expr) {
+		return number(expr.right_operand) > number(expr.left_operand) &&
+			   !has_side_effects(expr.left_operand) &&
+			   !has_side_effects(expr.right_operand);
+	}
+
+	// Get the symbol of a string literal. Identical string literals share a
+	// symbol.
+	std::string string_symbol(std::string string) {
+		auto it = string_indices.find(string);
+		if (it == string_indices.end()) {
+			it = string_indices.insert({string, output.strings.size()}).first;
+			output.strings.push_back(string);
+		}
+		return "S" + std::to_string(it->second);
+	}
+
+	// Generate the address of an lvalue expression. A file-scope variable is
+	// addressed by it's symbol, and a field by the address of it's struct
+	// plus it's offset, which ends up as the displacement of the memory
+	// operands using it. The offsets of nested fields add up to one.
+	ir_operand_t generate_address(expression_t* expression, symbol_table_t& symbols) {
+		if (expression->type == et_identifier) {
+			symbol_t& symbol = symbols.fetch(expression->identifier);
+			if (symbol.slot < 0) {
+				return builder.build_address(symbol.identifier);
+			}
+			return builder.build_slot_address(symbol.slot);
+		} else if (expression->type == et_member) {
+			long offset = member_field(expression)->offset;
+			while (!expression->member.arrow && expression->member.object->type == et_member) {
+				expression = expression->member.object;
+				offset += member_field(expression)->offset;
+			}
+			member_expression_t& expr = expression->member;
+			ir_operand_t address = expr.arrow ? generate_expression(expr.object, symbols) : generate_address(expr.object, symbols);
+			return offset ? builder.build_binary(ir_add, address, ir_immediate(offset)) : address;
+		} else {
+			// un_value_of
+			return generate_expression(expression->unary.operand, symbols);
+		}
+	}
+
+	// Check if an expression names a variable living in a stack slot, which
+	// is accessed without computing it's address.
+	static bool is_slot_variable(expression_t* expression, symbol_table_t& symbols) {
+		return expression->type == et_identifier && symbols.fetch(expression->identifier).slot >= 0;
+	}
+
+	// Get the number of operations evaluating an expression takes, or -1 if
+	// it may not be evaluated unconditionally, since it may have side
+	// effects, fault or trap.
+	long speculation_cost(expression_t* expression) {
+		if (expression->type == et_integer_literal || expression->type == et_character_literal ||
+			expression->type == et_identifier)
+		{
+			return 0;
+		} else if (expression->type == et_string_literal) {
+			return 1;
+		} else if (expression->type == et_member) {
+			// A field of a variable can't fault.
+			return !expression->member.arrow && expression->member.object->type == et_identifier ? 1 : -1;
+		} else if (expression->type == et_binary) {
+			binary_operator_t op = expression->binary.binary_operator;
+			if (op == bi_assignment || op == bi_division || op == bi_modulo ||
+				op == bi_logical_and || op == bi_logical_or)
+			{
+				return -1;
+			}
+			long left = speculation_cost(expression->binary.left_operand);
+			long right = speculation_cost(expression->binary.right_operand);
+			return left < 0 || right < 0 ? -1 : left + right + 1;
+		} else if (expression->type == et_unary) {
+			unary_operator_t op = expression->unary.unary_operator;
+			if (op == un_value_of || op == un_address_of || is_increment(op)) {
+				return -1;
+			}
+			long operand = speculation_cost(expression->unary.operand);
+			return operand < 0 ? -1 : operand + (op != un_arithmetic_positive);
+		} else if (expression->type == et_ternary) {
+			long condition = speculation_cost(expression->ternary.condition);
+			long if_true = speculation_cost(expression->ternary.if_true);
+			long if_false = speculation_cost(expression->ternary.if_false);
+			if (condition < 0 || if_true < 0 || if_false < 0) {
+				return -1;
+			}
+			return condition + if_true + if_false + 1;
+		}
+		return -1;
+	}
+
+	// Check if an expression is cheap and safe enough to evaluate
+	// unconditionally.
+	bool is_speculatable(expression_t* expression) {
+		long cost = speculation_cost(expression);
+		return cost >= 0 && cost <= ir_select_budget;
+	}
+
+	// Generate a select of one of two values by a condition, converting
+	// both to a type. Both values are generated before the condition unless
+	// the condition has side effects, so a comparison ends up right before
+	// the select.
+	ir_operand_t generate_select(expression_t* condition, expression_t* if_true, expression_t* if_false, type_t type, symbol_table_t& symbols) {
+		ir_operand_t condition_value;
+		if (has_side_effects(condition)) {
+			condition_value = generate_expression(condition, symbols);
+		}
+		ir_operand_t true_value = generate_operand(if_true, type, false, symbols);
+		ir_operand_t false_value = generate_operand(if_false, type, false, symbols);
+		if (!has_side_effects(condition)) {
+			condition_value = generate_expression(condition, symbols);
+		}
+		return builder.build_select(condition_value, true_value, false_value, operation_size(condition->return_type));
+	}
+
+	// Generate a ternary expression, as a select if both values are cheap
+	// and safe to evaluate unconditionally. Otherwise the condition is
+	// generated in branch context, and the result is materialized through a
+	// temporary stack slot.
+	ir_operand_t generate_ternary(ternary_expression_t& expr, type_t type, symbol_table_t& symbols) {
+		if (is_speculatable(expr.if_true) && is_speculatable(expr.if_false)) {
+			return generate_select(expr.condition, expr.if_true, expr.if_false, type, symbols);
+		}
+		long slot = builder.create_slot("", 8);
+		long true_block = builder.create_block();
+		long false_block = builder.create_block();
+		long end_block = builder.create_block();
+		generate_condition(expr.condition, true_block, false_block, symbols);
+		builder.set_block(true_block);
+		builder.build_store_slot(slot, generate_operand(expr.if_true, type, false, symbols));
+		builder.build_jump(end_block);
+		builder.set_block(false_block);
+		builder.build_store_slot(slot, generate_operand(expr.if_false, type, false, symbols));
+		builder.build_jump(end_block);
+		builder.set_block(end_block);
+		return builder.build_load_slot(slot);
+	}
+
+	// Convert a value of one type to another. Values of type char are kept
+	// zero-extended and values of type short sign-extended, while only the
+	// lower half of an int is defined: converting to a narrower type
+	// truncates the value and extends it again, and converting an int to a
+	// wider type sign-extends it.
+	ir_operand_t generate_conversion(ir_operand_t value, type_t from, type_t to) {
+		if (value.type == io_immediate) {
+			if (is_char(to)) {
+				return ir_immediate((unsigned char)value.value);
+			} else if (type_size(to) == 2) {
+				return ir_immediate((short)value.value);
+			} else if (type_size(to) == 4) {
+				return ir_immediate((int)value.value);
+			}
+			return value;
+		} else if (is_char(to)) {
+			return is_char(from) ? value : builder.build_binary(ir_and, value, ir_immediate(0xff));
+		} else if (type_size(to) == 2) {
+			return type_size(from) <= 2 ? value : builder.build_extend(value, 2);
+		} else if (type_size(to) == 8 && type_size(from) == 4) {
+			return builder.build_extend(value, 4);
+		}
+		return value;
+	}
+
+	// Generate an increment or decrement of an lvalue in place, stepping
+	// pointers by the size of the element they point to. The address is
+	// generated once, and the value before the update is what a
+	// post-increment or post-decrement returns; it only costs a register
+	// where it is used.
+	ir_operand_t generate_increment(unary_expression_t& expr, symbol_table_t& symbols) {
+		unary_operator_t op = expr.unary_operator;
+		ir_opcode_t opcode = op == un_pre_increment || op == un_post_increment ? ir_add : ir_sub;
+		type_t type = expr.operand->return_type;
+		ir_operand_t step = ir_immediate(is_pointer(type) ? type_size(element_type(type)) : 1);
+		ir_operand_t old_value;
+		ir_operand_t new_value;
+		if (is_slot_variable(expr.operand, symbols)) {
+			long slot = symbols.fetch(expr.operand->identifier).slot;
+			old_value = builder.build_load_slot(slot);
+			new_value = generate_conversion(builder.build_binary(opcode, old_value, step, operation_size(type)), {0, ty_long}, type);
+			builder.build_store_slot(slot, new_value);
+		} else {
+			ir_operand_t address = generate_address(expr.operand, symbols);
+			old_value = builder.build_load(address, type_size(type));
+			new_value = builder.build_binary(opcode, old_value, step, operation_size(type));
+			builder.build_store(address, new_value, type_size(type));
+			if (op == un_pre_increment || op == un_pre_decrement) {
+				new_value = generate_conversion(new_value, {0, ty_long}, type);
+			}
+		}
+		return op == un_post_increment || op == un_post_decrement ? old_value : new_value;
+	}
+
+	// Get the base two logarithm of the size of the elements of a pointer
+	// type, or -1 if it is not a power of two, as the size of a struct may
+	// not be.
+	static long element_shift(type_t type) {
+		long size = type_size(element_type(type));
+		long shift = 0;
+		while ((1l << shift) < size) {
+			shift++;
+		}
+		return (1l << shift) == size ? shift : -1;
+	}
+
+	// Generate an operand of an operation converted to the type of the
+	// operation. An integer operand of a scaled pointer addition or
+	// subtraction is also scaled by the size of the elements of the pointer
+	// type, with a shift when the size is a power of two.
+	ir_operand_t generate_operand(expression_t* expression, type_t type, bool scaled, symbol_table_t& symbols) {
+		ir_operand_t value = generate_conversion(generate_expression(expression, symbols), expression->return_type, type);
+		if (!scaled || !is_pointer(type) || is_pointer(expression->return_type)) {
+			return value;
+		}
+		long size = type_size(element_type(type));
+		if (value.type == io_immediate) {
+			return ir_immediate((unsigned long)value.value * size);
+		} else if (element_shift(type) < 0) {
+			return builder.build_binary(ir_mul, value, ir_immediate(size));
+		} else if (element_shift(type) > 0) {
+			return builder.build_binary(ir_shl, value, ir_immediate(element_shift(type)));
+		}
+		return value;
+	}
+
+	// Generate a condition in branch context, jumping to one of two blocks
+	// instead of materializing it's value. Logical operators chain their
+	// jumps directly, and a logical NOT swaps the targets.
+	void generate_condition(expression_t* expression, long if_true, long if_false, symbol_table_t& symbols) {
+		if (expression->type == et_binary && (expression->binary.binary_operator == bi_logical_and ||
+											  expression->binary.binary_operator == bi_logical_or)) {
+			binary_expression_t expr = expression->binary;
+			long rhs_block = builder.create_block();
+			if (expr.binary_operator == bi_logical_and) {
+				generate_condition(expr.left_operand, rhs_block, if_false, symbols);
+			} else {
+				generate_condition(expr.left_operand, if_true, rhs_block, symbols);
+			}
+			builder.set_block(rhs_block);
+			generate_condition(expr.right_operand, if_true, if_false, symbols);
+		} else if (expression->type == et_unary && expression->unary.unary_operator == un_logical_not) {
+			generate_condition(expression->unary.operand, if_false, if_true, symbols);
+		} else if (expression->type == et_integer_literal || expression->type == et_character_literal) {
+			ir_operand_t value = generate_expression(expression, symbols);
+			builder.build_jump(value.value ? if_true : if_false);
+		} else {
+			ir_operand_t value = generate_expression(expression, symbols);
+			builder.build_branch(value, if_true, if_false, operation_size(expression->return_type));
+		}
+	}
+
+	// Generate a short-circuiting logical AND or logical OR as a value. The
+	// condition is generated in branch context, and the result is
+	// materialized through a temporary stack slot.
+	ir_operand_t generate_logical(expression_t* expression, symbol_table_t& symbols) {
+		long slot = builder.create_slot("", 8);
+		long true_block = builder.create_block();
+		long false_block = builder.create_block();
+		long end_block = builder.create_block();
+		generate_condition(expression, true_block, false_block, symbols);
+		builder.set_block(true_block);
+		builder.build_store_slot(slot, ir_immediate(1));
+		builder.build_jump(end_block);
+		builder.set_block(false_block);
+		builder.build_store_slot(slot, ir_immediate(0));
+		builder.build_jump(end_block);
+		builder.set_block(end_block);
+		return builder.build_load_slot(slot);
+	}
+
+	// Generate an expression and return the operand holding it's value.
+	ir_operand_t generate_expression(expression_t* expression, symbol_table_t& symbols) {
+		if (expression->type == et_integer_literal) {
+			return ir_immediate(std::strtol(expression->integer_literal.c_str(), nullptr, 10));
+		} else if (expression->type == et_string_literal) {
+			return builder.build_address(string_symbol(expression->string_literal));
+		} else if (expression->type == et_character_literal) {
+			return ir_immediate((unsigned char)expression->character_literal[0]);
+		} else if (expression->type == et_identifier) {
+			// An array evaluates to the address of it's first element, and a
+			// file-scope variable is loaded through it's symbol.
+			symbol_t& symbol = symbols.fetch(expression->identifier);
+			if (is_array(symbol.type)) {
+				return generate_address(expression, symbols);
+			} else if (symbol.slot < 0) {
+				return builder.build_load(generate_address(expression, symbols), type_size(symbol.type));
+			}
+			return builder.build_load_slot(symbol.slot);
+		} else if (expression->type == et_function_call) {
+			function_call_expression_t expr = expression->function_call;
+			if (expr.function == "sizeof") {
+				// A string literal is an array of it's characters and a null
+				// terminator, and an array variable does not decay.
+				expression_t* argument = expr.arguments[0];
+				if (argument->type == et_string_literal) {
+					return ir_immediate(argument->string_literal.size() + 1);
+				} else if (argument->type == et_identifier && is_array(symbols.fetch(argument->identifier).type)) {
+					return ir_immediate(type_size(symbols.fetch(argument->identifier).type));
+				} else if (argument->type == et_member) {
+					return ir_immediate(type_size(member_field(argument)->type));
+				}
+				return ir_immediate(type_size(expr.arguments[0]->return_type));
+			}
+			// Arguments are converted to the types of the parameters of the
+			// functions of the program, and ints passed to other functions
+			// are widened to longs.
+			auto it = functions.find(expr.function);
+			std::vector<ir_operand_t> arguments;
+			for (int i = 0; i < expr.arguments.size(); i++) {
+				type_t type = {0, ty_long};
+				if (it != functions.end() && i < it->second->parameters.size()) {
+					type = it->second->parameters[i].type;
+				} else if (is_pointer(expr.arguments[i]->return_type)) {
+					type = expr.arguments[i]->return_type;
+				}
+				arguments.push_back(generate_operand(expr.arguments[i], type, false, symbols));
+			}
+			return builder.build_call(expr.function, arguments);
+		} else if (expression->type == et_binary) {
+			binary_expression_t expr = expression->binary;
+			binary_operator_t op = expr.binary_operator;
+			if (op == bi_assignment) {
+				type_t type = expr.left_operand->return_type;
+				ir_operand_t value = generate_expression(expr.right_operand, symbols);
+				if (is_slot_variable(expr.left_operand, symbols)) {
+					value = generate_conversion(value, expr.right_operand->return_type, type);
+					builder.build_store_slot(symbols.fetch(expr.left_operand->identifier).slot, value);
+				} else if (type_size(type) == 8) {
+					value = generate_conversion(value, expr.right_operand->return_type, type);
+					builder.build_store(generate_address(expr.left_operand, symbols), value, type_size(type));
+				} else {
+					// A narrow store truncates the value by itself.
+					builder.build_store(generate_address(expr.left_operand, symbols), value, type_size(type));
+					value = generate_conversion(value, expr.right_operand->return_type, type);
+				}
+				return value;
+			} else if (op == bi_logical_and || op == bi_logical_or) {
+				return generate_logical(expression, symbols);
+			}
+			ir_opcode_t opcode;
+			if (op == bi_addition) {
+				opcode = ir_add;
+			} else if (op == bi_subtraction) {
+				opcode = ir_sub;
+			} else if (op == bi_multiplication) {
+				opcode = ir_mul;
+			} else if (op == bi_division) {
+				opcode = ir_div;
+			} else if (op == bi_modulo) {
+				opcode = ir_mod;
+			} else if (op == bi_relational_equal) {
+				opcode = ir_eq;
+			} else if (op == bi_relational_non_equal) {
+				opcode = ir_ne;
+			} else if (op == bi_relational_greater_than) {
+				opcode = ir_gt;
+			} else if (op == bi_relational_lesser_than) {
+				opcode = ir_lt;
+			} else if (op == bi_relational_greater_than_or_equal_to) {
+				opcode = ir_ge;
+			} else if (op == bi_relational_lesser_than_or_equal_to) {
+				opcode = ir_le;
+			} else if (op == bi_binary_and) {
+				opcode = ir_and;
+			} else if (op == bi_binary_or) {
+				opcode = ir_or;
+			} else if (op == bi_binary_xor) {
+				opcode = ir_xor;
+			} else if (op == bi_binary_left_shift) {
+				opcode = ir_shl;
+			} else {
+				// bi_binary_right_shift
+				opcode = ir_sar;
+			}
+			// The operands are converted to the type of the operation, and
+			// compared at the size of the wider one. The shift count is not
+			// converted. An integer added to or subtracted from a pointer
+			// counts elements, and so does the difference of two pointers.
+			type_t left_type = expr.left_operand->return_type;
+			type_t right_type = expr.right_operand->return_type;
+			type_t type = expression->return_type;
+			if (ir_is_comparison(opcode)) {
+				type = {0, std::max(operation_size(left_type), operation_size(right_type)) == 8 ? ty_long : ty_int};
+			}
+			bool scaled = opcode == ir_add || opcode == ir_sub;
+			type_t count_type = opcode == ir_shl || opcode == ir_sar ? right_type : type;
+			// Evaluate the operand needing more registers first, so fewer values
+			// are live at once.
+			ir_operand_t left;
+			ir_operand_t right;
+			if (right_first(expr)) {
+				right = generate_operand(expr.right_operand, count_type, scaled, symbols);
+				left = generate_operand(expr.left_operand, type, scaled, symbols);
+			} else {
+				left = generate_operand(expr.left_operand, type, scaled, symbols);
+				right = generate_operand(expr.right_operand, count_type, scaled, symbols);
+			}
+			ir_operand_t value = builder.build_binary(opcode, left, right, operation_size(type));
+			if (opcode == ir_sub && is_pointer(left_type) && is_pointer(right_type) && element_shift(left_type) < 0) {
+				value = builder.build_binary(ir_div, value, ir_immediate(type_size(element_type(left_type))));
+			} else if (opcode == ir_sub && is_pointer(left_type) && is_pointer(right_type) && element_shift(left_type)) {
+				value = builder.build_binary(ir_sar, value, ir_immediate(element_shift(left_type)));
+			}
+			return value;
+		} else if (expression->type == et_ternary) {
+			return generate_ternary(expression->ternary, expression->return_type, symbols);
+		} else if (expression->type == et_member) {
+			// An array field evaluates to the address of it's first element.
+			if (is_array(member_field(expression)->type)) {
+				return generate_address(expression, symbols);
+			}
+			return builder.build_load(generate_address(expression, symbols), type_size(expression->return_type));
+		} else {
+			// et_unary
+			unary_expression_t expr = expression->unary;
+			if (expr.unary_operator == un_address_of) {
+				return generate_address(expr.operand, symbols);
+			} else if (is_increment(expr.unary_operator)) {
+				return generate_increment(expr, symbols);
+			}
+			type_t type = expression->return_type;
+			if (expr.unary_operator == un_value_of) {
+				return builder.build_load(generate_expression(expr.operand, symbols), type_size(type));
+			} else if (expr.unary_operator == un_logical_not) {
+				ir_operand_t operand = generate_expression(expr.operand, symbols);
+				return builder.build_binary(ir_eq, operand, ir_immediate(0), operation_size(expr.operand->return_type));
+			}
+			ir_operand_t operand = generate_operand(expr.operand, type, false, symbols);
+			// A negated constant is a constant itself, so that dividing by
+			// one still divides by a constant.
+			if (operand.type == io_immediate && expr.unary_operator != un_arithmetic_positive) {
+				unsigned long value = operand.value;
+				value = expr.unary_operator == un_arithmetic_negative ? -value : ~value;
+				return generate_conversion(ir_immediate(value), type, type);
+			} else if (expr.unary_operator == un_arithmetic_negative) {
+				return builder.build_unary(ir_neg, operand, operation_size(type));
+			} else if (expr.unary_operator == un_binary_not) {
+				return builder.build_unary(ir_not, operand, operation_size(type));
+			}
+			// un_arithmetic_positive
+			return operand;
+		}
+	}
+
+	// Continue generating code in a fresh block. Code following a jump or a
+	// return is unreachable and is removed once the function is complete.
+	void start_unreachable() {
+		builder.set_block(builder.create_block());
+	}
+
+	// Generate a loop in rotated form: a guard testing the condition once
+	// before the loop (unless the body always runs first), then the body,
+	// the step and the condition again, ending in a single branch back to
+	// the body. Continue statements jump to the step. A missing condition
+	// is always true.
+	void generate_loop(expression_t* condition, statement_t* body, expression_t* step, bool guarded, symbol_table_t& symbols) {
+		long body_block = builder.create_block();
+		long latch_block = builder.create_block();
+		long end_block = builder.create_block();
+		if (guarded && condition) {
+			generate_condition(condition, body_block, end_block, symbols);
+		} else {
+			builder.build_jump(body_block);
+		}
+		builder.set_block(body_block);
+		symbol_table_t new_symbols(&symbols);
+		new_symbols.loop_break_to = end_block;
+		new_symbols.loop_continue_to = latch_block;
+		generate_statement(body, new_symbols);
+		builder.build_jump(latch_block);
+		builder.set_block(latch_block);
+		if (step) {
+			generate_expression(step, symbols);
+		}
+		if (condition) {
+			generate_condition(condition, body_block, end_block, symbols);
+		} else {
+			builder.build_jump(body_block);
+		}
+		builder.set_block(end_block);
+	}
+
+	// Check if a statement is a case or default label.
+	static bool is_label(statement_t* statement) {
+		return statement->type == st_case || statement->type == st_default;
+	}
+
+	// Collect the case and default labels of a switch statement body, grouping
+	// the labels that directly follow each other since they share a block.
+	// The labels of nested switch statements belong to those.
+	void collect_labels(statement_t* statement, std::vector<std::vector<statement_t*>>& groups) {
+		if (is_label(statement)) {
+			groups.push_back({statement});
+		} else if (statement->type == st_compound) {
+			std::vector<statement_t*>& statements = statement->compound_stmt.statements;
+			for (int i = 0; i < statements.size(); i++) {
+				if (i && is_label(statements[i - 1]) && is_label(statements[i])) {
+					groups.back().push_back(statements[i]);
+				} else {
+					collect_labels(statements[i], groups);
+				}
+			}
+		} else if (statement->type == st_conditional) {
+			collect_labels(statement->conditional_stmt.body, groups);
+			if (statement->conditional_stmt.else_body) {
+				collect_labels(statement->conditional_stmt.else_body, groups);
+			}
+		} else if (statement->type == st_while) {
+			collect_labels(statement->while_stmt.body, groups);
+		} else if (statement->type == st_for) {
+			collect_labels(statement->for_stmt.body, groups);
+		} else if (statement->type == st_do_while) {
+			collect_labels(statement->do_while_stmt.body, groups);
+		}
+	}
+
+	// Generate a chain of equality tests of a value against a few cases.
+	void generate_case_chain(ir_operand_t value, std::vector<std::pair<long, long>>& cases, long default_block) {
+		for (int i = 0; i < cases.size(); i++) {
+			long next_block = i + 1 < cases.size() ? builder.create_block() : default_block;
+			ir_operand_t equal = builder.build_binary(ir_eq, value, ir_immediate(cases[i].first));
+			builder.build_branch(equal, cases[i].second, next_block);
+			if (i + 1 < cases.size()) {
+				builder.set_block(next_block);
+			}
+		}
+	}
+
+	// Generate a test of a value against a set of cases jumping to at most a
+	// few distinct targets, all within a machine word of each other: the
+	// value selects a bit, which is tested against a mask per target.
+	void generate_bit_tests(ir_operand_t value, std::vector<std::pair<long, long>>& cases, std::vector<long>& targets, long default_block) {
+		long first = cases.front().first;
+		long last = cases.back().first;
+		long in_range_block = builder.create_block();
+		long above_first_block = builder.create_block();
+		builder.build_branch(builder.build_binary(ir_lt, value, ir_immediate(first)), default_block, above_first_block);
+		builder.set_block(above_first_block);
+		builder.build_branch(builder.build_binary(ir_gt, value, ir_immediate(last)), default_block, in_range_block);
+		builder.set_block(in_range_block);
+		// Values from 0 to 63 index the bits directly.
+		long base = first >= 0 && last < 64 ? 0 : first;
+		ir_operand_t index = base ? builder.build_binary(ir_sub, value, ir_immediate(base)) : value;
+		ir_operand_t bit = builder.build_binary(ir_shl, ir_immediate(1), index);
+		for (int i = 0; i < targets.size(); i++) {
+			unsigned long mask = 0;
+			for (int j = 0; j < cases.size(); j++) {
+				if (cases[j].second == targets[i]) {
+					mask |= 1ul << (cases[j].first - base);
+				}
+			}
+			long next_block = i + 1 < targets.size() ? builder.create_block() : default_block;
+			builder.build_branch(builder.build_binary(ir_and, bit, ir_immediate(mask)), targets[i], next_block);
+			if (i + 1 < targets.size()) {
+				builder.set_block(next_block);
+			}
+		}
+	}
+
+	// Generate the dispatch of a switch statement to it's cases, sorted by
+	// value. A small set of cases with few distinct targets is tested as a
+	// bit set, dense cases jump through a table, and sparse cases are split
+	// in half by value until either of those applies or only a few are left
+	// to test one by one.
+	void generate_dispatch(ir_operand_t value, std::vector<std::pair<long, long>> cases, long default_block) {
+		if (cases.empty()) {
+			builder.build_jump(default_block);
+			return;
+		}
+		long first = cases.front().first;
+		long last = cases.back().first;
+		// The range may not fit in a signed 64-bit integer.
+		unsigned long span = (unsigned long)last - (unsigned long)first;
+		std::vector<long> targets;
+		for (int i = 0; i < cases.size(); i++) {
+			if (std::find(targets.begin(), targets.end(), cases[i].second) == targets.end()) {
+				targets.push_back(cases[i].second);
+			}
+		}
+		if (cases.size() >= 3 && targets.size() <= 3 && span < 64) {
+			generate_bit_tests(value, cases, targets, default_block);
+		} else if (cases.size() >= 4 && span < cases.size() * 5 / 2) {
+			// At least 40% of the table entries are cases.
+			std::vector<long> table(span + 1, default_block);
+			for (int i = 0; i < cases.size(); i++) {
+				table[(unsigned long)cases[i].first - (unsigned long)first] = cases[i].second;
+			}
+			builder.build_switch(value, first, default_block, table);
+		} else if (cases.size() <= 3) {
+			generate_case_chain(value, cases, default_block);
+		} else {
+			long middle = cases.size() / 2;
+			long lower_block = builder.create_block();
+			long upper_block = builder.create_block();
+			ir_operand_t below = builder.build_binary(ir_lt, value, ir_immediate(cases[middle].first));
+			builder.build_branch(below, lower_block, upper_block);
+			builder.set_block(lower_block);
+			generate_dispatch(value, std::vector<std::pair<long, long>>(cases.begin(), cases.begin() + middle), default_block);
+			builder.set_block(upper_block);
+			generate_dispatch(value, std::vector<std::pair<long, long>>(cases.begin() + middle, cases.end()), default_block);
+		}
+	}
+
+	// Generate a switch statement. The body is generated after the dispatch,
+	// with every case and default label starting a new block. Break
+	// statements jump past the body.
+	void generate_switch(switch_statement_t& stmt, symbol_table_t& symbols) {
+		ir_operand_t value = generate_operand(stmt.value, {0, ty_long}, false, symbols);
+		std::vector<std::vector<statement_t*>> groups;
+		collect_labels(stmt.body, groups);
+		long end_block = builder.create_block();
+		long default_block = end_block;
+		std::vector<std::pair<long, long>> cases;
+		for (int i = 0; i < groups.size(); i++) {
+			long block = builder.create_block();
+			for (int j = 0; j < groups[i].size(); j++) {
+				statement_t* label = groups[i][j];
+				label_blocks[label] = block;
+				if (label->type == st_default) {
+					default_block = block;
+				} else {
+					cases.push_back({label->case_stmt.constant, block});
+				}
+			}
+		}
+		std::sort(cases.begin(), cases.end());
+		generate_dispatch(value, cases, default_block);
+		start_unreachable();
+		symbol_table_t new_symbols(&symbols);
+		new_symbols.loop_break_to = end_block;
+		generate_statement(stmt.body, new_symbols);
+		builder.build_jump(end_block);
+		builder.set_block(end_block);
+	}
+
+	// Get the assignment to a variable a statement consists of, or null.
+	binary_expression_t* simple_assignment(statement_t* statement) {
+		if (statement->type == st_compound && statement->compound_stmt.statements.size() == 1) {
+			statement = statement->compound_stmt.statements[0];
+		}
+		if (statement->type != st_expression) {
+			return nullptr;
+		}
+		expression_t* expression = statement->expression_stmt.expression;
+		if (expression->type != et_binary || expression->binary.binary_operator != bi_assignment ||
+			expression->binary.left_operand->type != et_identifier)
+		{
+			return nullptr;
+		}
+		return &expression->binary;
+	}
+
+	// Generate a conditional statement. A statement that only assigns a
+	// variable, in either or both bodies, becomes a select of the assigned
+	// values when they are cheap and safe to evaluate unconditionally; a
+	// missing assignment keeps the variable's value. A file-scope variable
+	// is only stored to when the source stores to it, so it needs both.
+	void generate_conditional(conditional_statement_t& stmt, symbol_table_t& symbols) {
+		binary_expression_t* assignment = simple_assignment(stmt.body);
+		binary_expression_t* else_assignment = stmt.else_body ? simple_assignment(stmt.else_body) : nullptr;
+		if (assignment && (stmt.else_body || is_slot_variable(assignment->left_operand, symbols)) &&
+			is_speculatable(assignment->right_operand) &&
+			(!stmt.else_body || (else_assignment && is_speculatable(else_assignment->right_operand) &&
+								 else_assignment->left_operand->identifier == assignment->left_operand->identifier)))
+		{
+			expression_t* if_false = else_assignment ? else_assignment->right_operand : assignment->left_operand;
+			symbol_t variable = symbols.fetch(assignment->left_operand->identifier);
+			ir_operand_t value = generate_select(stmt.condition, assignment->right_operand, if_false, variable.type, symbols);
+			if (variable.slot < 0) {
+				builder.build_store(generate_address(assignment->left_operand, symbols), value, type_size(variable.type));
+			} else {
+				builder.build_store_slot(variable.slot, value);
+			}
+			return;
+		}
+		long body_block = builder.create_block();
+		long else_block = stmt.else_body ? builder.create_block() : -1;
+		long end_block = builder.create_block();
+		generate_condition(stmt.condition, body_block, stmt.else_body ? else_block : end_block, symbols);
+		builder.set_block(body_block);
+		symbol_table_t new_symbols(&symbols);
+		generate_statement(stmt.body, new_symbols);
+		builder.build_jump(end_block);
+		if (stmt.else_body) {
+			builder.set_block(else_block);
+			symbol_table_t else_symbols(&symbols);
+			generate_statement(stmt.else_body, else_symbols);
+			builder.build_jump(end_block);
+		}
+		builder.set_block(end_block);
+	}
+
+	// Get the initializers of the elements of a variable, where a scalar
+	// variable is a single element.
+	static std::vector<expression_t*> element_initializers(variable_declaration_statement_t& stmt) {
+		if (stmt.initializer && !stmt.is_array) {
+			return {stmt.initializer};
+		}
+		return stmt.initializers;
+	}
+
+	// Get the offsets and types of the initialized elements of a variable,
+	// the scalars it is made of, in the order it's initializers initialize
+	// them.
+	static std::vector<std::pair<long, type_t>> element_layout(variable_declaration_statement_t& stmt) {
+		std::vector<std::pair<long, type_t>> elements;
+		scalar_layout(stmt.type, 0, element_initializers(stmt).size(), elements);
+		return elements;
+	}
+
+	// Lay out the initial bytes of a variable: the characters and null
+	// terminator of a string literal initializing an array, or the constant
+	// elements converted to their types. The bytes of the other elements are
+	// left zero, and their indices collected.
+	std::string initial_image(variable_declaration_statement_t& stmt, std::vector<long>& others) {
+		std::string image(type_size(stmt.type), '\0');
+		if (stmt.is_array && stmt.initializer) {
+			std::string& string = stmt.initializer->string_literal;
+			std::copy(string.begin(), string.begin() + std::min(string.size(), image.size()), image.begin());
+		}
+		std::vector<expression_t*> initializers = element_initializers(stmt);
+		std::vector<std::pair<long, type_t>> elements = element_layout(stmt);
+		for (int i = 0; i < initializers.size(); i++) {
+			expression_t* initializer = initializers[i];
+			if (initializer->type != et_integer_literal) {
+				others.push_back(i);
+				continue;
+			}
+			ir_operand_t value = ir_immediate(std::strtol(initializer->integer_literal.c_str(), nullptr, 10));
+			value = generate_conversion(value, {0, ty_long}, elements[i].second);
+			for (int j = 0; j < type_size(elements[i].second); j++) {
+				image[elements[i].first + j] = (char)((unsigned long)value.value >> j * 8);
+			}
+		}
+		return image;
+	}
+
+	// Get the little-endian value of a number of bytes of an image.
+	static long image_value(std::string& image, long offset, long size) {
+		unsigned long value = 0;
+		for (int i = 0; i < size; i++) {
+			value |= (unsigned long)(unsigned char)image[offset + i] << i * 8;
+		}
+		return value;
+	}
+
+	// Generate the address of a byte of a stack slot.
+	ir_operand_t generate_slot_offset(long slot, long offset) {
+		ir_operand_t address = builder.build_slot_address(slot);
+		return offset ? builder.build_binary(ir_add, address, ir_immediate(offset)) : address;
+	}
+
+	// Generate the initialization of a local array or struct. The bytes of
+	// the constant elements are stored in the widest aligned stores that
+	// fit, halving an 8-byte store whose value does not fit in a 32-bit
+	// immediate, and the other elements are stored one by one after them. A
+	// large variable is cleared by memset first, and only it's nonzero bytes
+	// are stored.
+	void generate_aggregate_initializer(variable_declaration_statement_t& stmt, long slot, symbol_table_t& symbols) {
+		if (!stmt.initializer && stmt.initializers.empty()) {
+			return;
+		}
+		std::vector<long> others;
+		std::string image = initial_image(stmt, others);
+		long size = image.size();
+		bool cleared = size > ir_clear_threshold;
+		if (cleared) {
+			builder.build_call("memset", {builder.build_slot_address(slot), ir_immediate(0), ir_immediate(size)});
+		}
+		for (long offset = 0; offset < size;) {
+			long chunk = 8;
+			while (chunk > size - offset || offset % chunk) {
+				chunk /= 2;
+			}
+			long value = image_value(image, offset, chunk);
+			if (chunk == 8 && value != (int)value) {
+				chunk = 4;
+				value = image_value(image, offset, chunk);
+			}
+			if (!cleared || value) {
+				builder.build_store(generate_slot_offset(slot, offset), ir_immediate(value), chunk);
+			}
+			offset += chunk;
+		}
+		std::vector<std::pair<long, type_t>> elements = element_layout(stmt);
+		for (int i = 0; i < others.size(); i++) {
+			expression_t* initializer = stmt.initializers[others[i]];
+			type_t element = elements[others[i]].second;
+			ir_operand_t value = generate_expression(initializer, symbols);
+			if (type_size(element) == 8) {
+				value = generate_conversion(value, initializer->return_type, element);
+			}
+			builder.build_store(generate_slot_offset(slot, elements[others[i]].first), value, type_size(element));
+		}
+	}
+
+	// Generate a statement.
+	void generate_statement(statement_t* statement, symbol_table_t& symbols) {
+		if (statement->type == st_compound) {
+			compound_statement_t stmt = statement->compound_stmt;
+			symbol_table_t new_symbols(&symbols);
+			for (int i = 0; i < stmt.statements.size(); i++) {
+				generate_statement(stmt.statements[i], new_symbols);
+			}
+		} else if (statement->type == st_conditional) {
+			generate_conditional(statement->conditional_stmt, symbols);
+		} else if (statement->type == st_while) {
+			while_statement_t stmt = statement->while_stmt;
+			generate_loop(stmt.condition, stmt.body, nullptr, true, symbols);
+		} else if (statement->type == st_for) {
+			for_statement_t stmt = statement->for_stmt;
+			symbol_table_t new_symbols(&symbols);
+			if (stmt.initializer) {
+				generate_statement(stmt.initializer, new_symbols);
+			}
+			generate_loop(stmt.condition, stmt.body, stmt.step, true, new_symbols);
+		} else if (statement->type == st_do_while) {
+			do_while_statement_t stmt = statement->do_while_stmt;
+			generate_loop(stmt.condition, stmt.body, nullptr, false, symbols);
+		} else if (statement->type == st_switch) {
+			generate_switch(statement->switch_stmt, symbols);
+		} else if (is_label(statement)) {
+			// Fall through from the previous label, unless it shares the
+			// block.
+			long block = label_blocks[statement];
+			if (builder.block != block) {
+				builder.build_jump(block);
+				builder.set_block(block);
+			}
+		} else if (statement->type == st_return) {
+			expression_t* value = statement->return_stmt.value;
+			builder.build_return(generate_conversion(generate_expression(value, symbols), value->return_type, return_type));
+			start_unreachable();
+		} else if (statement->type == st_variable_declaration && (statement->variable_declaration_stmt.is_array || is_struct(statement->variable_declaration_stmt.type))) {
+			variable_declaration_statement_t& stmt = statement->variable_declaration_stmt;
+			long slot = builder.create_slot(stmt.identifier, type_size(stmt.type), type_alignment(stmt.type));
+			generate_aggregate_initializer(stmt, slot, symbols);
+			symbols.add_symbol(symbol_t(stmt.type, stmt.identifier, slot));
+		} else if (statement->type == st_variable_declaration) {
+			variable_declaration_statement_t stmt = statement->variable_declaration_stmt;
+			long slot = builder.create_slot(stmt.identifier, type_size(stmt.type));
+			if (stmt.initializer) {
+				ir_operand_t value = generate_expression(stmt.initializer, symbols);
+				builder.build_store_slot(slot, generate_conversion(value, stmt.initializer->return_type, stmt.type));
+			}
+			symbols.add_symbol(symbol_t(stmt.type, stmt.identifier, slot));
+		} else if (statement->type == st_expression) {
+			generate_expression(statement->expression_stmt.expression, symbols);
+		} else if (statement->type == st_break) {
+			builder.build_jump(symbols.loop_break_to);
+			start_unreachable();
+		} else if (statement->type == st_continue) {
+			builder.build_jump(symbols.loop_continue_to);
+			start_unreachable();
+		}
+	}
+
+	// Generate a function.
+	void generate_function(function_t& function) {
+		output.functions.push_back(ir_function_t());
+		ir_function_t& ir_function = output.functions.back();
+		ir_function.identifier = function.identifier;
+		ir_function.parameter_count = function.parameters.size();
+		builder = ir_builder_t(&ir_function);
+		builder.set_block(builder.create_block());
+		return_type = function.type;
+
+		// Spill the parameters into stack slots, truncating the ones
+		// declared narrower than the value they are passed as.
+		symbol_table_t symbols(&global_symbols);
+		for (int i = 0; i < function.parameters.size(); i++) {
+			long slot = builder.create_slot(function.parameters[i].identifier, type_size(function.parameters[i].type));
+			builder.build_store_slot(slot, generate_conversion(builder.build_parameter(i), {0, ty_long}, function.parameters[i].type));
+			symbols.add_symbol(symbol_t(
+				function.parameters[i].type,
+				function.parameters[i].identifier,
+				slot
+			));
+		}
+		for (int i = 0; i < function.body.size(); i++) {
+			generate_statement(function.body[i], symbols);
+		}
+
+		// Falling off the end of a function returns zero.
+		if (!builder.terminated()) {
+			builder.build_return(ir_immediate(0));
+		}
+		ir_remove_unreachable(ir_function);
+	}
+
+	// Generate a file-scope variable from it's initial bytes. The string
+	// literals among it's elements are stored as relocations, and trailing
+	// zero bytes are left out of the data.
+	void generate_global(variable_declaration_statement_t& stmt) {
+		ir_global_t global = {stmt.identifier, type_size(stmt.type), type_alignment(stmt.type)};
+		std::vector<long> others;
+		std::string image = initial_image(stmt, others);
+		std::vector<expression_t*> initializers = element_initializers(stmt);
+		std::vector<std::pair<long, type_t>> elements = element_layout(stmt);
+		long end = 0;
+		for (int i = 0; i < others.size(); i++) {
+			long offset = elements[others[i]].first;
+			global.relocations.push_back({offset, string_symbol(initializers[others[i]]->string_literal)});
+			end = offset + 8;
+		}
+		for (long i = end; i < image.size(); i++) {
+			if (image[i]) {
+				end = i + 1;
+			}
+		}
+		global.data = image.substr(0, end);
+		output.globals.push_back(global);
+		global_symbols.add_symbol(symbol_t(stmt.type, stmt.identifier, -1));
+	}
+
+	// Generate the program.
+	ir_program_t generate(program_t& program) {
+		for (int i = 0; i < program.globals.size(); i++) {
+			generate_global(program.globals[i]->variable_declaration_stmt);
+		}
+		for (int i = 0; i < program.functions.size(); i++) {
+			functions[program.functions[i].identifier] = &program.functions[i];
+		}
+		for (int i = 0; i < program.functions.size(); i++) {
+			generate_function(program.functions[i]);
+		}
+		return output;
+	}
+};
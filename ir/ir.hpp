@@ -0,0 +1,327 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// All IR opcodes.
+enum ir_opcode_t {
+	// Values.
+	ir_constant,
+	ir_parameter,
+	ir_copy,
+	ir_address,
+	ir_slot_address,
+	// Memory.
+	ir_load_slot,
+	ir_store_slot,
+	ir_load,
+	ir_store,
+	// Arithmetic.
+	ir_add,
+	ir_sub,
+	ir_mul,
+	ir_div,
+	ir_mod,
+	ir_and,
+	ir_or,
+	ir_xor,
+	ir_shl,
+	ir_sar,
+	ir_neg,
+	ir_not,
+	// Comparisons.
+	ir_eq,
+	ir_ne,
+	ir_lt,
+	ir_gt,
+	ir_le,
+	ir_ge,
+	// Conversions.
+	ir_extend,
+	// Selection.
+	ir_select,
+	// Calls.
+	ir_call,
+	// SSA.
+	ir_phi,
+	// Terminators.
+	ir_jump,
+	ir_branch,
+	ir_switch,
+	ir_return
+};
+
+// All IR opcodes as strings.
+std::string ir_opcode_str[] = {
+	// Values.
+	"constant",
+	"parameter",
+	"copy",
+	"address",
+	"slot_address",
+	// Memory.
+	"load_slot",
+	"store_slot",
+	"load",
+	"store",
+	// Arithmetic.
+	"add",
+	"sub",
+	"mul",
+	"div",
+	"mod",
+	"and",
+	"or",
+	"xor",
+	"shl",
+	"sar",
+	"neg",
+	"not",
+	// Comparisons.
+	"eq",
+	"ne",
+	"lt",
+	"gt",
+	"le",
+	"ge",
+	// Conversions.
+	"extend",
+	// Selection.
+	"select",
+	// Calls.
+	"call",
+	// SSA.
+	"phi",
+	// Terminators.
+	"jump",
+	"branch",
+	"switch",
+	"return"
+};
+
+// All IR operand types.
+enum ir_operand_type_t {
+	io_none,
+	io_register,
+	io_immediate,
+	io_slot
+};
+
+// An IR operand. A register operand refers to a virtual register, an
+// immediate operand holds a constant and a slot operand refers to a stack
+// slot of the enclosing function.
+struct ir_operand_t {
+	ir_operand_type_t	type;
+	long				value;
+};
+
+// Make a virtual register operand.
+ir_operand_t ir_register(long value) {
+	return {io_register, value};
+}
+
+// Make an immediate operand.
+ir_operand_t ir_immediate(long value) {
+	return {io_immediate, value};
+}
+
+// Make a stack slot operand.
+ir_operand_t ir_slot(long value) {
+	return {io_slot, value};
+}
+
+// An IR instruction. The destination is the virtual register defined by the
+// instruction, or -1 if the instruction does not define a value. The targets
+// are the block indices a terminator may transfer control to. A phi has one
+// operand per predecessor, and the target at the same index is the
+// predecessor the operand flows in from. A select's operands are a condition
+// and the values it selects when the condition is nonzero and when it is
+// zero. A switch jumps through a table: it's operands are the value and the
+// first value of the table, the first target is the default and the others
+// are the table entries, in order. The size of an arithmetic operation or
+// comparison is the size of it's operands, 4 or 8 bytes, and only the lower
+// half of the result of a 4-byte operation is defined. A branch or select
+// tests as many bytes of it's condition as it's size. A load or store
+// accesses as many bytes as it's size: a 1-byte load zero-extends the char
+// it loads and a 2-byte load sign-extends the short it loads. An extend
+// sign-extends the lower bytes of it's operand, as many as it's size.
+struct ir_instruction_t {
+	ir_opcode_t					opcode;
+	long						destination = -1;
+	std::vector<ir_operand_t>	operands;
+	std::vector<long>			targets;
+	std::string					symbol;
+	long						size = 8;
+};
+
+// A basic block. Every block ends with exactly one terminator.
+struct ir_block_t {
+	std::vector<ir_instruction_t>	instructions;
+	std::vector<long>				predecessors;
+};
+
+// A stack slot, aligned to a number of bytes.
+struct ir_slot_t {
+	identifier_t	identifier;
+	long			size;
+	long			alignment;
+};
+
+// An IR function. The first block is the entry block.
+struct ir_function_t {
+	identifier_t				identifier;
+	long						parameter_count = 0;
+	long						register_count = 0;
+	std::vector<ir_slot_t>		slots;
+	std::vector<ir_block_t>		blocks;
+};
+
+// A relocation: the address of a symbol, stored at an offset into the
+// data of a global variable.
+struct ir_relocation_t {
+	long			offset;
+	std::string		symbol;
+};
+
+// A global variable, referred to by the symbol of it's identifier. It's data
+// holds the initial values of it's leading bytes, and the rest are zero; the
+// addresses of symbols are stored over the data at the offsets of it's
+// relocations.
+struct ir_global_t {
+	identifier_t					identifier;
+	long							size;
+	long							alignment;
+	std::string						data;
+	std::vector<ir_relocation_t>	relocations;
+};
+
+// An IR program. String literal i is referred to by the symbol S<i>, and
+// every string literal is distinct.
+struct ir_program_t {
+	std::vector<ir_global_t>	globals;
+	std::vector<ir_function_t>	functions;
+	std::vector<std::string>	strings;
+};
+
+// Check if an opcode is a terminator.
+bool ir_is_terminator(ir_opcode_t opcode) {
+	return opcode == ir_jump ||
+		   opcode == ir_branch ||
+		   opcode == ir_switch ||
+		   opcode == ir_return;
+}
+
+// Check if an opcode is a binary arithmetic or comparison operator.
+bool ir_is_binary(ir_opcode_t opcode) {
+	return opcode >= ir_add && opcode <= ir_ge && opcode != ir_neg && opcode != ir_not;
+}
+
+// Check if an opcode is a comparison.
+bool ir_is_comparison(ir_opcode_t opcode) {
+	return opcode >= ir_eq && opcode <= ir_ge;
+}
+
+// Check if an instruction may be removed when it's destination is unused.
+bool ir_is_pure(ir_instruction_t& instruction) {
+	return instruction.opcode != ir_store_slot &&
+		   instruction.opcode != ir_store &&
+		   instruction.opcode != ir_call &&
+		   !ir_is_terminator(instruction.opcode);
+}
+
+// Get the virtual registers used by an instruction.
+std::vector<long> ir_uses(ir_instruction_t& instruction) {
+	std::vector<long> uses;
+	for (int i = 0; i < instruction.operands.size(); i++) {
+		if (instruction.operands[i].type == io_register) {
+			uses.push_back(instruction.operands[i].value);
+		}
+	}
+	return uses;
+}
+
+// Get the successors of a block.
+std::vector<long> ir_successors(ir_block_t& block) {
+	if (block.instructions.empty()) {
+		return {};
+	}
+	return block.instructions.back().targets;
+}
+
+// Compute the predecessors of every block in a function.
+void ir_compute_predecessors(ir_function_t& function) {
+	for (int i = 0; i < function.blocks.size(); i++) {
+		function.blocks[i].predecessors.clear();
+	}
+	for (int i = 0; i < function.blocks.size(); i++) {
+		std::vector<long> successors = ir_successors(function.blocks[i]);
+		for (int j = 0; j < successors.size(); j++) {
+			std::vector<long>& predecessors = function.blocks[successors[j]].predecessors;
+			if (std::find(predecessors.begin(), predecessors.end(), i) == predecessors.end()) {
+				predecessors.push_back(i);
+			}
+		}
+	}
+}
+
+// Compute a reverse postorder of the blocks reachable from the entry block.
+std::vector<long> ir_reverse_postorder(ir_function_t& function) {
+	std::vector<long> order;
+	std::vector<bool> visited(function.blocks.size(), false);
+	// Iterative depth-first search, storing the next successor to visit
+	// alongside each block on the stack.
+	std::vector<std::pair<long, long>> stack;
+	stack.push_back({0, 0});
+	visited[0] = true;
+	while (!stack.empty()) {
+		long block = stack.back().first;
+		std::vector<long> successors = ir_successors(function.blocks[block]);
+		if (stack.back().second < successors.size()) {
+			long successor = successors[stack.back().second++];
+			if (!visited[successor]) {
+				visited[successor] = true;
+				stack.push_back({successor, 0});
+			}
+		} else {
+			order.push_back(block);
+			stack.pop_back();
+		}
+	}
+	std::reverse(order.begin(), order.end());
+	return order;
+}
+
+// Remove every block that is unreachable from the entry block, keeping the
+// remaining blocks in their original order.
+void ir_remove_unreachable(ir_function_t& function) {
+	std::vector<long> order = ir_reverse_postorder(function);
+	std::vector<bool> reachable(function.blocks.size(), false);
+	for (int i = 0; i < order.size(); i++) {
+		reachable[order[i]] = true;
+	}
+	std::vector<long> renumber(function.blocks.size(), -1);
+	std::vector<ir_block_t> blocks;
+	for (int i = 0; i < function.blocks.size(); i++) {
+		if (reachable[i]) {
+			renumber[i] = blocks.size();
+			blocks.push_back(function.blocks[i]);
+		}
+	}
+	for (int i = 0; i < blocks.size(); i++) {
+		std::vector<ir_instruction_t>& instructions = blocks[i].instructions;
+		for (int j = 0; j < instructions.size(); j++) {
+			ir_instruction_t& instruction = instructions[j];
+			// Drop the phi operands flowing in from removed blocks.
+			for (int k = instruction.targets.size() - 1; k >= 0; k--) {
+				if (renumber[instruction.targets[k]] < 0) {
+					instruction.targets.erase(instruction.targets.begin() + k);
+					instruction.operands.erase(instruction.operands.begin() + k);
+				} else {
+					instruction.targets[k] = renumber[instruction.targets[k]];
+				}
+			}
+		}
+	}
+	function.blocks = blocks;
+	ir_compute_predecessors(function);
+}
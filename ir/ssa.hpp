@@ -0,0 +1,526 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+
+#include "ir.hpp"
+#include "dominators.hpp"
+
+// Resolve an operand through a replacement map, following chains of
+// replaced registers.
+ir_operand_t ir_resolve(std::vector<ir_operand_t>& replacement, ir_operand_t operand) {
+	while (operand.type == io_register && replacement[operand.value].type != io_none) {
+		operand = replacement[operand.value];
+	}
+	return operand;
+}
+
+// A pass promoting stack slots to SSA values. A slot is promoted when it's
+// address is never taken, so it is only ever accessed by load_slot and
+// store_slot. Phis are placed at the iterated dominance frontier of the
+// stores, the loads are replaced by the reaching value while walking the
+// dominator tree, and finally trivial and dead phis are removed.
+struct ir_mem2reg_t {
+	ir_function_t* function = nullptr;
+	ir_dominator_tree_t* tree = nullptr;
+	// Whether each slot is promoted.
+	std::vector<bool> promoted;
+	// The slot each phi was placed for, by destination register.
+	std::vector<long> phi_slot;
+	// The current value of each slot during renaming.
+	std::vector<std::vector<ir_operand_t>> values;
+	// The operand replacing each removed register, or io_none.
+	std::vector<ir_operand_t> replacement;
+
+	// Place phis for a promoted slot at the iterated dominance frontier of the
+	// blocks storing to it.
+	void place_phis(long slot, std::vector<long> worklist) {
+		std::vector<bool> has_phi(function->blocks.size(), false);
+		std::vector<bool> queued(function->blocks.size(), false);
+		for (int i = 0; i < worklist.size(); i++) {
+			queued[worklist[i]] = true;
+		}
+		while (!worklist.empty()) {
+			long block = worklist.back();
+			worklist.pop_back();
+			std::vector<long>& frontier = tree->frontier[block];
+			for (int i = 0; i < frontier.size(); i++) {
+				long join = frontier[i];
+				if (has_phi[join]) {
+					continue;
+				}
+				has_phi[join] = true;
+				ir_instruction_t phi;
+				phi.opcode = ir_phi;
+				phi.destination = function->register_count++;
+				phi_slot.push_back(slot);
+				std::vector<ir_instruction_t>& instructions = function->blocks[join].instructions;
+				instructions.insert(instructions.begin(), phi);
+				if (!queued[join]) {
+					queued[join] = true;
+					worklist.push_back(join);
+				}
+			}
+		}
+	}
+
+	// Get the value of a slot, which is zero if the slot is read before it is
+	// ever written.
+	ir_operand_t current_value(long slot) {
+		if (values[slot].empty()) {
+			return ir_immediate(0);
+		}
+		return values[slot].back();
+	}
+
+	// Rename the promoted slots in a block and the blocks it dominates.
+	void rename(long block) {
+		std::vector<long> pushed;
+		std::vector<ir_instruction_t>& instructions = function->blocks[block].instructions;
+		std::vector<ir_instruction_t> renamed;
+		for (int i = 0; i < instructions.size(); i++) {
+			ir_instruction_t& instruction = instructions[i];
+			if (instruction.opcode == ir_phi) {
+				long slot = phi_slot[instruction.destination];
+				if (slot >= 0) {
+					values[slot].push_back(ir_register(instruction.destination));
+					pushed.push_back(slot);
+				}
+				renamed.push_back(instruction);
+				continue;
+			}
+			for (int j = 0; j < instruction.operands.size(); j++) {
+				instruction.operands[j] = ir_resolve(replacement, instruction.operands[j]);
+			}
+			if (instruction.opcode == ir_load_slot && promoted[instruction.operands[0].value]) {
+				replacement[instruction.destination] = current_value(instruction.operands[0].value);
+			} else if (instruction.opcode == ir_store_slot && promoted[instruction.operands[0].value]) {
+				values[instruction.operands[0].value].push_back(instruction.operands[1]);
+				pushed.push_back(instruction.operands[0].value);
+			} else {
+				renamed.push_back(instruction);
+			}
+		}
+		instructions = renamed;
+		// Fill in the phi operands flowing into the successors.
+		std::vector<long> successors = ir_successors(function->blocks[block]);
+		for (int i = 0; i < successors.size(); i++) {
+			if (std::find(successors.begin(), successors.begin() + i, successors[i]) != successors.begin() + i) {
+				continue;
+			}
+			std::vector<ir_instruction_t>& phis = function->blocks[successors[i]].instructions;
+			for (int j = 0; j < phis.size() && phis[j].opcode == ir_phi; j++) {
+				long slot = phi_slot[phis[j].destination];
+				if (slot >= 0) {
+					phis[j].operands.push_back(current_value(slot));
+					phis[j].targets.push_back(block);
+				}
+			}
+		}
+		std::vector<long>& children = tree->children[block];
+		for (int i = 0; i < children.size(); i++) {
+			rename(children[i]);
+		}
+		for (int i = 0; i < pushed.size(); i++) {
+			values[pushed[i]].pop_back();
+		}
+	}
+
+	// Replace phis whose operands are all the same value, or the phi itself,
+	// by that value.
+	void remove_trivial_phis() {
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int i = 0; i < function->blocks.size(); i++) {
+				std::vector<ir_instruction_t>& instructions = function->blocks[i].instructions;
+				for (int j = 0; j < instructions.size() && instructions[j].opcode == ir_phi; j++) {
+					ir_instruction_t& phi = instructions[j];
+					if (replacement[phi.destination].type != io_none) {
+						continue;
+					}
+					ir_operand_t same = ir_immediate(0);
+					bool found = false;
+					bool trivial = true;
+					for (int k = 0; k < phi.operands.size(); k++) {
+						ir_operand_t operand = ir_resolve(replacement, phi.operands[k]);
+						if (operand.type == io_register && operand.value == phi.destination) {
+							continue;
+						}
+						if (found && (operand.type != same.type || operand.value != same.value)) {
+							trivial = false;
+							break;
+						}
+						same = operand;
+						found = true;
+					}
+					if (trivial) {
+						replacement[phi.destination] = same;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+
+	// Remove the replaced phis, rewrite the remaining operands and remove the
+	// phis whose values never reach an instruction other than a phi.
+	void remove_dead_phis() {
+		std::vector<ir_instruction_t*> phis(function->register_count, nullptr);
+		std::vector<bool> live(function->register_count, false);
+		std::vector<long> worklist;
+		for (int i = 0; i < function->blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = function->blocks[i].instructions;
+			instructions.erase(std::remove_if(instructions.begin(), instructions.end(), [&](ir_instruction_t& instruction) {
+				return instruction.opcode == ir_phi && replacement[instruction.destination].type != io_none;
+			}), instructions.end());
+			for (int j = 0; j < instructions.size(); j++) {
+				ir_instruction_t& instruction = instructions[j];
+				for (int k = 0; k < instruction.operands.size(); k++) {
+					instruction.operands[k] = ir_resolve(replacement, instruction.operands[k]);
+				}
+				if (instruction.opcode == ir_phi) {
+					phis[instruction.destination] = &instruction;
+					continue;
+				}
+				std::vector<long> uses = ir_uses(instruction);
+				worklist.insert(worklist.end(), uses.begin(), uses.end());
+			}
+		}
+		while (!worklist.empty()) {
+			long reg = worklist.back();
+			worklist.pop_back();
+			if (live[reg]) {
+				continue;
+			}
+			live[reg] = true;
+			if (phis[reg]) {
+				std::vector<long> uses = ir_uses(*phis[reg]);
+				worklist.insert(worklist.end(), uses.begin(), uses.end());
+			}
+		}
+		for (int i = 0; i < function->blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = function->blocks[i].instructions;
+			instructions.erase(std::remove_if(instructions.begin(), instructions.end(), [&](ir_instruction_t& instruction) {
+				return instruction.opcode == ir_phi && !live[instruction.destination];
+			}), instructions.end());
+		}
+	}
+
+	// Remove the promoted slots and renumber the remaining ones.
+	void remove_promoted_slots() {
+		std::vector<long> renumber(function->slots.size(), -1);
+		std::vector<ir_slot_t> slots;
+		for (int i = 0; i < function->slots.size(); i++) {
+			if (!promoted[i]) {
+				renumber[i] = slots.size();
+				slots.push_back(function->slots[i]);
+			}
+		}
+		for (int i = 0; i < function->blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = function->blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				std::vector<ir_operand_t>& operands = instructions[j].operands;
+				for (int k = 0; k < operands.size(); k++) {
+					if (operands[k].type == io_slot) {
+						operands[k].value = renumber[operands[k].value];
+					}
+				}
+			}
+		}
+		function->slots = slots;
+	}
+
+	// Promote the slots of a function.
+	void run(ir_function_t& function) {
+		this->function = &function;
+		promoted.assign(function.slots.size(), true);
+		std::vector<std::vector<long>> stores(function.slots.size());
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = function.blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				ir_instruction_t& instruction = instructions[j];
+				if (instruction.opcode == ir_slot_address) {
+					promoted[instruction.operands[0].value] = false;
+				} else if (instruction.opcode == ir_store_slot) {
+					std::vector<long>& blocks = stores[instruction.operands[0].value];
+					if (blocks.empty() || blocks.back() != i) {
+						blocks.push_back(i);
+					}
+				}
+			}
+		}
+		ir_dominator_tree_t tree(function);
+		this->tree = &tree;
+		// Existing phis are numbered -1 so renaming leaves them alone.
+		phi_slot.assign(function.register_count, -1);
+		for (int i = 0; i < function.slots.size(); i++) {
+			if (promoted[i]) {
+				place_phis(i, stores[i]);
+			}
+		}
+		values.assign(function.slots.size(), {});
+		replacement.assign(function.register_count, ir_operand_t());
+		rename(0);
+		remove_trivial_phis();
+		remove_dead_phis();
+		remove_promoted_slots();
+		this->tree = nullptr;
+	}
+
+	// Promote the slots of every function in a program.
+	void run(ir_program_t& program) {
+		for (int i = 0; i < program.functions.size(); i++) {
+			run(program.functions[i]);
+		}
+	}
+};
+
+// Translate a function out of SSA form. Critical edges into blocks with phis
+// are split, then the phis of each block are replaced by parallel copies at
+// the end of it's predecessors. The parallel copies are sequentialized,
+// breaking cycles through a fresh register. A critical edge is not split when
+// the copies may run before the branch of it's source without changing what
+// the other successors see, which keeps the back edge of a rotated loop a
+// single conditional branch.
+struct ir_ssa_destructor_t {
+	ir_function_t* function = nullptr;
+	// The registers live into each block, not counting it's phis.
+	std::vector<std::vector<bool>> live_in;
+
+	// Compute the registers live into each block. The operands of a phi are
+	// live out of the corresponding predecessor.
+	void compute_live_in() {
+		long count = function->blocks.size();
+		std::vector<std::vector<bool>> uses(count, std::vector<bool>(function->register_count, false));
+		std::vector<std::vector<bool>> defs(count, std::vector<bool>(function->register_count, false));
+		std::vector<std::vector<bool>> phi_uses(count, std::vector<bool>(function->register_count, false));
+		for (int i = 0; i < count; i++) {
+			std::vector<ir_instruction_t>& instructions = function->blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				ir_instruction_t& instruction = instructions[j];
+				for (int k = 0; k < instruction.operands.size(); k++) {
+					ir_operand_t& operand = instruction.operands[k];
+					if (operand.type != io_register) {
+						continue;
+					} else if (instruction.opcode == ir_phi) {
+						phi_uses[instruction.targets[k]][operand.value] = true;
+					} else if (!defs[i][operand.value]) {
+						uses[i][operand.value] = true;
+					}
+				}
+				if (instruction.destination >= 0) {
+					defs[i][instruction.destination] = true;
+				}
+			}
+		}
+		live_in = uses;
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (long i = count - 1; i >= 0; i--) {
+				std::vector<bool> live_out = phi_uses[i];
+				std::vector<long> successors = ir_successors(function->blocks[i]);
+				for (int j = 0; j < successors.size(); j++) {
+					for (long reg = 0; reg < function->register_count; reg++) {
+						if (live_in[successors[j]][reg]) {
+							live_out[reg] = true;
+						}
+					}
+				}
+				for (long reg = 0; reg < function->register_count; reg++) {
+					if (live_out[reg] && !defs[i][reg] && !live_in[i][reg]) {
+						live_in[i][reg] = true;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+
+	// Check if the phi copies of an edge from a block with several successors
+	// may be placed at the end of the block. No other successor may see the
+	// registers they write, neither as live registers nor as phi operands,
+	// and the branch may not read them.
+	bool copies_fit_in_source(long source, long target) {
+		ir_instruction_t& terminator = function->blocks[source].instructions.back();
+		std::vector<ir_instruction_t>& phis = function->blocks[target].instructions;
+		for (int i = 0; i < phis.size() && phis[i].opcode == ir_phi; i++) {
+			long reg = phis[i].destination;
+			for (int j = 0; j < terminator.operands.size(); j++) {
+				if (terminator.operands[j].type == io_register && terminator.operands[j].value == reg) {
+					return false;
+				}
+			}
+			for (int j = 0; j < terminator.targets.size(); j++) {
+				long other = terminator.targets[j];
+				if (other == target) {
+					continue;
+				}
+				if (live_in[other][reg]) {
+					return false;
+				}
+				std::vector<ir_instruction_t>& other_phis = function->blocks[other].instructions;
+				for (int k = 0; k < other_phis.size() && other_phis[k].opcode == ir_phi; k++) {
+					for (int l = 0; l < other_phis[k].operands.size(); l++) {
+						ir_operand_t& operand = other_phis[k].operands[l];
+						if (other_phis[k].targets[l] == source && operand.type == io_register && operand.value == reg) {
+							return false;
+						}
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	// Split the edges from blocks with several successors into blocks with
+	// phis, so every predecessor of a block with phis ends with a jump,
+	// except for at most one edge per block whose copies fit in it's source.
+	void split_critical_edges() {
+		compute_live_in();
+		long count = function->blocks.size();
+		for (long i = 0; i < count; i++) {
+			std::vector<long> targets = function->blocks[i].instructions.back().targets;
+			if (targets.size() < 2) {
+				continue;
+			}
+			long kept = -1;
+			for (int j = 0; j < targets.size() && kept < 0; j++) {
+				if (function->blocks[targets[j]].instructions[0].opcode == ir_phi && copies_fit_in_source(i, targets[j])) {
+					kept = targets[j];
+				}
+			}
+			for (int j = 0; j < targets.size(); j++) {
+				long target = targets[j];
+				if (target == kept || function->blocks[target].instructions[0].opcode != ir_phi) {
+					continue;
+				}
+				// Both targets of a branch may be the same block; the phis see a
+				// single edge, so both are redirected to the same new block.
+				std::vector<long>& terminator_targets = function->blocks[i].instructions.back().targets;
+				if (std::find(terminator_targets.begin(), terminator_targets.end(), target) == terminator_targets.end()) {
+					continue;
+				}
+				long split = function->blocks.size();
+				ir_instruction_t jump;
+				jump.opcode = ir_jump;
+				jump.targets.push_back(target);
+				ir_block_t block;
+				block.instructions.push_back(jump);
+				function->blocks.push_back(block);
+				std::vector<long>& retargeted = function->blocks[i].instructions.back().targets;
+				std::replace(retargeted.begin(), retargeted.end(), target, split);
+				std::vector<ir_instruction_t>& phis = function->blocks[target].instructions;
+				for (int k = 0; k < phis.size() && phis[k].opcode == ir_phi; k++) {
+					std::replace(phis[k].targets.begin(), phis[k].targets.end(), i, split);
+				}
+			}
+		}
+		ir_compute_predecessors(*function);
+	}
+
+	// Sequentialize a parallel copy, appending the copies to a list.
+	void sequentialize(std::vector<std::pair<long, ir_operand_t>> copies, std::vector<ir_instruction_t>& output) {
+		// Drop the copies of a register to itself.
+		copies.erase(std::remove_if(copies.begin(), copies.end(), [](std::pair<long, ir_operand_t>& copy) {
+			return copy.second.type == io_register && copy.second.value == copy.first;
+		}), copies.end());
+		while (!copies.empty()) {
+			// Emit a copy whose destination is not read by any other copy.
+			bool emitted = false;
+			for (int i = 0; i < copies.size(); i++) {
+				bool read = false;
+				for (int j = 0; j < copies.size(); j++) {
+					if (copies[j].second.type == io_register && copies[j].second.value == copies[i].first) {
+						read = true;
+						break;
+					}
+				}
+				if (!read) {
+					ir_instruction_t copy;
+					copy.opcode = ir_copy;
+					copy.destination = copies[i].first;
+					copy.operands.push_back(copies[i].second);
+					output.push_back(copy);
+					copies.erase(copies.begin() + i);
+					emitted = true;
+					break;
+				}
+			}
+			if (emitted) {
+				continue;
+			}
+			// Every remaining copy is part of a cycle. Save the destination of
+			// the first into a fresh register and read it from there instead.
+			long saved = copies[0].first;
+			ir_instruction_t copy;
+			copy.opcode = ir_copy;
+			copy.destination = function->register_count++;
+			copy.operands.push_back(ir_register(saved));
+			output.push_back(copy);
+			for (int i = 0; i < copies.size(); i++) {
+				if (copies[i].second.type == io_register && copies[i].second.value == saved) {
+					copies[i].second = ir_register(copy.destination);
+				}
+			}
+		}
+	}
+
+	// Find where to insert copies at the end of a block: before the
+	// terminator, or before the comparison or bit test feeding a branch if
+	// the copies neither read nor write it's registers, so the two stay
+	// adjacent.
+	long insertion_point(std::vector<ir_instruction_t>& instructions, std::vector<ir_instruction_t>& copies) {
+		long end = instructions.size() - 1;
+		ir_instruction_t& terminator = instructions[end];
+		if (terminator.opcode != ir_branch || end < 1 ||
+			(!ir_is_comparison(instructions[end - 1].opcode) && instructions[end - 1].opcode != ir_and) ||
+			terminator.operands[0].type != io_register || terminator.operands[0].value != instructions[end - 1].destination)
+		{
+			return end;
+		}
+		ir_instruction_t& comparison = instructions[end - 1];
+		for (int i = 0; i < copies.size(); i++) {
+			if (copies[i].operands[0].type == io_register && copies[i].operands[0].value == comparison.destination) {
+				return end;
+			}
+			for (int j = 0; j < comparison.operands.size(); j++) {
+				ir_operand_t& operand = comparison.operands[j];
+				if (operand.type == io_register && operand.value == copies[i].destination) {
+					return end;
+				}
+			}
+		}
+		return end - 1;
+	}
+
+	// Translate a function out of SSA form.
+	void run(ir_function_t& function) {
+		this->function = &function;
+		split_critical_edges();
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = function.blocks[i].instructions;
+			long phi_count = 0;
+			while (phi_count < instructions.size() && instructions[phi_count].opcode == ir_phi) {
+				phi_count++;
+			}
+			if (!phi_count) {
+				continue;
+			}
+			std::vector<long>& predecessors = function.blocks[i].predecessors;
+			for (int j = 0; j < predecessors.size(); j++) {
+				std::vector<std::pair<long, ir_operand_t>> copies;
+				for (int k = 0; k < phi_count; k++) {
+					ir_instruction_t& phi = instructions[k];
+					long index = std::find(phi.targets.begin(), phi.targets.end(), predecessors[j]) - phi.targets.begin();
+					copies.push_back({phi.destination, phi.operands[index]});
+				}
+				std::vector<ir_instruction_t> sequence;
+				sequentialize(copies, sequence);
+				std::vector<ir_instruction_t>& predecessor = function.blocks[predecessors[j]].instructions;
+				predecessor.insert(predecessor.begin() + insertion_point(predecessor, sequence), sequence.begin(), sequence.end());
+			}
+			instructions.erase(instructions.begin(), instructions.begin() + phi_count);
+		}
+	}
+};
@@ -0,0 +1,261 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include "../util/ansi_colors.hpp"
+#include "ir.hpp"
+#include "dump.hpp"
+#include "dominators.hpp"
+
+// An IR verifier. The verifier checks the structural invariants that every
+// pass may assume about the IR, and optionally that the IR is in SSA form.
+struct ir_verifier_t {
+	ir_function_t* function = nullptr;
+	// Whether every register must have a single definition that dominates
+	// it's uses.
+	bool ssa = false;
+
+	// Default constructor.
+	ir_verifier_t(bool ssa = false) {
+		this->ssa = ssa;
+	}
+
+	// Print an error message along with the offending function, then exit.
+	void die(std::string error) {
+		std::cerr << set_color(bold_white) << function->identifier << ": ";
+		std::cerr << set_color(bold_red) << "internal compiler error: ";
+		std::cerr << set_color(bold_white) << error << set_color(reset) << std::endl;
+		std::cerr << ir_dump_function(*function);
+		exit(4);
+	}
+
+	// Print an error message along with the offending instruction, then exit.
+	void die(std::string error, long block, ir_instruction_t& instruction) {
+		die(error + " in '" + ir_dump_instruction(instruction) + "' (" + ir_dump_label(block) + ")");
+	}
+
+	// Verify a value operand.
+	void verify_value(ir_operand_t operand, long block, ir_instruction_t& instruction) {
+		if (operand.type == io_register) {
+			if (operand.value < 0 || operand.value >= function->register_count) {
+				die("register out of range", block, instruction);
+			}
+		} else if (operand.type != io_immediate) {
+			die("expected a register or immediate operand", block, instruction);
+		}
+	}
+
+	// Verify a slot operand.
+	void verify_slot(ir_operand_t operand, long block, ir_instruction_t& instruction) {
+		if (operand.type != io_slot) {
+			die("expected a slot operand", block, instruction);
+		} else if (operand.value < 0 || operand.value >= function->slots.size()) {
+			die("slot out of range", block, instruction);
+		}
+	}
+
+	// Verify an instruction.
+	void verify_instruction(long block, ir_instruction_t& instruction) {
+		ir_opcode_t opcode = instruction.opcode;
+		std::vector<ir_operand_t>& operands = instruction.operands;
+		// Check the operand count.
+		long expected = 1;
+		if (opcode == ir_address || opcode == ir_jump) {
+			expected = 0;
+		} else if (opcode == ir_store_slot || opcode == ir_store || opcode == ir_switch || ir_is_binary(opcode)) {
+			expected = 2;
+		} else if (opcode == ir_select) {
+			expected = 3;
+		} else if (opcode == ir_call || opcode == ir_phi) {
+			expected = operands.size();
+		}
+		if (operands.size() != expected) {
+			die("expected " + std::to_string(expected) + " operands", block, instruction);
+		}
+		// Check the destination.
+		bool has_destination = opcode != ir_store_slot &&
+							   opcode != ir_store &&
+							   !ir_is_terminator(opcode);
+		if (has_destination && instruction.destination < 0) {
+			die("missing destination", block, instruction);
+		} else if (!has_destination && instruction.destination >= 0) {
+			die("unexpected destination", block, instruction);
+		} else if (instruction.destination >= function->register_count) {
+			die("register out of range", block, instruction);
+		}
+		// Check the operands.
+		if (opcode == ir_constant || opcode == ir_parameter) {
+			if (operands[0].type != io_immediate) {
+				die("expected an immediate operand", block, instruction);
+			}
+			if (opcode == ir_parameter && (operands[0].value < 0 || operands[0].value >= function->parameter_count)) {
+				die("parameter out of range", block, instruction);
+			}
+		} else if (opcode == ir_slot_address || opcode == ir_load_slot) {
+			verify_slot(operands[0], block, instruction);
+		} else if (opcode == ir_store_slot) {
+			verify_slot(operands[0], block, instruction);
+			verify_value(operands[1], block, instruction);
+		} else {
+			for (int i = 0; i < operands.size(); i++) {
+				verify_value(operands[i], block, instruction);
+			}
+			if (opcode == ir_switch && operands[1].type != io_immediate) {
+				die("expected an immediate operand", block, instruction);
+			}
+		}
+		// Check the size.
+		long size = instruction.size;
+		if (opcode == ir_load || opcode == ir_store) {
+			if (size != 1 && size != 2 && size != 4 && size != 8) {
+				die("invalid access size", block, instruction);
+			}
+		} else if (opcode == ir_extend) {
+			if (size != 1 && size != 2 && size != 4) {
+				die("invalid extension size", block, instruction);
+			}
+		} else if (ir_is_binary(opcode) || opcode == ir_neg || opcode == ir_not ||
+				   opcode == ir_select || opcode == ir_branch)
+		{
+			if (size != 4 && size != 8) {
+				die("invalid operation size", block, instruction);
+			}
+		} else if (size != 8) {
+			die("unexpected size", block, instruction);
+		}
+		// Check the symbol.
+		if ((opcode == ir_address || opcode == ir_call) && instruction.symbol.empty()) {
+			die("missing symbol", block, instruction);
+		}
+		// Check the targets.
+		long target_count = 0;
+		if (opcode == ir_jump) {
+			target_count = 1;
+		} else if (opcode == ir_branch) {
+			target_count = 2;
+		} else if (opcode == ir_phi) {
+			target_count = operands.size();
+		} else if (opcode == ir_switch) {
+			// The default and at least one table entry.
+			target_count = std::max<long>(instruction.targets.size(), 2);
+		}
+		if (instruction.targets.size() != target_count) {
+			die("expected " + std::to_string(target_count) + " targets", block, instruction);
+		}
+		for (int i = 0; i < instruction.targets.size(); i++) {
+			if (instruction.targets[i] < 0 || instruction.targets[i] >= function->blocks.size()) {
+				die("target out of range", block, instruction);
+			}
+		}
+		// A phi has exactly one operand per predecessor.
+		if (opcode == ir_phi) {
+			std::vector<long> targets = instruction.targets;
+			std::vector<long> predecessors = function->blocks[block].predecessors;
+			std::sort(targets.begin(), targets.end());
+			std::sort(predecessors.begin(), predecessors.end());
+			if (targets != predecessors) {
+				die("phi does not match the predecessors", block, instruction);
+			}
+		}
+	}
+
+	// Verify that every register has a single definition that dominates it's
+	// uses. The operands of a phi are used at the end of the predecessor they
+	// flow in from.
+	void verify_ssa() {
+		ir_dominator_tree_t tree(*function);
+		std::vector<long> definition_block(function->register_count, -1);
+		std::vector<long> definition_index(function->register_count, -1);
+		for (int i = 0; i < function->blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = function->blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				long destination = instructions[j].destination;
+				if (destination < 0) {
+					continue;
+				}
+				if (definition_block[destination] >= 0) {
+					die("register defined more than once", i, instructions[j]);
+				}
+				definition_block[destination] = i;
+				definition_index[destination] = j;
+			}
+		}
+		for (int i = 0; i < function->blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = function->blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				ir_instruction_t& instruction = instructions[j];
+				for (int k = 0; k < instruction.operands.size(); k++) {
+					if (instruction.operands[k].type != io_register) {
+						continue;
+					}
+					long reg = instruction.operands[k].value;
+					long use_block = i;
+					long use_index = j;
+					if (instruction.opcode == ir_phi) {
+						use_block = instruction.targets[k];
+						use_index = function->blocks[use_block].instructions.size();
+					}
+					bool dominated = definition_block[reg] == use_block ?
+						definition_index[reg] < use_index :
+						tree.dominates(definition_block[reg], use_block);
+					if (!dominated) {
+						die("definition does not dominate use", i, instruction);
+					}
+				}
+			}
+		}
+	}
+
+	// Verify a function.
+	void verify(ir_function_t& function) {
+		this->function = &function;
+		if (function.blocks.empty()) {
+			die("function has no blocks");
+		} else if (!function.blocks[0].predecessors.empty()) {
+			die("the entry block has predecessors");
+		}
+		std::vector<bool> defined(function.register_count, false);
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = function.blocks[i].instructions;
+			if (instructions.empty() || !ir_is_terminator(instructions.back().opcode)) {
+				die(ir_dump_label(i) + " does not end with a terminator");
+			}
+			for (int j = 0; j < instructions.size(); j++) {
+				if (j != instructions.size() - 1 && ir_is_terminator(instructions[j].opcode)) {
+					die("terminator before the end of the block", i, instructions[j]);
+				}
+				if (j && instructions[j].opcode == ir_phi && instructions[j - 1].opcode != ir_phi) {
+					die("phi after the start of the block", i, instructions[j]);
+				}
+				verify_instruction(i, instructions[j]);
+				if (instructions[j].destination >= 0) {
+					defined[instructions[j].destination] = true;
+				}
+			}
+		}
+		// Every register that is used must be defined somewhere.
+		for (int i = 0; i < function.blocks.size(); i++) {
+			std::vector<ir_instruction_t>& instructions = function.blocks[i].instructions;
+			for (int j = 0; j < instructions.size(); j++) {
+				std::vector<long> uses = ir_uses(instructions[j]);
+				for (int k = 0; k < uses.size(); k++) {
+					if (!defined[uses[k]]) {
+						die("use of undefined register", i, instructions[j]);
+					}
+				}
+			}
+		}
+		if (ssa) {
+			verify_ssa();
+		}
+	}
+
+	// Verify a program.
+	void verify(ir_program_t& program) {
+		for (int i = 0; i < program.functions.size(); i++) {
+			verify(program.functions[i]);
+		}
+	}
+};
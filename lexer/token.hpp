@@ -13,11 +13,20 @@ enum token_type_t {
 	// Reserved words.
 	tk_if,
 	tk_int,
+	tk_char,
+	tk_short,
+	tk_long,
 	tk_else,
 	tk_while,
+	tk_for,
+	tk_do,
 	tk_return,
 	tk_break,
 	tk_continue,
+	tk_switch,
+	tk_case,
+	tk_default,
+	tk_struct,
 	// Punctuation.
 	tk_left_parenthesis,
 	tk_right_parenthesis,
@@ -27,6 +36,10 @@ enum token_type_t {
 	tk_right_brace,
 	tk_comma,
 	tk_semicolon,
+	tk_colon,
+	tk_question,
+	tk_dot,
+	tk_arrow,
 	// Binary operators.
 	tk_bi_division,
 	tk_bi_modulo,
@@ -56,6 +69,8 @@ enum token_type_t {
 	// Unary operators.
 	tk_un_logical_not,
 	tk_un_binary_not,
+	tk_un_increment,
+	tk_un_decrement,
 	// Ambiguous operators.
 	tk_plus,
 	tk_minus,
@@ -74,11 +89,20 @@ std::string token_type_str[] = {
 	// Reserved words.
 	"'if'",
 	"'int'",
+	"'char'",
+	"'short'",
+	"'long'",
 	"'else'",
 	"'while'",
+	"'for'",
+	"'do'",
 	"'return'",
 	"'break'",
 	"'continue'",
+	"'switch'",
+	"'case'",
+	"'default'",
+	"'struct'",
 	// Punctuation.
 	"'('",
 	"')'",
@@ -88,6 +112,10 @@ std::string token_type_str[] = {
 	"'}'",
 	"','",
 	"';'",
+	"':'",
+	"'?'",
+	"'.'",
+	"'->'",
 	// Binary operators.
 	"'/'",
 	"'%'",
@@ -117,6 +145,8 @@ std::string token_type_str[] = {
 	// Unary operators.
 	"'!'",
 	"'~'",
+	"'++'",
+	"'--'",
 	// Ambiguous operators.
 	"'+'",
 	"'-'",
@@ -63,16 +63,34 @@ struct token_stream_t {
 			return {tk_if, str, TOKEN_DEBUG};
 		} else if (str == "int") {
 			return {tk_int, str, TOKEN_DEBUG};
+		} else if (str == "char") {
+			return {tk_char, str, TOKEN_DEBUG};
+		} else if (str == "short") {
+			return {tk_short, str, TOKEN_DEBUG};
+		} else if (str == "long") {
+			return {tk_long, str, TOKEN_DEBUG};
 		} else if (str == "else") {
 			return {tk_else, str, TOKEN_DEBUG};
 		} else if (str == "while") {
 			return {tk_while, str, TOKEN_DEBUG};
+		} else if (str == "for") {
+			return {tk_for, str, TOKEN_DEBUG};
+		} else if (str == "do") {
+			return {tk_do, str, TOKEN_DEBUG};
 		} else if (str == "return") {
 			return {tk_return, str, TOKEN_DEBUG};
 		} else if (str == "break") {
 			return {tk_break, str, TOKEN_DEBUG};
 		} else if (str == "continue") {
 			return {tk_continue, str, TOKEN_DEBUG};
+		} else if (str == "switch") {
+			return {tk_switch, str, TOKEN_DEBUG};
+		} else if (str == "case") {
+			return {tk_case, str, TOKEN_DEBUG};
+		} else if (str == "default") {
+			return {tk_default, str, TOKEN_DEBUG};
+		} else if (str == "struct") {
+			return {tk_struct, str, TOKEN_DEBUG};
 		} else {
 			return {tk_identifier, str, TOKEN_DEBUG};
 		}
@@ -219,9 +237,24 @@ struct token_stream_t {
 			input.next();
 			return {tk_semicolon, ";", TOKEN_DEBUG};
 		}
+		// Check for colons.
+		else if (ch == ':') {
+			input.next();
+			return {tk_colon, ":", TOKEN_DEBUG};
+		}
+		// Check for question marks.
+		else if (ch == '?') {
+			input.next();
+			return {tk_question, "?", TOKEN_DEBUG};
+		}
+		// Check for dots.
+		else if (ch == '.') {
+			input.next();
+			return {tk_dot, ".", TOKEN_DEBUG};
+		}
 
-		// Check for the ambiguous plus (+) operator and binary addition
-		// assignment.
+		// Check for the ambiguous plus (+) operator, binary addition
+		// assignment and unary increment.
 		else if (ch == '+') {
 			input.next();
 			if (input.eof()) {
@@ -229,19 +262,28 @@ struct token_stream_t {
 			} else if (input.peek() == '=') {
 				input.next();
 				return {tk_bi_addition_assignment, "+=", TOKEN_DEBUG};
+			} else if (input.peek() == '+') {
+				input.next();
+				return {tk_un_increment, "++", TOKEN_DEBUG};
 			} else {
 				return {tk_plus, "+", TOKEN_DEBUG};
 			}
 		}
-		// Check for the ambiguous minus (-) operator and binary subtraction
-		// assignment.
+		// Check for the ambiguous minus (-) operator, binary subtraction
+		// assignment, unary decrement and member access through a pointer.
 		else if (ch == '-') {
 			input.next();
 			if (input.eof()) {
 				return {tk_minus, "-", TOKEN_DEBUG};
+			} else if (input.peek() == '>') {
+				input.next();
+				return {tk_arrow, "->", TOKEN_DEBUG};
 			} else if (input.peek() == '=') {
 				input.next();
 				return {tk_bi_subtraction_assignment, "-=", TOKEN_DEBUG};
+			} else if (input.peek() == '-') {
+				input.next();
+				return {tk_un_decrement, "--", TOKEN_DEBUG};
 			} else {
 				return {tk_minus, "-", TOKEN_DEBUG};
 			}
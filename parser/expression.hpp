@@ -15,7 +15,10 @@ enum expression_type_t {
 	et_indexing,
 	et_function_call,
 	et_binary,
-	et_unary
+	et_unary,
+	et_ternary,
+	et_type_name,
+	et_member
 };
 
 // An indexing expression.
@@ -43,6 +46,21 @@ struct unary_expression_t {
 	unary_operator_t unary_operator;
 };
 
+// A ternary expression, selecting one of two values by a condition.
+struct ternary_expression_t {
+	expression_t* condition;
+	expression_t* if_true;
+	expression_t* if_false;
+};
+
+// A member access expression, naming a field of a struct or, through the
+// arrow operator, of the struct a pointer points to.
+struct member_expression_t {
+	expression_t* object;
+	identifier_t member;
+	bool arrow;
+};
+
 // An expression.
 struct expression_t {
 	expression_type_t			type;
@@ -61,6 +79,8 @@ struct expression_t {
 	function_call_expression_t	function_call;
 	binary_expression_t			binary;
 	unary_expression_t			unary;
+	ternary_expression_t		ternary;
+	member_expression_t			member;
 
 	expression_t(std::string literal, std::string disambiguation, long lineno, long colno) {
 		if (disambiguation == "int") {
@@ -107,4 +127,41 @@ struct expression_t {
 		this->lineno = lineno;
 		this->colno = colno;
 	}
-};
\ No newline at end of file
+
+	expression_t(ternary_expression_t expr, long lineno, long colno) {
+		type = et_ternary;
+		ternary = expr;
+		this->lineno = lineno;
+		this->colno = colno;
+	}
+
+	expression_t(member_expression_t expr, long lineno, long colno) {
+		type = et_member;
+		member = expr;
+		this->lineno = lineno;
+		this->colno = colno;
+	}
+
+	expression_t(type_t type_name, long lineno, long colno) {
+		type = et_type_name;
+		return_type = type_name;
+		this->lineno = lineno;
+		this->colno = colno;
+	}
+};
+
+// Get the field a member access expression names, once the type of it's
+// object is known, or null if there is no such field.
+field_t* member_field(expression_t* expression) {
+	type_t type = expression->member.object->return_type;
+	if (expression->member.arrow) {
+		if (!is_pointer(type)) {
+			return nullptr;
+		}
+		type = element_type(type);
+	}
+	if (!is_struct(type) || !struct_types[type.tag].complete) {
+		return nullptr;
+	}
+	return find_field(type, expression->member.member);
+}
\ No newline at end of file
@@ -75,7 +75,11 @@ enum unary_operator_t {
 	un_arithmetic_negative,
 	un_address_of,
 	un_logical_not,
-	un_binary_not
+	un_binary_not,
+	un_pre_increment,
+	un_pre_decrement,
+	un_post_increment,
+	un_post_decrement
 };
 
 // All unary operators as strings.
@@ -85,5 +89,9 @@ std::string unary_operator_str[] = {
 	"arithmetic negative",
 	"address-of",
 	"logical NOT",
-	"binary NOT"
+	"binary NOT",
+	"pre-increment",
+	"pre-decrement",
+	"post-increment",
+	"post-decrement"
 };
\ No newline at end of file
@@ -14,13 +14,20 @@ typedef std::string identifier_t;
 #include "statement.hpp"
 #include "function.hpp"
 
-// A program.
-typedef std::vector<function_t> program_t;
+// A program: the struct types it defines, in order, it's file-scope
+// variable declarations and it's functions.
+struct program_t {
+	std::vector<long>			structs;
+	std::vector<statement_t*>	globals;
+	std::vector<function_t>		functions;
+};
 
 // A parser.
 struct parser_t {
 	std::string filename;
 	complete_token_stream_t input;
+	// The struct types defined so far, in order.
+	std::vector<long> structs;
 
 	// Default constructor.
 	parser_t(std::string filename, std::string buffer) {
@@ -44,15 +51,69 @@ struct parser_t {
 		return input.next();
 	}
 
-	// Parse a type.
+	// Check if a token starts a type.
+	static bool is_type(token_type_t type) {
+		return type == tk_int || type == tk_char || type == tk_short || type == tk_long || type == tk_struct;
+	}
+
+	// Parse the fields of a struct definition into it's struct type. A
+	// field is declared like a variable without an initializer.
+	void parse_struct_body(long tag) {
+		struct_type_t& type = struct_types[tag];
+		if (type.defined) {
+			die("redefinition of 'struct " + type.tag + "'");
+		}
+		type.defined = true;
+		token_t brace = expect(tk_left_brace);
+		type.lineno = brace.lineno;
+		type.colno = brace.colno - 2;
+		while (input.peek().type != tk_right_brace) {
+			token_t peek = input.peek();
+			field_t field = {parse_type(), parse_identifier(), nullptr};
+			field.lineno = peek.lineno;
+			field.colno = peek.colno - peek.text.length() - 1;
+			if (input.peek().type == tk_left_bracket) {
+				expect(tk_left_bracket);
+				field.length = parse_expression();
+				expect(tk_right_bracket);
+			}
+			expect(tk_semicolon);
+			struct_types[tag].fields.push_back(field);
+		}
+		expect(tk_right_brace);
+		structs.push_back(tag);
+	}
+
+	// Parse a type. A struct type may be defined where it is named.
 	type_t parse_type() {
-		expect(tk_int);
+		base_type_t base = ty_int;
+		long tag = 0;
+		token_type_t peek = input.peek().type;
+		if (peek == tk_struct) {
+			expect(tk_struct);
+			base = ty_struct;
+			tag = struct_tag(parse_identifier());
+			if (input.peek().type == tk_left_brace) {
+				parse_struct_body(tag);
+			}
+		} else if (peek == tk_char) {
+			expect(tk_char);
+			base = ty_char;
+		} else if (peek == tk_short) {
+			expect(tk_short);
+			base = ty_short;
+		} else if (peek == tk_long) {
+			expect(tk_long);
+			base = ty_long;
+		} else {
+			expect(tk_int);
+		}
 		long pointer_depth = 0;
 		while (input.peek().type == tk_asterisk) {
 			input.next();
 			pointer_depth++;
 		}
-		return {pointer_depth};
+		return {pointer_depth, base, 0, tag};
 	}
 
 	// Parse an identifier.
@@ -132,12 +193,14 @@ struct parser_t {
 		} else if (peek.type == tk_un_binary_not) {
 			expect(tk_un_binary_not);
 			return new expression_t({parse_literal(), un_binary_not}, EXPRESSION_DEBUG);
-		} else if (peek.type == tk_int) {
-			expect(tk_int);
-			while (input.peek().type == tk_asterisk) {
-				expect(tk_asterisk);
-			}
-			return new expression_t("0", "int", EXPRESSION_DEBUG);
+		} else if (peek.type == tk_un_increment) {
+			expect(tk_un_increment);
+			return new expression_t({parse_literal(), un_pre_increment}, EXPRESSION_DEBUG);
+		} else if (peek.type == tk_un_decrement) {
+			expect(tk_un_decrement);
+			return new expression_t({parse_literal(), un_pre_decrement}, EXPRESSION_DEBUG);
+		} else if (is_type(peek.type)) {
+			return new expression_t(parse_type(), EXPRESSION_DEBUG);
 		} else {
 			die("expected literal");
 			return nullptr;
@@ -149,11 +212,27 @@ struct parser_t {
 	expression_t* parse_literal() {
 		expression_t* node = parse_literal_no_suffix();
 		token_t peek;
-		while ((peek = input.peek()).type == tk_left_bracket) {
-			expect(tk_left_bracket);
-			expression_t* index = parse_expression();
-			expect(tk_right_bracket);
-			node = new expression_t((indexing_expression_t){node, index}, peek.lineno, peek.colno - peek.text.length() - 1);
+		while ((peek = input.peek()).type == tk_left_bracket ||
+			   peek.type == tk_un_increment ||
+			   peek.type == tk_un_decrement ||
+			   peek.type == tk_dot ||
+			   peek.type == tk_arrow)
+		{
+			if (peek.type == tk_dot || peek.type == tk_arrow) {
+				input.next();
+				node = new expression_t((member_expression_t){node, parse_identifier(), peek.type == tk_arrow}, peek.lineno, peek.colno - peek.text.length() - 1);
+			} else if (peek.type == tk_un_increment) {
+				expect(tk_un_increment);
+				node = new expression_t((unary_expression_t){node, un_post_increment}, peek.lineno, peek.colno - peek.text.length() - 1);
+			} else if (peek.type == tk_un_decrement) {
+				expect(tk_un_decrement);
+				node = new expression_t((unary_expression_t){node, un_post_decrement}, peek.lineno, peek.colno - peek.text.length() - 1);
+			} else {
+				expect(tk_left_bracket);
+				expression_t* index = parse_expression();
+				expect(tk_right_bracket);
+				node = new expression_t((indexing_expression_t){node, index}, peek.lineno, peek.colno - peek.text.length() - 1);
+			}
 		}
 		return node;
 	}
@@ -335,11 +414,24 @@ struct parser_t {
 		return node;
 	}
 
+	// Parse a ternary term (right-associative).
+	expression_t* parse_ternary_term() {
+		expression_t* node = parse_logical_or_term();
+		if (input.peek().type == tk_question) {
+			token_t peek = input.peek();
+			expect(tk_question);
+			expression_t* if_true = parse_expression();
+			expect(tk_colon);
+			node = new expression_t((ternary_expression_t){node, if_true, parse_ternary_term()}, EXPRESSION_DEBUG);
+		}
+		return node;
+	}
+
 	// Parse an assignment term (right-associative).
 	expression_t* parse_assignment_term() {
 		std::vector<expression_t*> nodes;
 		std::vector<binary_operator_t> operators;
-		nodes.push_back(parse_logical_or_term());
+		nodes.push_back(parse_ternary_term());
 		while (input.peek().type == tk_bi_assignment ||
 			   input.peek().type == tk_bi_addition_assignment ||
 			   input.peek().type == tk_bi_subtraction_assignment ||
@@ -376,7 +468,7 @@ struct parser_t {
 			} else if (next.type == tk_bi_binary_right_shift_assignment) {
 				operators.push_back(bi_binary_right_shift_assignment);
 			}
-			nodes.push_back(parse_logical_or_term());
+			nodes.push_back(parse_ternary_term());
 		}
 		if (nodes.size() == 1) {
 			return nodes[0];
@@ -406,6 +498,43 @@ struct parser_t {
 
 	#define STATEMENT_DEBUG peek.lineno, peek.colno - peek.text.length() - 1
 
+	// Parse the rest of a variable declaration following it's type and
+	// identifier, starting at a token: an optional array length and an
+	// optional initializer. An array or struct is initialized by a braced
+	// list of elements, which may end in a comma, and an array also by a
+	// string literal.
+	statement_t* parse_declaration(type_t type, identifier_t identifier, token_t peek) {
+		variable_declaration_statement_t declaration = {type, identifier, nullptr};
+		if (input.peek().type == tk_left_bracket) {
+			expect(tk_left_bracket);
+			declaration.is_array = true;
+			if (input.peek().type != tk_right_bracket) {
+				declaration.length = parse_expression();
+			}
+			expect(tk_right_bracket);
+		}
+		if (input.peek().type == tk_bi_assignment) {
+			expect(tk_bi_assignment);
+			if ((declaration.is_array || is_struct(type)) && input.peek().type == tk_left_brace) {
+				expect(tk_left_brace);
+				while (input.peek().type != tk_right_brace) {
+					declaration.initializers.push_back(parse_expression());
+					if (input.peek().type != tk_right_brace) {
+						expect(tk_comma);
+					}
+				}
+				expect(tk_right_brace);
+			} else {
+				declaration.initializer = parse_expression();
+			}
+		}
+		expect(tk_semicolon);
+		statement_t* statement = new statement_t(declaration);
+		statement->lineno = peek.lineno;
+		statement->colno = peek.colno - peek.text.length() - 1;
+		return statement;
+	}
+
 	// Parse a statement.
 	statement_t* parse_statement() {
 		token_t peek = input.peek();
@@ -425,7 +554,12 @@ struct parser_t {
 			expression_t* condition = parse_expression();
 			expect(tk_right_parenthesis);
 			statement_t* body = parse_statement();
-			return new statement_t((conditional_statement_t){condition, body});
+			statement_t* else_body = nullptr;
+			if (input.peek().type == tk_else) {
+				expect(tk_else);
+				else_body = parse_statement();
+			}
+			return new statement_t((conditional_statement_t){condition, body, else_body});
 		} else if (peek.type == tk_while) {
 			// While statement.
 			expect(tk_while);
@@ -434,23 +568,77 @@ struct parser_t {
 			expect(tk_right_parenthesis);
 			statement_t* body = parse_statement();
 			return new statement_t((while_statement_t){condition, body});
+		} else if (peek.type == tk_for) {
+			// For statement.
+			expect(tk_for);
+			expect(tk_left_parenthesis);
+			statement_t* initializer = nullptr;
+			if (input.peek().type == tk_semicolon) {
+				expect(tk_semicolon);
+			} else if (is_type(input.peek().type)) {
+				initializer = parse_statement();
+			} else {
+				expression_t* expression = parse_expression();
+				expect(tk_semicolon);
+				initializer = new statement_t((expression_statement_t){expression});
+			}
+			expression_t* condition = nullptr;
+			if (input.peek().type != tk_semicolon) {
+				condition = parse_expression();
+			}
+			expect(tk_semicolon);
+			expression_t* step = nullptr;
+			if (input.peek().type != tk_right_parenthesis) {
+				step = parse_expression();
+			}
+			expect(tk_right_parenthesis);
+			statement_t* body = parse_statement();
+			return new statement_t((for_statement_t){initializer, condition, step, body});
+		} else if (peek.type == tk_do) {
+			// Do/while statement.
+			expect(tk_do);
+			statement_t* body = parse_statement();
+			expect(tk_while);
+			expect(tk_left_parenthesis);
+			expression_t* condition = parse_expression();
+			expect(tk_right_parenthesis);
+			expect(tk_semicolon);
+			return new statement_t((do_while_statement_t){body, condition});
+		} else if (peek.type == tk_switch) {
+			// Switch statement.
+			expect(tk_switch);
+			expect(tk_left_parenthesis);
+			expression_t* value = parse_expression();
+			expect(tk_right_parenthesis);
+			statement_t* body = parse_statement();
+			return new statement_t((switch_statement_t){value, body});
+		} else if (peek.type == tk_case) {
+			// Case label.
+			expect(tk_case);
+			expression_t* value = parse_expression();
+			expect(tk_colon);
+			return new statement_t((case_statement_t){value, 0});
+		} else if (peek.type == tk_default) {
+			// Default label.
+			expect(tk_default);
+			expect(tk_colon);
+			return new statement_t(st_default, STATEMENT_DEBUG);
 		} else if (peek.type == tk_return) {
 			// Return statement.
 			expect(tk_return);
 			expression_t* value = parse_expression();
 			expect(tk_semicolon);
 			return new statement_t((return_statement_t){value});
-		} else if (peek.type == tk_int) {
-			// Variable declaration statement.
+		} else if (is_type(peek.type)) {
+			// Variable declaration statement. Struct types are only
+			// defined at file scope, where their tags are visible to every
+			// function.
+			long defined = structs.size();
 			type_t type = parse_type();
-			identifier_t identifier = parse_identifier();
-			expression_t* initializer = nullptr;
-			if (input.peek().type == tk_bi_assignment) {
-				expect(tk_bi_assignment);
-				initializer = parse_expression();
+			if (structs.size() != defined) {
+				input.die("struct definitions are only supported at file scope", peek);
 			}
-			expect(tk_semicolon);
-			return new statement_t({type, identifier, initializer});
+			return parse_declaration(type, parse_identifier(), peek);
 		} else if (peek.type == tk_semicolon) {
 			// No-op statement.
 			expect(tk_semicolon);
@@ -484,20 +672,32 @@ struct parser_t {
 		return statements;
 	}
 
-	// Parse the program.
-	std::vector<function_t> parse() {
-		std::vector<function_t> functions;
+	// Parse the program, a sequence of functions, file-scope variable
+	// declarations and struct definitions.
+	program_t parse() {
+		program_t program;
 		while (!input.eof()) {
 			token_t peek = input.peek();
-			functions.push_back({
-				parse_type(),
-				parse_identifier(),
-				parse_parameters(),
-				parse_statements(),
-				long(peek.lineno),
-				long(peek.colno - peek.text.length() - 1)
-			});
+			type_t type = parse_type();
+			if (type.base == ty_struct && input.peek().type == tk_semicolon) {
+				expect(tk_semicolon);
+				continue;
+			}
+			identifier_t identifier = parse_identifier();
+			if (input.peek().type == tk_left_parenthesis) {
+				program.functions.push_back({
+					type,
+					identifier,
+					parse_parameters(),
+					parse_statements(),
+					long(peek.lineno),
+					long(peek.colno - peek.text.length() - 1)
+				});
+			} else {
+				program.globals.push_back(parse_declaration(type, identifier, peek));
+			}
 		}
-		return functions;
+		program.structs = structs;
+		return program;
 	}
 };
\ No newline at end of file
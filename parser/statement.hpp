@@ -8,12 +8,17 @@ enum statement_type_t {
 	st_compound,
 	st_conditional,
 	st_while,
+	st_for,
+	st_do_while,
 	st_return,
 	st_variable_declaration,
 	st_no_op,
 	st_expression,
 	st_break,
-	st_continue
+	st_continue,
+	st_switch,
+	st_case,
+	st_default
 };
 
 // A compound statement.
@@ -21,10 +26,11 @@ struct compound_statement_t {
 	std::vector<statement_t*> statements;
 };
 
-// A conditional statement.
+// A conditional statement. The else body is null when there is none.
 struct conditional_statement_t {
 	expression_t* condition;
 	statement_t* body;
+	statement_t* else_body;
 };
 
 // A while statement.
@@ -33,16 +39,51 @@ struct while_statement_t {
 	statement_t* body;
 };
 
+// A for statement. The initializer is a variable declaration or expression
+// statement, and the initializer, condition and step may be omitted.
+struct for_statement_t {
+	statement_t* initializer;
+	expression_t* condition;
+	expression_t* step;
+	statement_t* body;
+};
+
+// A do/while statement.
+struct do_while_statement_t {
+	statement_t* body;
+	expression_t* condition;
+};
+
+// A switch statement. The case and default labels are statements within
+// it's body.
+struct switch_statement_t {
+	expression_t* value;
+	statement_t* body;
+};
+
+// A case label. The value must be a constant expression, which the semantic
+// analyzer evaluates into constant.
+struct case_statement_t {
+	expression_t* value;
+	long constant;
+};
+
 // A return statement.
 struct return_statement_t {
 	expression_t* value;
 };
 
-// A variable declaration statement.
+// A variable declaration statement. An array declaration has a length
+// expression, unless it's length is given by it's initializer, and is
+// initialized by a list of elements or, for an array of char, a string
+// literal.
 struct variable_declaration_statement_t {
 	type_t type;
 	identifier_t identifier;
 	expression_t* initializer;
+	bool is_array;
+	expression_t* length;
+	std::vector<expression_t*> initializers;
 };
 
 // An expression statement.
@@ -57,6 +98,10 @@ struct statement_t {
 	compound_statement_t				compound_stmt;
 	conditional_statement_t				conditional_stmt;
 	while_statement_t					while_stmt;
+	for_statement_t						for_stmt;
+	do_while_statement_t				do_while_stmt;
+	switch_statement_t					switch_stmt;
+	case_statement_t					case_stmt;
 	return_statement_t					return_stmt;
 	variable_declaration_statement_t	variable_declaration_stmt;
 	expression_statement_t				expression_stmt;
@@ -79,6 +124,26 @@ struct statement_t {
 		while_stmt = stmt;
 	}
 
+	statement_t(for_statement_t stmt) {
+		type = st_for;
+		for_stmt = stmt;
+	}
+
+	statement_t(do_while_statement_t stmt) {
+		type = st_do_while;
+		do_while_stmt = stmt;
+	}
+
+	statement_t(switch_statement_t stmt) {
+		type = st_switch;
+		switch_stmt = stmt;
+	}
+
+	statement_t(case_statement_t stmt) {
+		type = st_case;
+		case_stmt = stmt;
+	}
+
 	statement_t(return_statement_t stmt) {
 		type = st_return;
 		return_stmt = stmt;
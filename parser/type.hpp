@@ -1,17 +1,204 @@
 #pragma once
 #include <string>
+#include <vector>
 
-// A type.
+struct expression_t;
+
+// All base types.
+enum base_type_t {
+	ty_int,
+	ty_char,
+	ty_short,
+	ty_long,
+	ty_struct
+};
+
+// All base types as strings.
+std::string base_type_str[] = {
+	"int",
+	"char",
+	"short",
+	"long",
+	"struct"
+};
+
+// A type. A type with a pointer depth of zero is it's base type, otherwise
+// it is a pointer to the type with one less pointer depth. A type with a
+// length is an array of that many elements of the type without it. A struct
+// base type is the struct type at the index of it's tag.
 struct type_t {
-	long	pointer_depth;
+	long		pointer_depth;
+	base_type_t	base;
+	long		length;
+	long		tag;
 };
 
+// A field of a struct, at an offset from the start of it. A field declared
+// as an array has a length expression.
+struct field_t {
+	type_t			type;
+	identifier_t	identifier;
+	expression_t*	length;
+	long			offset;
+	long			lineno;
+	long			colno;
+};
+
+// A struct type, known by it's tag. It is defined once it's fields have been
+// parsed, and complete once they have been laid out.
+struct struct_type_t {
+	std::string				tag;
+	std::vector<field_t>	fields;
+	bool					defined;
+	bool					complete;
+	long					size;
+	long					alignment;
+	long					lineno;
+	long					colno;
+};
+
+// Every struct type mentioned by the program, in order.
+std::vector<struct_type_t> struct_types;
+
+// Get the index of the struct type with a tag, adding it if it has not
+// been mentioned yet.
+long struct_tag(std::string tag) {
+	for (long i = 0; i < struct_types.size(); i++) {
+		if (struct_types[i].tag == tag) {
+			return i;
+		}
+	}
+	struct_types.push_back({tag});
+	return struct_types.size() - 1;
+}
+
 // Check if a type can be converted to another type.
 bool can_convert(type_t a, type_t b) {
 	return true;
 }
 
+// Check if a type is an array.
+bool is_array(type_t type) {
+	return type.length > 0;
+}
+
+// Check if a type is a pointer.
+bool is_pointer(type_t type) {
+	return type.pointer_depth > 0 && !is_array(type);
+}
+
+// Check if a type is a struct.
+bool is_struct(type_t type) {
+	return type.pointer_depth == 0 && type.base == ty_struct && !is_array(type);
+}
+
+// Check if a type is char.
+bool is_char(type_t type) {
+	return type.pointer_depth == 0 && type.base == ty_char && !is_array(type);
+}
+
+type_t element_type(type_t type);
+
+// Get the size of a value of a type in bytes.
+long type_size(type_t type) {
+	if (is_array(type)) {
+		return type.length * type_size(element_type(type));
+	} else if (is_struct(type)) {
+		return struct_types[type.tag].size;
+	} else if (is_pointer(type) || type.base == ty_long) {
+		return 8;
+	} else if (type.base == ty_char) {
+		return 1;
+	} else if (type.base == ty_short) {
+		return 2;
+	}
+	return 4;
+}
+
+// Get the size of the operations on a value of a type in bytes. Types
+// narrower than int are promoted to int.
+long operation_size(type_t type) {
+	return type_size(type) == 8 ? 8 : 4;
+}
+
+// Get the alignment a type needs in bytes: the alignment of it's elements
+// for an array, or of it's widest field for a struct.
+long natural_alignment(type_t type) {
+	if (is_array(type)) {
+		return natural_alignment(element_type(type));
+	} else if (is_struct(type)) {
+		return struct_types[type.tag].alignment;
+	}
+	return type_size(type);
+}
+
+// Get the alignment of a variable of a type in bytes. Arrays of 16 bytes or
+// more are aligned to 16 bytes, as the System V ABI has it.
+long type_alignment(type_t type) {
+	if (is_array(type) && type_size(type) >= 16) {
+		return 16;
+	}
+	return natural_alignment(type);
+}
+
+// Get the type a pointer type points to, or the type of the elements of an
+// array type.
+type_t element_type(type_t type) {
+	if (is_array(type)) {
+		return {type.pointer_depth, type.base, 0, type.tag};
+	}
+	return {type.pointer_depth - 1, type.base, 0, type.tag};
+}
+
+// Get the type of a pointer to a type.
+type_t pointer_type(type_t type) {
+	return {type.pointer_depth + 1, type.base, 0, type.tag};
+}
+
+// Get the type an array decays to in an expression, a pointer to it's
+// first element. Other types are left as they are.
+type_t decay(type_t type) {
+	return is_array(type) ? pointer_type(element_type(type)) : type;
+}
+
+// Get the field of a struct type with an identifier, or null if it has none.
+field_t* find_field(type_t type, identifier_t identifier) {
+	std::vector<field_t>& fields = struct_types[type.tag].fields;
+	for (int i = 0; i < fields.size(); i++) {
+		if (fields[i].identifier == identifier) {
+			return &fields[i];
+		}
+	}
+	return nullptr;
+}
+
+// Collect the offsets and types of the scalars a value of a type is made
+// of, in order, starting at an offset, until there are a number of them.
+void scalar_layout(type_t type, long offset, long limit, std::vector<std::pair<long, type_t>>& scalars) {
+	if (is_array(type)) {
+		type_t element = element_type(type);
+		for (long i = 0; i < type.length && scalars.size() < limit; i++) {
+			scalar_layout(element, offset + i * type_size(element), limit, scalars);
+		}
+	} else if (is_struct(type)) {
+		std::vector<field_t>& fields = struct_types[type.tag].fields;
+		for (int i = 0; i < fields.size() && scalars.size() < limit; i++) {
+			scalar_layout(fields[i].type, offset + fields[i].offset, limit, scalars);
+		}
+	} else if (scalars.size() < limit) {
+		scalars.push_back({offset, type});
+	}
+}
+
 // Prettyprint a type.
 std::string prettyprint_type(type_t type) {
-	return "int" + std::string(type.pointer_depth, '*');
-}
\ No newline at end of file
+	std::string string = base_type_str[type.base];
+	if (type.base == ty_struct) {
+		string += " " + struct_types[type.tag].tag;
+	}
+	string += std::string(type.pointer_depth, '*');
+	if (is_array(type)) {
+		string += "[" + std::to_string(type.length) + "]";
+	}
+	return string;
+}
@@ -1,5 +1,9 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 
@@ -10,6 +14,12 @@
 struct semantic_analyzer_t {
 	std::string filename;
 	std::string buffer;
+	// The case values of the switch statements being validated, innermost
+	// last, and whether they have a default label.
+	std::vector<std::vector<long>> switch_cases;
+	std::vector<bool> switch_defaults;
+	// Whether to warn about the padding in the layout of struct types.
+	bool warn_padded = false;
 
 	// Default constructor.
 	semantic_analyzer_t(std::string filename, std::string buffer) {
@@ -23,12 +33,12 @@ struct semantic_analyzer_t {
 		exit(3);
 	}
 
-	// Print an error message, then exit.
-	void die(std::string error, long lineno, long colno) {
+	// Print a diagnostic of a kind, with the line and column it refers to.
+	void report(std::string kind, ansi_color_t color, std::string message, long lineno, long colno) {
 		std::cerr << set_color(bold_white) << filename << ":";
 		std::cerr << lineno + 1 << ":" << colno + 1 << ": ";
-		std::cerr << set_color(bold_red) << "error: ";
-		std::cerr << set_color(bold_white) << error << set_color(reset) << std::endl;
+		std::cerr << set_color(color) << kind << ": ";
+		std::cerr << set_color(bold_white) << message << set_color(reset) << std::endl;
 		// Print the line where the error occurred.
 		std::stringstream in(buffer);
 		std::string line;
@@ -46,9 +56,19 @@ struct semantic_analyzer_t {
 			}
 		}
 		std::cerr << set_color(bold_green) << '^' << set_color(reset) << std::endl;
+	}
+
+	// Print an error message, then exit.
+	void die(std::string error, long lineno, long colno) {
+		report("error", bold_red, error, lineno, colno);
 		exit(3);
 	}
 
+	// Print a warning message.
+	void warn(std::string warning, long lineno, long colno) {
+		report("warning", bold_magenta, warning, lineno, colno);
+	}
+
 	// Print an error message, then exit.
 	void die(std::string error, expression_t* expression) {
 		die(error, expression->lineno, expression->colno);
@@ -71,7 +91,7 @@ struct semantic_analyzer_t {
 		std::string expanded;
 		bool escaped = false;
 		for (int i = 0; i < literal.size(); i++) {
-			if (literal[i] == '\\') {
+			if (literal[i] == '\\' && !escaped) {
 				escaped = true;
 			} else {
 				if (escaped) {
@@ -126,32 +146,69 @@ struct semantic_analyzer_t {
 			   identifier == "sizeof";
 	}
 
+	// Check if an expression names an array variable or array field.
+	bool is_array_variable(expression_t* expression, symbol_table_t& symbols) {
+		if (expression->type == et_member) {
+			field_t* field = member_field(expression);
+			return field && is_array(field->type);
+		}
+		return expression->type == et_identifier && symbols.exists(expression->identifier) &&
+			   is_array(symbols.fetch(expression->identifier).type);
+	}
+
 	// Check if an expression is an rvalue.
 	bool is_rvalue(expression_t* expression, symbol_table_t symbols) {
 		if (expression->type == et_unary) {
 			return expression->unary.unary_operator != un_value_of;
 		} else {
 			return expression->type != et_identifier &&
-				   expression->type != et_indexing;
+				   expression->type != et_indexing &&
+				   expression->type != et_member;
+		}
+	}
+
+	// Get the type of a value of a type in an arithmetic expression: types
+	// narrower than int are promoted to int.
+	type_t promoted_type(type_t type) {
+		if (is_pointer(type) || type.base == ty_long) {
+			return type;
 		}
+		return {0, ty_int};
+	}
+
+	// Get the type of an arithmetic expression: the type of it's pointer
+	// operand, if any, or else long if either operand is a long, and int
+	// otherwise. The difference of two pointers is a long.
+	type_t arithmetic_type(binary_operator_t op, type_t left, type_t right) {
+		if (is_pointer(left) && (op != bi_subtraction || !is_pointer(right))) {
+			return left;
+		} else if (is_pointer(right) && !is_pointer(left)) {
+			return right;
+		} else if (is_pointer(left) || left.base == ty_long || right.base == ty_long) {
+			return {0, ty_long};
+		}
+		return {0, ty_int};
 	}
 
 	// Get the return type of an expression.
 	type_t expression_type(expression_t* expression, symbol_table_t symbols) {
 		if (expression->type == et_integer_literal) {
-			// An integer literal is of type int.
-			return expression->return_type = {0};
+			// An integer literal is of type int, or long if it does not fit
+			// in an int.
+			long value = std::strtol(expression->integer_literal.c_str(), nullptr, 10);
+			return expression->return_type = {0, value == (int)value ? ty_int : ty_long};
 		} else if (expression->type == et_string_literal) {
-			// A string literal is of type int*.
-			return expression->return_type = {1};
+			// A string literal is of type char*.
+			return expression->return_type = {1, ty_char};
 		} else if (expression->type == et_character_literal) {
 			// A character literal is of type int.
 			return expression->return_type = {0};
 		} else if (expression->type == et_identifier) {
 			// An identifier literal's type is equivalent to the type of the
-			// entry in the symbol table under the name of the identifier.
+			// entry in the symbol table under the name of the identifier,
+			// where an array decays to a pointer to it's first element.
 			if (symbols.exists(expression->identifier)) {
-				return expression->return_type = symbols.fetch(expression->identifier).type;
+				return expression->return_type = decay(symbols.fetch(expression->identifier).type);
 			} else {
 				die("unknown identifier '" + expression->identifier + "'", expression);
 				return expression->return_type = {0};
@@ -159,7 +216,7 @@ struct semantic_analyzer_t {
 		} else if (expression->type == et_indexing) {
 			// An indexing expression's return type is the type of the array
 			// expression with one less pointer-depth.
-			return {expression_type(expression->indexing.array, symbols).pointer_depth - 1};
+			return expression->return_type = element_type(expression_type(expression->indexing.array, symbols));
 		} else if (expression->type == et_function_call) {
 			// A function call's type is equivalent to the type of the entry
 			// in the symbol table under the name of the function.
@@ -167,9 +224,10 @@ struct semantic_analyzer_t {
 			if (symbols.exists(function_call.function)) {
 				return expression->return_type = symbols.fetch(function_call.function).type;
 			} else {
-				// Assume that the return type is int, it shouldn't matter
-				// since all types are compatible.
-				return expression->return_type = {0};
+				// Assume that the return type is long, so the pointers
+				// returned by library functions like malloc are not
+				// truncated.
+				return expression->return_type = {0, ty_long};
 			}
 		} else if (expression->type == et_binary) {
 			binary_expression_t binary = expression->binary;
@@ -177,14 +235,16 @@ struct semantic_analyzer_t {
 				binary.binary_operator == bi_subtraction ||
 				binary.binary_operator == bi_multiplication ||
 				binary.binary_operator == bi_division ||
-				binary.binary_operator == bi_modulo)
+				binary.binary_operator == bi_modulo ||
+				binary.binary_operator == bi_binary_and ||
+				binary.binary_operator == bi_binary_or ||
+				binary.binary_operator == bi_binary_xor)
 			{
 				// The return type of these types of binary expressions is
-				// equivalent to the return type of the operand with the
-				// greatest pointer depth.
+				// the type of the arithmetic on it's operands.
 				type_t left_type = expression_type(binary.left_operand, symbols);
 				type_t right_type = expression_type(binary.right_operand, symbols);
-				return expression->return_type = {std::max(left_type.pointer_depth, right_type.pointer_depth)};
+				return expression->return_type = arithmetic_type(binary.binary_operator, left_type, right_type);
 			} else if (binary.binary_operator == bi_assignment ||
 					   binary.binary_operator == bi_addition_assignment ||
 					   binary.binary_operator == bi_subtraction_assignment ||
@@ -200,6 +260,13 @@ struct semantic_analyzer_t {
 				// The return type of this type of binary expression is
 				// equivalent to the return type of the left-hand operand.
 				return expression->return_type = expression_type(binary.left_operand, symbols);
+			} else if (binary.binary_operator == bi_binary_left_shift ||
+					   binary.binary_operator == bi_binary_right_shift)
+			{
+				// The return type of this type of binary expression is the
+				// promoted type of the left-hand operand.
+				expression_type(binary.right_operand, symbols);
+				return expression->return_type = promoted_type(expression_type(binary.left_operand, symbols));
 			} else {
 				// bi_logical_and,
 				// bi_logical_or,
@@ -208,41 +275,62 @@ struct semantic_analyzer_t {
 				// bi_relational_greater_than,
 				// bi_relational_lesser_than,
 				// bi_relational_greater_than_or_equal_to,
-	            // bi_relational_lesser_than_or_equal_to,
-	            // bi_binary_and,
-				// bi_binary_or,
-				// bi_binary_xor,
-				// bi_binary_and_assignment,
-				// bi_binary_or_assignment,
-				// bi_binary_xor_assignment,
-				// bi_binary_left_shift,
-				// bi_binary_right_shift
+	            // bi_relational_lesser_than_or_equal_to
 				//
 				// The return type of these types of binary expressions is
 				// int.
 				return expression->return_type = {0};
 			}
+		} else if (expression->type == et_ternary) {
+			// A ternary expression's return type is the type of the pointer
+			// operand, or int.
+			type_t true_type = expression_type(expression->ternary.if_true, symbols);
+			type_t false_type = expression_type(expression->ternary.if_false, symbols);
+			expression_type(expression->ternary.condition, symbols);
+			return expression->return_type = arithmetic_type(bi_addition, true_type, false_type);
+		} else if (expression->type == et_type_name) {
+			// A type name's return type is the type it names.
+			return expression->return_type;
+		} else if (expression->type == et_member) {
+			// A member access expression's return type is the type of the
+			// field it names, where an array decays to a pointer to it's
+			// first element.
+			expression_type(expression->member.object, symbols);
+			field_t* field = member_field(expression);
+			return expression->return_type = field ? decay(field->type) : (type_t){0};
 		} else {
 			unary_expression_t unary = expression->unary;
 			if (unary.unary_operator == un_value_of) {
 				// The return type of this type of unary expression is the
 				// return type of the operand with one less pointer-depth.
 				type_t operand_type = expression_type(unary.operand, symbols);
-				return expression->return_type = {operand_type.pointer_depth - 1};
-			} else if (unary.unary_operator == un_arithmetic_positive ||
-					   unary.unary_operator == un_arithmetic_negative)
+				return expression->return_type = element_type(operand_type);
+			} else if (unary.unary_operator == un_pre_increment ||
+					   unary.unary_operator == un_pre_decrement ||
+					   unary.unary_operator == un_post_increment ||
+					   unary.unary_operator == un_post_decrement)
 			{
 				// The return type of these types of unary expressions is
 				// equivalent to the return type of the operand.
 				return expression->return_type = expression_type(unary.operand, symbols);
 			} else if (unary.unary_operator == un_address_of) {
 				// The return type of this type of unary expression is the
-				// return type of the operand with one more pointer-depth.
+				// return type of the operand with one more pointer-depth. The
+				// address of an array is the address of it's first element.
 				type_t operand_type = expression_type(unary.operand, symbols);
-				return expression->return_type = {operand_type.pointer_depth + 1};
+				if (is_array_variable(unary.operand, symbols)) {
+					return expression->return_type = operand_type;
+				}
+				return expression->return_type = pointer_type(operand_type);
+			} else if (unary.unary_operator == un_arithmetic_positive ||
+					   unary.unary_operator == un_arithmetic_negative ||
+					   unary.unary_operator == un_binary_not)
+			{
+				// The return type of these types of unary expressions is the
+				// promoted type of the operand.
+				return expression->return_type = promoted_type(expression_type(unary.operand, symbols));
 			} else {
 				// un_logical_not
-				// un_binary_not
 				//
 				// The return type of this type of unary expression is int.
 				return expression->return_type = {0};
@@ -250,10 +338,15 @@ struct semantic_analyzer_t {
 		}
 	}
 
-	// Validate an expression.
-	bool validate_expression(expression_t* expression, symbol_table_t symbols) {
+	// Validate an expression. A value of struct type is only valid as the
+	// object of a member access or the operand of address-of or sizeof.
+	bool validate_expression(expression_t* expression, symbol_table_t symbols, bool object = false) {
 		expression_type(expression, symbols);
-		if (expression->type == et_character_literal) {
+		if (expression->type == et_type_name) {
+			// Type names are only valid as the argument of sizeof.
+			die("unexpected type name '" + prettyprint_type(expression->return_type) + "'", expression);
+			return false;
+		} else if (expression->type == et_character_literal) {
 			// Expand the character literal.
 			character_t expanded_literal = expand_literal(expression->character_literal, expression);
 			if (expanded_literal.length() != 1) {
@@ -322,9 +415,21 @@ struct semantic_analyzer_t {
 				}
 			}
 			// A function call expression is invalid if any of it's parameter
-			// expressions are invalid.
+			// expressions are invalid. The argument of sizeof may be a type
+			// name.
 			for (int i = 0; i < function_call.arguments.size(); i++) {
-				if (!validate_expression(function_call.arguments[i], symbols)) {
+				if (function_call.function == "sizeof" && function_call.arguments[i]->type == et_type_name) {
+					continue;
+				} else if (!validate_expression(function_call.arguments[i], symbols, function_call.function == "sizeof")) {
+					return false;
+				}
+			}
+			// A sizeof expression is invalid if it's argument is an
+			// incomplete struct.
+			if (function_call.function == "sizeof" && function_call.arguments.size() == 1) {
+				type_t argument_type = function_call.arguments[0]->return_type;
+				if (is_struct(argument_type) && !struct_types[argument_type.tag].complete) {
+					die("invalid application of 'sizeof' to an incomplete type '" + prettyprint_type(argument_type) + "'", function_call.arguments[0]);
 					return false;
 				}
 			}
@@ -382,8 +487,8 @@ struct semantic_analyzer_t {
 					binary.binary_operator == bi_binary_right_shift_assignment)
 				{
 					// A binary expression of this type is invalid if the
-					// left-hand operand is an rvalue.
-					if (is_rvalue(binary.left_operand, symbols)) {
+					// left-hand operand is an rvalue or an array.
+					if (is_rvalue(binary.left_operand, symbols) || is_array_variable(binary.left_operand, symbols)) {
 						die("expression is not assignable", binary.left_operand);
 						return false;
 					}
@@ -467,7 +572,7 @@ struct semantic_analyzer_t {
 		} else if (expression->type == et_unary) {
 			unary_expression_t unary = expression->unary;
 			// Any unary expression is invalid if the operand is invalid.
-			if (!validate_expression(unary.operand, symbols)) {
+			if (!validate_expression(unary.operand, symbols, unary.unary_operator == un_address_of)) {
 				return false;
 			}
 			else if (unary.unary_operator == un_value_of) {
@@ -489,17 +594,381 @@ struct semantic_analyzer_t {
 					die("wrong type argument to unary operator ('" + prettyprint_type(operand_type) + "')", expression);
 					return false;
 				}
-			} else {
-				// un_address_of
-				//
+			} else if (unary.unary_operator == un_address_of) {
 				// A unary expression of this type is invalid if the operand
 				// is an rvalue.
 				if (is_rvalue(unary.operand, symbols)) {
 					die("cannot take the address of an rvalue of type '" + prettyprint_type(expression_type(unary.operand, symbols)) + "'", expression);
 					return false;
 				}
+			} else if (unary.unary_operator == un_pre_increment ||
+					   unary.unary_operator == un_pre_decrement ||
+					   unary.unary_operator == un_post_increment ||
+					   unary.unary_operator == un_post_decrement)
+			{
+				// A unary expression of this type is invalid if the operand
+				// is an rvalue or an array.
+				if (is_rvalue(unary.operand, symbols) || is_array_variable(unary.operand, symbols)) {
+					die("expression is not assignable", unary.operand);
+					return false;
+				}
+			}
+		} else if (expression->type == et_ternary) {
+			ternary_expression_t ternary = expression->ternary;
+			// A ternary expression is invalid if any of it's operands are
+			// invalid.
+			if (!validate_expression(ternary.condition, symbols) ||
+				!validate_expression(ternary.if_true, symbols) ||
+				!validate_expression(ternary.if_false, symbols))
+			{
+				return false;
+			}
+			// A ternary expression is invalid if it's condition cannot be
+			// converted to int, or if it's operands cannot be converted to
+			// each other.
+			type_t condition_type = expression_type(ternary.condition, symbols);
+			if (!can_convert(condition_type, {0})) {
+				die("cannot convert expression of type '" + prettyprint_type(condition_type) + "' to 'int'", ternary.condition);
+				return false;
+			}
+			type_t true_type = expression_type(ternary.if_true, symbols);
+			type_t false_type = expression_type(ternary.if_false, symbols);
+			if (!can_convert(true_type, false_type)) {
+				die("incompatible operand types ('" + prettyprint_type(true_type) + "' and '" + prettyprint_type(false_type) + "')", expression);
+				return false;
+			}
+		} else if (expression->type == et_member) {
+			member_expression_t member = expression->member;
+			// A member access expression is invalid if it's object is
+			// invalid.
+			if (!validate_expression(member.object, symbols, true)) {
+				return false;
+			}
+			// A member access expression is invalid if it's object is not a
+			// complete struct, or a pointer to one through the arrow
+			// operator, with a field under it's member identifier.
+			type_t object_type = member.object->return_type;
+			if (member.arrow && !is_pointer(object_type)) {
+				die("member reference type '" + prettyprint_type(object_type) + "' is not a pointer", expression);
+				return false;
+			} else if (!member.arrow && is_pointer(object_type) && is_struct(element_type(object_type))) {
+				die("member reference type '" + prettyprint_type(object_type) + "' is a pointer; did you mean to use '->'?", expression);
+				return false;
+			} else if (member.arrow) {
+				object_type = element_type(object_type);
+			}
+			if (!is_struct(object_type)) {
+				die("member reference base type '" + prettyprint_type(object_type) + "' is not a structure", expression);
+				return false;
+			} else if (!struct_types[object_type.tag].complete) {
+				die("incomplete definition of type '" + prettyprint_type(object_type) + "'", expression);
+				return false;
+			} else if (!member_field(expression)) {
+				die("no member named '" + member.member + "' in '" + prettyprint_type(object_type) + "'", expression);
+				return false;
 			}
 		}
+		// An expression is invalid if it is a struct value anywhere else,
+		// since structs are not copied.
+		if (!object && is_struct(expression->return_type)) {
+			die("cannot use a value of type '" + prettyprint_type(expression->return_type) + "' here; access it's members or take it's address", expression);
+			return false;
+		}
+		return true;
+	}
+
+	// Evaluate a constant expression, returning whether it is constant.
+	bool evaluate_constant(expression_t* expression, long& value) {
+		if (expression->type == et_integer_literal) {
+			value = std::strtol(expression->integer_literal.c_str(), nullptr, 10);
+			return true;
+		} else if (expression->type == et_character_literal) {
+			value = (unsigned char)expression->character_literal[0];
+			return true;
+		} else if (expression->type == et_unary) {
+			unary_expression_t& expr = expression->unary;
+			if (!evaluate_constant(expr.operand, value)) {
+				return false;
+			}
+			if (expr.unary_operator == un_arithmetic_negative) {
+				value = -(unsigned long)value;
+			} else if (expr.unary_operator == un_binary_not) {
+				value = ~value;
+			} else if (expr.unary_operator == un_logical_not) {
+				value = !value;
+			} else if (expr.unary_operator != un_arithmetic_positive) {
+				return false;
+			}
+			return true;
+		} else if (expression->type == et_binary) {
+			binary_expression_t& expr = expression->binary;
+			long left;
+			long right;
+			if (!evaluate_constant(expr.left_operand, left) || !evaluate_constant(expr.right_operand, right)) {
+				return false;
+			}
+			binary_operator_t op = expr.binary_operator;
+			if (op == bi_addition) {
+				value = (unsigned long)left + right;
+			} else if (op == bi_subtraction) {
+				value = (unsigned long)left - right;
+			} else if (op == bi_multiplication) {
+				value = (unsigned long)left * right;
+			} else if ((op == bi_division || op == bi_modulo) && right != 0) {
+				value = op == bi_division ? left / right : left % right;
+			} else if (op == bi_binary_and) {
+				value = left & right;
+			} else if (op == bi_binary_or) {
+				value = left | right;
+			} else if (op == bi_binary_xor) {
+				value = left ^ right;
+			} else if (op == bi_binary_left_shift) {
+				value = (unsigned long)left << (right & 63);
+			} else if (op == bi_binary_right_shift) {
+				value = left >> (right & 63);
+			} else {
+				return false;
+			}
+			return true;
+		} else if (expression->type == et_ternary) {
+			ternary_expression_t& expr = expression->ternary;
+			long condition;
+			if (!evaluate_constant(expr.condition, condition)) {
+				return false;
+			}
+			return evaluate_constant(condition ? expr.if_true : expr.if_false, value);
+		}
+		return false;
+	}
+
+	// Validate the condition of a loop statement.
+	bool validate_condition(expression_t* condition, symbol_table_t& symbols) {
+		// A condition is invalid if it's expression is invalid.
+		if (!validate_expression(condition, symbols)) {
+			return false;
+		}
+		// A condition is invalid if it cannot be converted to int.
+		type_t condition_type = expression_type(condition, symbols);
+		if (!can_convert(condition_type, {0})) {
+			die("cannot convert expression of type '" + prettyprint_type(condition_type) + "' to 'int'", condition);
+			return false;
+		}
+		return true;
+	}
+
+	// Validate the initializer list of an array or struct, whose elements
+	// initialize the scalars it is made of in order. Constant elements are
+	// folded into integer literals, and the elements of a file-scope variable
+	// must be constants or string literals.
+	bool validate_initializers(statement_t* statement, symbol_table_t& symbols, bool global) {
+		variable_declaration_statement_t& stmt = statement->variable_declaration_stmt;
+		std::vector<std::pair<long, type_t>> scalars;
+		scalar_layout(stmt.type, 0, stmt.initializers.size() + 1, scalars);
+		// An initializer list is invalid if it has more elements than there
+		// are scalars to initialize.
+		if (stmt.initializers.size() > scalars.size()) {
+			die(std::string("excess elements in ") + (stmt.is_array ? "array" : "struct") + " initializer", stmt.initializers[scalars.size()]);
+			return false;
+		}
+		for (int i = 0; i < stmt.initializers.size(); i++) {
+			expression_t*& initializer = stmt.initializers[i];
+			type_t element = scalars[i].second;
+			if (!validate_expression(initializer, symbols)) {
+				return false;
+			}
+			type_t initializer_type = expression_type(initializer, symbols);
+			if (!can_convert(initializer_type, element)) {
+				die("no conversion from initializer value of type '" + prettyprint_type(initializer_type) + "' to element type '" + prettyprint_type(element) + "'", initializer);
+				return false;
+			}
+			long value;
+			if (evaluate_constant(initializer, value)) {
+				initializer = new expression_t(std::to_string(value), "int", initializer->lineno, initializer->colno);
+				expression_type(initializer, symbols);
+			} else if (global && (initializer->type != et_string_literal || !is_pointer(element))) {
+				die("initializer element is not a compile-time constant", initializer);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Validate an array declaration, working out it's length from it's
+	// initializer when it is not given: an initializer list of an array of
+	// structs initializes the fields of one element after the other.
+	bool validate_array(statement_t* statement, symbol_table_t& symbols, bool global) {
+		variable_declaration_statement_t& stmt = statement->variable_declaration_stmt;
+		// An array declaration is invalid if it's length is not a positive
+		// constant.
+		long length = 0;
+		if (stmt.length) {
+			if (!validate_expression(stmt.length, symbols) || !evaluate_constant(stmt.length, length) || length <= 0) {
+				die("array size is not a positive integer constant", stmt.length);
+				return false;
+			}
+		}
+		// An array declaration is invalid if it is initialized by anything
+		// but an initializer list or, for an array of char, a string literal.
+		long count = stmt.initializers.size();
+		if (stmt.initializer) {
+			if (stmt.initializer->type != et_string_literal || !is_char(stmt.type)) {
+				die("array initializer must be an initializer list", stmt.initializer);
+				return false;
+			}
+			validate_expression(stmt.initializer, symbols);
+			// A string exactly filling the array leaves out it's null
+			// terminator.
+			count = stmt.initializer->string_literal.size() + 1;
+			if (stmt.length && count == length + 1) {
+				count = length;
+			}
+		}
+		// An array declaration is invalid if it has no length and no
+		// initializer, or a string initializer longer than it is.
+		std::vector<std::pair<long, type_t>> scalars;
+		scalar_layout(stmt.type, 0, LONG_MAX, scalars);
+		if (!stmt.length && !count) {
+			die("definition of array '" + stmt.identifier + "' requires an explicit size", statement->lineno, statement->colno);
+			return false;
+		} else if (!stmt.length) {
+			length = stmt.initializer ? count : (count + scalars.size() - 1) / scalars.size();
+		} else if (stmt.initializer && count > length) {
+			die("initializer-string for char array is too long", stmt.initializer);
+			return false;
+		}
+		stmt.type.length = length;
+		return validate_initializers(statement, symbols, global);
+	}
+
+	// Get the number of bytes as a string.
+	static std::string bytes_str(long count) {
+		return std::to_string(count) + (count == 1 ? " byte" : " bytes");
+	}
+
+	// Lay out the fields of a struct type in order, each at the next offset
+	// aligned for it, rounding it's size up to the alignment of it's widest
+	// field. With -Wpadded, every run of padding is reported, along with the
+	// bytes sorting the fields by decreasing alignment would save, so more of
+	// them fit in a cache line.
+	bool layout_struct(struct_type_t& type, symbol_table_t& symbols) {
+		std::string name = "'struct " + type.tag + "'";
+		// A struct is invalid if it has no fields.
+		if (type.fields.empty()) {
+			die("struct " + name + " has no members", type.lineno, type.colno);
+			return false;
+		}
+		long offset = 0;
+		long sorted_size = 0;
+		type.alignment = 1;
+		for (int i = 0; i < type.fields.size(); i++) {
+			field_t& field = type.fields[i];
+			// A field is invalid if another field has the same identifier,
+			// or if it is of an incomplete struct type.
+			for (int j = 0; j < i; j++) {
+				if (type.fields[j].identifier == field.identifier) {
+					die("duplicate member '" + field.identifier + "'", field.lineno, field.colno);
+					return false;
+				}
+			}
+			if (is_struct(field.type) && !struct_types[field.type.tag].complete) {
+				die("field '" + field.identifier + "' has incomplete type '" + prettyprint_type(field.type) + "'", field.lineno, field.colno);
+				return false;
+			}
+			// An array field is invalid if it's length is not a positive
+			// constant.
+			if (field.length) {
+				if (!validate_expression(field.length, symbols) || !evaluate_constant(field.length, field.type.length) || field.type.length <= 0) {
+					die("array size is not a positive integer constant", field.length);
+					return false;
+				}
+			}
+			long alignment = natural_alignment(field.type);
+			long padding = -offset & (alignment - 1);
+			if (padding && warn_padded) {
+				warn("padding struct " + name + " with " + bytes_str(padding) + " to align '" + field.identifier + "' [-Wpadded]", field.lineno, field.colno);
+			}
+			field.offset = offset + padding;
+			offset = field.offset + type_size(field.type);
+			sorted_size += type_size(field.type);
+			type.alignment = std::max(type.alignment, alignment);
+		}
+		type.size = (offset + type.alignment - 1) & -type.alignment;
+		sorted_size = (sorted_size + type.alignment - 1) & -type.alignment;
+		if (type.size != offset && warn_padded) {
+			warn("padding size of " + name + " with " + bytes_str(type.size - offset) + " to alignment boundary [-Wpadded]", type.lineno, type.colno);
+		}
+		// Sorting the fields by decreasing alignment leaves no padding
+		// between them, since every size is a multiple of the alignment.
+		if (sorted_size < type.size && warn_padded) {
+			report("note", bold_black, "sorting the fields of " + name + " by decreasing alignment would make it " + bytes_str(type.size - sorted_size) + " smaller", type.lineno, type.colno);
+		}
+		type.complete = true;
+		return true;
+	}
+
+	// Validate a variable declaration statement, at file scope or in a
+	// function.
+	bool validate_declaration(statement_t* statement, symbol_table_t& symbols, bool global) {
+		variable_declaration_statement_t& stmt = statement->variable_declaration_stmt;
+		// A variable declaration statement is invalid if it's identifier
+		// is a reserved identifier.
+		if (is_reserved(stmt.identifier)) {
+			die("cannot declare variable with reserved identifier '" + stmt.identifier + "'");
+			return false;
+		}
+		// A variable declaration statement is invalid if the variable, or
+		// it's elements, are of an incomplete struct type, or if a struct
+		// is initialized by anything but an initializer list.
+		if (is_struct(stmt.type) && !struct_types[stmt.type.tag].complete) {
+			die("variable has incomplete type '" + prettyprint_type(stmt.type) + "'", statement->lineno, statement->colno);
+			return false;
+		} else if (is_struct(stmt.type) && !stmt.is_array && stmt.initializer) {
+			die("struct initializer must be an initializer list", stmt.initializer);
+			return false;
+		}
+		if (stmt.is_array && !validate_array(statement, symbols, global)) {
+			return false;
+		} else if (is_struct(stmt.type) && !stmt.is_array && !validate_initializers(statement, symbols, global)) {
+			return false;
+		}
+		// A variable declaration statement is invalid if it's initializer
+		// is invalid.
+		if (stmt.initializer && !stmt.is_array) {
+			if (!validate_expression(stmt.initializer, symbols)) {
+				return false;
+			}
+		}
+		// A variable declaration statement is invalid if the type of it's
+		// initializer cannot be converted to it's declared type.
+		if (stmt.initializer && !stmt.is_array) {
+			type_t initializer_type = expression_type(stmt.initializer, symbols);
+			if (!can_convert(initializer_type, stmt.type)) {
+				die("no conversion from initializer value of type '" + prettyprint_type(initializer_type) + "' to variable type '" + prettyprint_type(stmt.type) + "'", stmt.initializer);
+				return false;
+			}
+		}
+		// A file-scope variable declaration is invalid if it's initializer
+		// is not a constant, or a string literal for a pointer. Constant
+		// initializers are folded into integer literals.
+		long value;
+		if (global && stmt.initializer && !stmt.is_array) {
+			if (evaluate_constant(stmt.initializer, value)) {
+				stmt.initializer = new expression_t(std::to_string(value), "int", stmt.initializer->lineno, stmt.initializer->colno);
+				expression_type(stmt.initializer, symbols);
+			} else if (stmt.initializer->type != et_string_literal || !is_pointer(stmt.type)) {
+				die("initializer element is not a compile-time constant", stmt.initializer);
+				return false;
+			}
+		}
+		// A variable declaration statement is invalid if a variable under
+		// the same identifier has already been declared in the current
+		// scope.
+		if (symbols.exists_locally(stmt.identifier)) {
+			die("redefinition of '" + stmt.identifier + "'");
+			return false;
+		}
+		// Add the variable to the current scope.
+		symbols.add_symbol(symbol_t(stmt.type, stmt.identifier));
 		return true;
 	}
 
@@ -535,6 +1004,12 @@ struct semantic_analyzer_t {
 			if (!validate_statement(stmt.body, new_symbols)) {
 				return false;
 			}
+			// A conditional statement is invalid if it's else body statement
+			// is invalid.
+			symbol_table_t else_symbols(&symbols);
+			if (stmt.else_body && !validate_statement(stmt.else_body, else_symbols)) {
+				return false;
+			}
 		} else if (statement->type == st_while) {
 			while_statement_t stmt = statement->while_stmt;
 			// A while statement is invalid if it's condition is invalid.
@@ -554,6 +1029,39 @@ struct semantic_analyzer_t {
 			if (!validate_statement(stmt.body, new_symbols)) {
 				return false;
 			}
+		} else if (statement->type == st_for) {
+			for_statement_t stmt = statement->for_stmt;
+			// A for statement is invalid if it's initializer, condition or
+			// step is invalid. The initializer is scoped to the statement.
+			symbol_table_t new_symbols(&symbols);
+			if (stmt.initializer && !validate_statement(stmt.initializer, new_symbols)) {
+				return false;
+			}
+			if (stmt.condition && !validate_condition(stmt.condition, new_symbols)) {
+				return false;
+			}
+			if (stmt.step && !validate_expression(stmt.step, new_symbols)) {
+				return false;
+			}
+			// A for statement is invalid if it's body statement is invalid.
+			symbol_table_t body_symbols(&new_symbols);
+			body_symbols.in_loop = true;
+			if (!validate_statement(stmt.body, body_symbols)) {
+				return false;
+			}
+		} else if (statement->type == st_do_while) {
+			do_while_statement_t stmt = statement->do_while_stmt;
+			// A do/while statement is invalid if it's body statement is
+			// invalid.
+			symbol_table_t new_symbols(&symbols);
+			new_symbols.in_loop = true;
+			if (!validate_statement(stmt.body, new_symbols)) {
+				return false;
+			}
+			// A do/while statement is invalid if it's condition is invalid.
+			if (!validate_condition(stmt.condition, symbols)) {
+				return false;
+			}
 		} else if (statement->type == st_return) {
 			return_statement_t stmt = statement->return_stmt;
 			// A return statement is invalid if it's value's type cannot be
@@ -568,45 +1076,67 @@ struct semantic_analyzer_t {
 				return false;
 			}
 		} else if (statement->type == st_variable_declaration) {
-			variable_declaration_statement_t stmt = statement->variable_declaration_stmt;
-			// A variable declaration statement is invalid if it's identifier
-			// is a reserved identifier.
-			if (is_reserved(stmt.identifier)) {
-				die("cannot declare variable with reserved identifier '" + stmt.identifier + "'");
+			return validate_declaration(statement, symbols, false);
+		} else if (statement->type == st_expression) {
+			expression_statement_t stmt = statement->expression_stmt;
+			// An expression statement is invalid if it's expression is
+			// invalid.
+			if (!validate_expression(stmt.expression, symbols)) {
 				return false;
 			}
-			// A variable declaration statement is invalid if it's initializer
-			// is invalid.
-			if (stmt.initializer) {
-				if (!validate_expression(stmt.initializer, symbols)) {
-					return false;
-				}
+		} else if (statement->type == st_switch) {
+			switch_statement_t stmt = statement->switch_stmt;
+			// A switch statement is invalid if it's value is invalid or
+			// cannot be converted to int.
+			if (!validate_condition(stmt.value, symbols)) {
+				return false;
 			}
-			// A variable declaration statement is invalid if the type of it's
-			// initializer cannot be converted to it's declared type.
-			if (stmt.initializer) {
-				type_t initializer_type = expression_type(stmt.initializer, symbols);
-				if (!can_convert(initializer_type, stmt.type)) {
-					die("no conversion from initializer value of type '" + prettyprint_type(initializer_type) + "' to variable type '" + prettyprint_type(stmt.type) + "'", stmt.initializer);
-					return false;
-				}
+			// A switch statement is invalid if it's body statement is
+			// invalid.
+			symbol_table_t new_symbols(&symbols);
+			new_symbols.in_switch = true;
+			switch_cases.push_back({});
+			switch_defaults.push_back(false);
+			if (!validate_statement(stmt.body, new_symbols)) {
+				return false;
 			}
-			// A variable declaration statement is invalid if a variable under
-			// the same identifier has already been declared in the current
-			// scope.
-			if (symbols.exists_locally(stmt.identifier)) {
-				die("redefinition of '" + stmt.identifier + "'");
+			switch_cases.pop_back();
+			switch_defaults.pop_back();
+		} else if (statement->type == st_case) {
+			case_statement_t& stmt = statement->case_stmt;
+			// A case label is invalid if it is encountered outside of a
+			// switch statement.
+			if (switch_cases.empty()) {
+				die("case label not within a switch statement", stmt.value);
 				return false;
 			}
-			// Add the variable to the current scope.
-			symbols.add_symbol(symbol_t(stmt.type, stmt.identifier));
-		} else if (statement->type == st_expression) {
-			expression_statement_t stmt = statement->expression_stmt;
-			// An expression statement is invalid if it's expression is
-			// invalid.
-			if (!validate_expression(stmt.expression, symbols)) {
+			// A case label is invalid if it's value is not a constant
+			// expression.
+			if (!validate_expression(stmt.value, symbols) || !evaluate_constant(stmt.value, stmt.constant)) {
+				die("case label does not reduce to an integer constant", stmt.value);
+				return false;
+			}
+			// A case label is invalid if the switch statement already has a
+			// case label with the same value.
+			std::vector<long>& cases = switch_cases.back();
+			if (std::find(cases.begin(), cases.end(), stmt.constant) != cases.end()) {
+				die("duplicate case value", stmt.value);
+				return false;
+			}
+			cases.push_back(stmt.constant);
+		} else if (statement->type == st_default) {
+			// A default label is invalid if it is encountered outside of a
+			// switch statement, or if the switch statement already has one.
+			if (switch_defaults.empty()) {
+				die("default label not within a switch statement", statement->lineno, statement->colno);
+				return false;
+			} else if (switch_defaults.back()) {
+				die("multiple default labels in one switch", statement->lineno, statement->colno);
 				return false;
 			}
+			switch_defaults.back() = true;
+		} else if (statement->type == st_break && !symbols.in_loop && symbols.in_switch) {
+			// A break statement within a switch statement is valid.
 		} else if (statement->type == st_break ||
 				   statement->type == st_continue) {
 			// A break or continue statement is invalid if it is encountered
@@ -626,6 +1156,17 @@ struct semantic_analyzer_t {
 	// Validate a function.
 	bool validate_function(function_t& function, symbol_table_t& global_symbols) {
 		symbol_table_t symbols(&global_symbols);
+		// A function is invalid if it takes or returns a struct by value.
+		if (is_struct(function.type)) {
+			die("function '" + function.identifier + "' returns a struct by value; return a pointer instead", function);
+			return false;
+		}
+		for (int i = 0; i < function.parameters.size(); i++) {
+			if (is_struct(function.parameters[i].type)) {
+				die("parameter '" + function.parameters[i].identifier + "' of function '" + function.identifier + "' is a struct passed by value; pass a pointer instead", function);
+				return false;
+			}
+		}
 		// Load the function parameters as symbols.
 		for (int i = 0; i < function.parameters.size(); i++) {
 			symbols.add_symbol(symbol_t(
@@ -660,22 +1201,39 @@ struct semantic_analyzer_t {
 		symbol_table_t global_symbols;
 		// Add the predefined function sizeof.
 		global_symbols.add_symbol(symbol_t(
-			{0}, "sizeof", {{{0}, ""}}
+			{0, ty_long}, "sizeof", {{{0}, ""}}
 		));
-		for (int i = 0; i < program.size(); i++) {
-			function_t function = program[i];
+		// Lay out the struct types, in the order they are defined.
+		for (int i = 0; i < program.structs.size(); i++) {
+			if (!layout_struct(struct_types[program.structs[i]], global_symbols)) {
+				return false;
+			}
+		}
+		// Add the file-scope variables, which every function can refer to.
+		for (int i = 0; i < program.globals.size(); i++) {
+			if (!validate_declaration(program.globals[i], global_symbols, true)) {
+				return false;
+			}
+		}
+		// Add every function to the symbol table before validating any of
+		// them, so a call to a function defined further down the file gets
+		// it's real return type.
+		for (int i = 0; i < program.functions.size(); i++) {
+			function_t function = program.functions[i];
 			// The function is invalid if a function already exists under the
 			// same identifier.
 			if (global_symbols.exists(function.identifier)) {
 				die("redefinition of function '" + function.identifier + "'", function);
 				return false;
 			}
-			// Add the function to the symbol table.
 			global_symbols.add_symbol(symbol_t(
 				function.type,
 				function.identifier,
 				function.parameters
 			));
+		}
+		for (int i = 0; i < program.functions.size(); i++) {
+			function_t function = program.functions[i];
 			if (!validate_function(function, global_symbols)) {
 				return false;
 			}
@@ -692,8 +1250,8 @@ struct semantic_analyzer_t {
 	//     - indexing expression expansion
 	//     - arithmetic assignment expression expansion
 	void expand_ast(program_t& program) {
-		for (int i = 0; i < program.size(); i++) {
-			expand_ast(program[i]);
+		for (int i = 0; i < program.functions.size(); i++) {
+			expand_ast(program.functions[i]);
 		}
 	}
 	void expand_ast(function_t& function) {
@@ -710,9 +1268,30 @@ struct semantic_analyzer_t {
 		} else if (statement->type == st_conditional) {
 			expand_ast(statement->conditional_stmt.condition);
 			expand_ast(statement->conditional_stmt.body);
+			if (statement->conditional_stmt.else_body) {
+				expand_ast(statement->conditional_stmt.else_body);
+			}
 		} else if (statement->type == st_while) {
 			expand_ast(statement->while_stmt.condition);
 			expand_ast(statement->while_stmt.body);
+		} else if (statement->type == st_for) {
+			for_statement_t& stmt = statement->for_stmt;
+			if (stmt.initializer) {
+				expand_ast(stmt.initializer);
+			}
+			if (stmt.condition) {
+				expand_ast(stmt.condition);
+			}
+			if (stmt.step) {
+				expand_ast(stmt.step);
+			}
+			expand_ast(stmt.body);
+		} else if (statement->type == st_do_while) {
+			expand_ast(statement->do_while_stmt.body);
+			expand_ast(statement->do_while_stmt.condition);
+		} else if (statement->type == st_switch) {
+			expand_ast(statement->switch_stmt.value);
+			expand_ast(statement->switch_stmt.body);
 		} else if (statement->type == st_return) {
 			expand_ast(statement->return_stmt.value);
 		} else if (statement->type == st_variable_declaration) {
@@ -720,6 +1299,9 @@ struct semantic_analyzer_t {
 			if (stmt.initializer) {
 				expand_ast(stmt.initializer);
 			}
+			for (int i = 0; i < stmt.initializers.size(); i++) {
+				expand_ast(stmt.initializers[i]);
+			}
 		} else if (statement->type == st_expression) {
 			expand_ast(statement->expression_stmt.expression);
 		}
@@ -748,7 +1330,8 @@ struct semantic_analyzer_t {
 				},
 				0, 0
 			);
-			expression->return_type = {array->return_type.pointer_depth - 1};
+			expression->unary.operand->return_type = arithmetic_type(bi_addition, array->return_type, index->return_type);
+			expression->return_type = element_type(expression->unary.operand->return_type);
 		} else if (expression->type == et_function_call) {
 			function_call_expression_t& expr = expression->function_call;
 			for (int i = 0; i < expr.arguments.size(); i++) {
@@ -757,6 +1340,7 @@ struct semantic_analyzer_t {
 		} else if (expression->type == et_binary) {
 			expand_ast(expression->binary.left_operand);
 			expand_ast(expression->binary.right_operand);
+			binary_operator_t op = expression->binary.binary_operator;
 			if (expression->binary.binary_operator == bi_addition_assignment) {
 				expression = new expression_t((binary_expression_t){expression->binary.left_operand, new expression_t((binary_expression_t){expression->binary.left_operand, expression->binary.right_operand, bi_addition}, 0, 0), bi_assignment}, 0, 0);
 			} else if (expression->binary.binary_operator == bi_subtraction_assignment) {
@@ -778,9 +1362,27 @@ struct semantic_analyzer_t {
 			} else if (expression->binary.binary_operator == bi_binary_right_shift_assignment) {
 				expression = new expression_t((binary_expression_t){expression->binary.left_operand, new expression_t((binary_expression_t){expression->binary.left_operand, expression->binary.right_operand, bi_binary_right_shift}, 0, 0), bi_assignment}, 0, 0);
 			}
-			expression->return_type = expression->binary.left_operand->return_type;
+			if (op != bi_assignment && expression->binary.binary_operator == bi_assignment) {
+				// The operation of an expanded arithmetic assignment is typed
+				// like any other, and the assignment like it's left operand.
+				binary_expression_t& operation = expression->binary.right_operand->binary;
+				type_t left_type = operation.left_operand->return_type;
+				type_t right_type = operation.right_operand->return_type;
+				if (operation.binary_operator == bi_binary_left_shift || operation.binary_operator == bi_binary_right_shift) {
+					expression->binary.right_operand->return_type = promoted_type(left_type);
+				} else {
+					expression->binary.right_operand->return_type = arithmetic_type(operation.binary_operator, left_type, right_type);
+				}
+				expression->return_type = expression->binary.left_operand->return_type;
+			}
 		} else if (expression->type == et_unary) {
 			expand_ast(expression->unary.operand);
+		} else if (expression->type == et_member) {
+			expand_ast(expression->member.object);
+		} else if (expression->type == et_ternary) {
+			expand_ast(expression->ternary.condition);
+			expand_ast(expression->ternary.if_true);
+			expand_ast(expression->ternary.if_false);
 		}
 	}
 };
\ No newline at end of file
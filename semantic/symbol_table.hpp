@@ -8,8 +8,9 @@ struct symbol_t {
 	std::vector<parameter_t> 	parameters;
 	bool						is_function = false;
 
-	// Only used by compiler.hpp.
-	long offset;
+	// Only used by ir/generator.hpp. The stack slot of a variable, or -1 for
+	// a file-scope variable.
+	long slot;
 
 	symbol_t(type_t type, identifier_t identifier) {
 		this->type = type;
@@ -23,11 +24,11 @@ struct symbol_t {
 		is_function = true;
 	}
 
-	// Only used by compiler.hpp.
-	symbol_t(type_t type, identifier_t identifier, long offset) {
+	// Only used by ir/generator.hpp.
+	symbol_t(type_t type, identifier_t identifier, long slot) {
 		this->type = type;
 		this->identifier = identifier;
-		this->offset = offset;
+		this->slot = slot;
 	}
 };
 
@@ -38,9 +39,9 @@ struct symbol_table_t {
 
 	// Only used by semantic_analyzer.hpp.
 	bool in_loop = false;
+	bool in_switch = false;
 
-	// Only used by compiler.hpp.
-	long offset = 0;
+	// Only used by ir/generator.hpp.
 	long loop_break_to = 0;
 	long loop_continue_to = 0;
 
@@ -49,7 +50,7 @@ struct symbol_table_t {
 		this->parent = parent;
 		if (parent) {
 			this->in_loop = parent->in_loop;
-			this->offset = parent->offset;
+			this->in_switch = parent->in_switch;
 			this->loop_break_to = parent->loop_break_to;
 			this->loop_continue_to = parent->loop_continue_to;
 		}
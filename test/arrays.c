@@ -0,0 +1,139 @@
+int puts(char* str) {
+	while (*str) {
+		putchar(*str);
+		str += 1;
+	}
+	return 0;
+}
+
+int putl(long n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		putl(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+int show(long n) {
+	putl(n);
+	return putchar('\n');
+}
+
+// File-scope arrays live in .data when initialized and in .bss otherwise.
+int primes[8] = {2, 3, 5, 7, 11, 13};
+long squares[] = {0, 1, 4, 9, 16, 25, 36, 49, 64, 81, 4294967296,};
+short shorts[4] = {-1, 40000, 7};
+char greeting[] = "hello, arrays\n";
+char* names[] = {"zero", "one", "two", "three"};
+int counts[100];
+
+// Sum the elements of an array passed as a pointer.
+long sum(int* values, int count) {
+	long total = 0;
+	for (int i = 0; i < count; i++) {
+		total += values[i];
+	}
+	return total;
+}
+
+// A leaf function with a local array, addressed from %rsp.
+int histogram(int seed) {
+	int buckets[16];
+	for (int i = 0; i < 16; i++) {
+		buckets[i] = 0;
+	}
+	for (int i = 0; i < 100; i++) {
+		seed = seed * 1103515245 + 12345;
+		buckets[(seed >> 16) & 15]++;
+	}
+	long address = buckets;
+	int most = 0;
+	for (int i = 1; i < 16; i++) {
+		if (buckets[i] > buckets[most]) {
+			most = i;
+		}
+	}
+	return most * 100 + buckets[most] + (address % 16) * 10000;
+}
+
+// Fill a local array and return the sum of every other element.
+long stride(long n) {
+	long values[32];
+	for (long i = 0; i < 32; i++) {
+		values[i] = i * n;
+	}
+	long total = 0;
+	long* p = values;
+	while (p < values + 32) {
+		total += *p;
+		p += 2;
+	}
+	return total;
+}
+
+int main() {
+	show(sum(primes, 8));
+	show(primes[5] * primes[4]);
+	show(primes[7]);
+	show(squares[10] + squares[9]);
+	show(sizeof(squares));
+	show(sizeof(primes) / sizeof(int));
+	show(shorts[0] + shorts[1] + shorts[2] + shorts[3]);
+	puts(greeting);
+	show(sizeof(greeting));
+	for (int i = 0; i < 4; i++) {
+		puts(names[i]);
+		putchar(' ');
+	}
+	putchar('\n');
+
+	// Zero-initialized globals start out zero and can be written.
+	for (int i = 0; i < 100; i++) {
+		counts[i * 7 % 100] += i;
+	}
+	show(counts[0] + counts[99] + counts[50]);
+	show(sum(counts, 100));
+
+	// Local arrays, with partial, full and computed initializers.
+	int small[5] = {1, -2, 3};
+	show(small[0] + small[1] + small[2] + small[3] + small[4]);
+	int k = 6;
+	int computed[] = {k, k * k, k * k * k, -k};
+	show(sum(computed, 4));
+	long wide[3] = {4294967297, -1, 2147483648};
+	show(wide[0] + wide[1] + wide[2]);
+	char word[] = "arrays";
+	show(sizeof(word));
+	word[0] = 'A';
+	puts(word);
+	putchar('\n');
+	char exact[3] = "abc";
+	show(exact[0] + exact[1] + exact[2]);
+
+	// A large array is cleared before it's nonzero elements are stored.
+	int large[40] = {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, k, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 5};
+	show(sum(large, 40));
+	show(large[10] * large[39]);
+	long address = large;
+	show(address % 16);
+
+	// An array decays to a pointer to it's first element.
+	int* first = small;
+	show(*first);
+	show(&small[2] - small);
+	show(*(small + 2));
+	int* same = &small;
+	show(same == first);
+	char letters[26];
+	for (int i = 0; i < 26; i++) {
+		letters[i] = 'a' + i;
+	}
+	show(letters[25] - letters[0]);
+
+	show(histogram(42));
+	show(stride(3));
+	return primes[2];
+}
@@ -0,0 +1,107 @@
+int puts(char* str) {
+	while (*str) {
+		putchar(*str);
+		str += 1;
+	}
+	return 0;
+}
+
+int puti(int n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		puti(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+int putn(int n) {
+	puti(n);
+	return putchar('\n');
+}
+
+// Count the characters of a string by pointer difference.
+int length(char* str) {
+	char* end = str;
+	while (*end) {
+		end++;
+	}
+	return end - str;
+}
+
+// Characters wrap around when they overflow.
+char next(char c) {
+	return c + 1;
+}
+
+// Copy a string backwards into a buffer.
+char* reverse(char* str) {
+	int n = length(str);
+	char* out = malloc(n + 1);
+	for (int i = 0; i < n; i++) {
+		out[i] = str[n - 1 - i];
+	}
+	out[n] = 0;
+	return out;
+}
+
+int main() {
+	puts("hello, \"bytes\" \\ world\x09!\n");
+	putn(length("a quick brown fox"));
+	putn(sizeof(char));
+	putn(sizeof(char*));
+	putn(sizeof(int));
+	putn(sizeof("four"));
+	char c = 250;
+	putn(c);
+	c += 10;
+	putn(c);
+	c = next(255);
+	putn(c);
+	char d = 'a';
+	d++;
+	putn(d);
+	putn(++d);
+	putn(d--);
+	putn(d);
+	char* high = "\xc8\x01";
+	putn(high[0] + high[1]);
+	puts(reverse("stressed"));
+	putchar('\n');
+	char* buffer = malloc(16);
+	for (int i = 0; i < 16; i++) {
+		buffer[i] = i * 37;
+	}
+	int sum = 0;
+	for (int i = 0; i < 16; i++) {
+		sum += buffer[i];
+	}
+	putn(sum);
+	buffer[3] = 1000;
+	putn(buffer[3]);
+	putn(buffer[2] = 300);
+	putn(*(buffer + 2));
+	char* p = buffer + 10;
+	putn(p - buffer);
+	putn(*--p);
+	putn(*p++);
+	putn(p - buffer);
+	int* words = malloc(80);
+	int* w = words + 7;
+	putn(w - words);
+	putn(words - w);
+	*w = 1234567890123;
+	putn(*(words + 7));
+	char** lines = malloc(3 * sizeof(char*));
+	lines[0] = "zero";
+	lines[1] = "one";
+	lines[2] = "two";
+	for (int i = 2; i >= 0; i--) {
+		puts(lines[i]);
+		putchar(' ');
+	}
+	putchar('\n');
+	return c;
+}
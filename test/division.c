@@ -0,0 +1,117 @@
+int puts(char* str) {
+	while (*str) {
+		putchar(*str);
+		str += 1;
+	}
+	return 0;
+}
+
+long puti(long n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		puti(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+// Divide through idivq, as the divisor is not a constant here.
+long divide(long n, long d) {
+	return n / d;
+}
+
+// Take the remainder through idivq.
+long modulo(long n, long d) {
+	return n % d;
+}
+
+// Check a division and modulo by a constant against idivq.
+long differ(long n, long d, long quotient, long remainder) {
+	return quotient != divide(n, d) || remainder != modulo(n, d);
+}
+
+// Count the constant divisors giving a different result than idivq for a
+// dividend.
+long check(long n) {
+	long failures = 0;
+	failures += differ(n, 1, n / 1, n % 1);
+	failures += differ(n, 2, n / 2, n % 2);
+	failures += differ(n, 3, n / 3, n % 3);
+	failures += differ(n, 5, n / 5, n % 5);
+	failures += differ(n, 6, n / 6, n % 6);
+	failures += differ(n, 7, n / 7, n % 7);
+	failures += differ(n, 8, n / 8, n % 8);
+	failures += differ(n, 10, n / 10, n % 10);
+	failures += differ(n, 24, n / 24, n % 24);
+	failures += differ(n, 60, n / 60, n % 60);
+	failures += differ(n, 64, n / 64, n % 64);
+	failures += differ(n, 365, n / 365, n % 365);
+	failures += differ(n, 641, n / 641, n % 641);
+	failures += differ(n, 1000, n / 1000, n % 1000);
+	failures += differ(n, 3600, n / 3600, n % 3600);
+	failures += differ(n, 86400, n / 86400, n % 86400);
+	failures += differ(n, 6700417, n / 6700417, n % 6700417);
+	failures += differ(n, 1000000007, n / 1000000007, n % 1000000007);
+	failures += differ(n, 2147483648, n / 2147483648, n % 2147483648);
+	failures += differ(n, 4294967296, n / 4294967296, n % 4294967296);
+	failures += differ(n, 4611686018427387904, n / 4611686018427387904, n % 4611686018427387904);
+	failures += differ(n, 9223372036854775807, n / 9223372036854775807, n % 9223372036854775807);
+	// Dividing the most negative long by -1 overflows, with or without a
+	// constant divisor.
+	if (n != -9223372036854775807 - 1) {
+		failures += differ(n, -1, n / -1, n % -1);
+	}
+	failures += differ(n, -2, n / -2, n % -2);
+	failures += differ(n, -3, n / -3, n % -3);
+	failures += differ(n, -7, n / -7, n % -7);
+	failures += differ(n, -8, n / -8, n % -8);
+	failures += differ(n, -10, n / -10, n % -10);
+	failures += differ(n, -64, n / -64, n % -64);
+	failures += differ(n, -641, n / -641, n % -641);
+	failures += differ(n, -1000000007, n / -1000000007, n % -1000000007);
+	failures += differ(n, -4611686018427387904, n / -4611686018427387904, n % -4611686018427387904);
+	failures += differ(n, -9223372036854775807, n / -9223372036854775807, n % -9223372036854775807);
+	return failures;
+}
+
+// Check the dividends around an edge value.
+long check_around(long edge) {
+	long failures = 0;
+	long delta = -3;
+	while (delta <= 3) {
+		failures += check(edge + delta);
+		delta += 1;
+	}
+	return failures;
+}
+
+int main() {
+	long failures = 0;
+	long n = -5000;
+	while (n <= 5000) {
+		failures += check(n);
+		n += 1;
+	}
+	long min = -9223372036854775807 - 1;
+	long max = 9223372036854775807;
+	failures += check(min);
+	failures += check(min + 1);
+	failures += check(min + 2);
+	failures += check(max);
+	failures += check(max - 1);
+	failures += check(max - 2);
+	failures += check_around(2147483648);
+	failures += check_around(-2147483648);
+	failures += check_around(4294967296);
+	failures += check_around(-4294967296);
+	failures += check_around(4611686018427387904);
+	failures += check_around(-4611686018427387904);
+	failures += check_around(1000000007 * 6700417);
+	failures += check_around(-1000000007 * 6700417);
+	puts("Failures: ");
+	puti(failures);
+	putchar('\n');
+	return failures != 0;
+}
@@ -1,5 +1,5 @@
-int* gets() {
-	int* str = malloc(256 * sizeof(int));
+char* gets() {
+	char* str = malloc(256 * sizeof(char));
 	int len = 0;
 	while ((str[len] = getchar()) != '\n') {
 		len += 1;
@@ -7,7 +7,7 @@ int* gets() {
 	return str;
 }
 
-int puts(int* str) {
+int puts(char* str) {
 	while (*str) {
 		putchar(*str);
 		str += 1;
@@ -17,7 +17,7 @@ int puts(int* str) {
 
 int main() {
 	while (1) {
-		int* str = gets();
+		char* str = gets();
 		puts(str);
 	}
 	return 0;
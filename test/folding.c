@@ -0,0 +1,16 @@
+// Counters in memory are updated with a single read-modify-write
+// instruction. At -O0 every local lives in it's stack slot, and both int
+// counters below must compile to
+//     addl    $1, offset(%rbp)
+// with no load into and store out of a register; `make check` pins this.
+int main() {
+	int count = 0;
+	int* address = &count;
+	for (int i = 0; i < 42; i++) {
+		count += 1;
+	}
+	putchar('0' + count / 10);
+	putchar('0' + *address % 10);
+	putchar('\n');
+	return 0;
+}
@@ -0,0 +1,98 @@
+int puts(char* str) {
+	while (*str) {
+		putchar(*str);
+		str += 1;
+	}
+	return 0;
+}
+
+int putl(long n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		putl(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+int show(long n) {
+	putl(n);
+	return putchar('\n');
+}
+
+// File-scope variables are shared by every function, without being passed
+// around.
+long calls;
+int depth = -1;
+int deepest;
+short level = 1000;
+char mark = 'a' + 2;
+long limit = 1 << 20;
+long big = 4294967296 * 3;
+char* banner = "globals\n";
+int* cursor;
+int table[4] = {10, 20, 30, 40};
+
+// Count the calls and track the deepest recursion.
+long fibonacci(long n) {
+	calls++;
+	depth += 1;
+	if (depth > deepest) {
+		deepest = depth;
+	}
+	long result = n < 2 ? n : fibonacci(n - 1) + fibonacci(n - 2);
+	depth--;
+	return result;
+}
+
+// A local variable shadows a file-scope one.
+int shadow(int depth) {
+	return depth * 2;
+}
+
+// Walk the table through a file-scope pointer.
+int next() {
+	int value = *cursor;
+	cursor++;
+	return value;
+}
+
+// Update a file-scope variable under a condition, with and without an else.
+int clamp(int value) {
+	if (value > 100) {
+		deepest = 100;
+	} else {
+		deepest = value;
+	}
+	if (value < 0) {
+		depth = 0;
+	}
+	return deepest;
+}
+
+int main() {
+	puts(banner);
+	show(fibonacci(20));
+	show(calls);
+	show(depth);
+	show(deepest);
+	show(shadow(21));
+	show(depth);
+	level += 30000;
+	show(level);
+	show(mark);
+	mark = 300;
+	show(mark);
+	show(limit + big);
+	cursor = table;
+	show(next() + next() * 100);
+	show(*cursor);
+	show(clamp(250));
+	show(clamp(-5));
+	show(depth);
+	banner = "done\n";
+	puts(banner);
+	return deepest + 5;
+}
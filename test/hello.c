@@ -1,4 +1,4 @@
-int puts(int* str) {
+int puts(char* str) {
 	while (*str) {
 		putchar(*str);
 		str += 1;
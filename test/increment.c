@@ -0,0 +1,68 @@
+int puti(int n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		puti(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+int show(int n) {
+	puti(n);
+	putchar(' ');
+	return 0;
+}
+
+// Sum an array, stepping the pointer past each element it reads.
+int sum(int* values, int count) {
+	int total = 0;
+	while (count--) {
+		total += *values++;
+	}
+	return total;
+}
+
+int main() {
+	int a = 5;
+	show(a++);
+	show(a);
+	show(++a);
+	show(a--);
+	show(--a);
+	show(a);
+	putchar('\n');
+	int* p = malloc(80);
+	for (int i = 0; i < 10; i++) {
+		p[i] = i * i;
+	}
+	show(sum(p, 10));
+	int* q = p;
+	q++;
+	show(*q);
+	show(*++q);
+	show(*q--);
+	show(*q);
+	p[3]++;
+	++p[3];
+	show(p[3]--);
+	show(p[3]);
+	int i = 0;
+	p[i++] = 100;
+	p[i++] = 200;
+	show(i);
+	show(p[0] + p[1]);
+	(*p)++;
+	show(*p);
+	putchar('\n');
+	int k = 0;
+	int n = 0;
+	while (k < 1000000) {
+		k++;
+		n += k & 1;
+	}
+	show(n);
+	putchar('\n');
+	return 0;
+}
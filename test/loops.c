@@ -0,0 +1,80 @@
+int puti(int n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		puti(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+int show(int n) {
+	puti(n);
+	return putchar('\n');
+}
+
+// Sum the odd numbers below a limit, skipping multiples of seven.
+int odd_sum(int limit) {
+	int sum = 0;
+	for (int i = 0; i < limit; i += 1) {
+		if (i % 2 == 0 || i % 7 == 0) {
+			continue;
+		}
+		sum += i;
+	}
+	return sum;
+}
+
+// Count the digits of a number, which has at least one.
+int digits(int n) {
+	int count = 0;
+	do {
+		count += 1;
+		n /= 10;
+	} while (n);
+	return count;
+}
+
+// Find the first power of two above a number.
+int next_power(int n) {
+	int power = 1;
+	for (;;) {
+		if (power > n) {
+			break;
+		}
+		power *= 2;
+	}
+	return power;
+}
+
+// Print a triangle of stars.
+int triangle(int rows) {
+	int row;
+	for (row = 1; row <= rows; row += 1) {
+		int column = 0;
+		while (column < row) {
+			putchar('*');
+			column += 1;
+		}
+		putchar('\n');
+	}
+	return rows;
+}
+
+int main() {
+	show(odd_sum(100));
+	show(digits(0));
+	show(digits(123456));
+	show(next_power(1000));
+	triangle(4);
+	int i = 10;
+	do {
+		i -= 3;
+	} while (i > 100);
+	show(i);
+	for (i = 0; i < 0; i += 1) {
+		show(i);
+	}
+	return 0;
+}
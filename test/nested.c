@@ -1,4 +1,4 @@
-int puts(int* str) {
+int puts(char* str) {
 	while (*str) {
 		putchar(*str);
 		str += 1;
@@ -21,7 +21,7 @@ int putn() {
 	return putchar('\n');
 }
 
-int putsin(int* str, int n) {
+int putsin(char* str, int n) {
 	puts(str);
 	puti(n);
 	return putn();
@@ -0,0 +1,108 @@
+int puti(int n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		puti(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+int show(int n) {
+	puti(n);
+	putchar(' ');
+	return 0;
+}
+
+int max(int a, int b) {
+	return a > b ? a : b;
+}
+
+int clamp(int n, int low, int high) {
+	return n < low ? low : n > high ? high : n;
+}
+
+int sign(int n) {
+	return n > 0 ? 1 : n < 0 ? -1 : 0;
+}
+
+// A branchy ternary, as the values may fault.
+int deref(int* p) {
+	return p ? *p : -1;
+}
+
+int classify(int n) {
+	int kind;
+	if (n % 2 == 0) {
+		kind = 2;
+	} else if (n % 3 == 0) {
+		kind = 3;
+	} else {
+		kind = 1;
+	}
+	return kind;
+}
+
+// Count the values below a pivot without branches.
+int below(int* values, int length, int pivot) {
+	int total = 0;
+	for (int i = 0; i < length; i++) {
+		if (values[i] < pivot) total += 1;
+	}
+	return total;
+}
+
+int absolute(int n) {
+	if (n < 0) n = -n;
+	return n;
+}
+
+int pick(int c, int a, int b) {
+	int x = 0;
+	if (c) x = a; else x = b;
+	return x;
+}
+
+int main() {
+	show(max(3, 7));
+	show(max(-3, -7));
+	show(clamp(5, 0, 10));
+	show(clamp(-5, 0, 10));
+	show(clamp(15, 0, 10));
+	show(sign(42));
+	show(sign(-42));
+	show(sign(0));
+	int v = 9;
+	show(deref(&v));
+	show(deref(0));
+	show(classify(4));
+	show(classify(9));
+	show(classify(7));
+	show(absolute(-12));
+	show(absolute(12));
+	show(pick(1, 5, 6));
+	show(pick(0, 5, 6));
+	putchar('\n');
+	int* values = malloc(800);
+	int seed = 12345;
+	for (int i = 0; i < 100; i++) {
+		seed = (seed * 1103515245 + 12345) % 2147483648;
+		values[i] = seed % 1000;
+	}
+	show(below(values, 100, 500));
+	show(below(values, 100, 100));
+	int x = 1;
+	int y = x > 0 ? x++ : x--;
+	show(x);
+	show(y);
+	int z = (x = 5) ? x : 0;
+	show(z);
+	show(1 ? 2 : 3);
+	show(0 ? 2 : 3);
+	int w = 0;
+	if (w++ == 0) w = w + 10;
+	show(w);
+	putchar('\n');
+	return 0;
+}
@@ -0,0 +1,17 @@
+short table[4];
+
+long add(long a, long b, long c, long d, long e, long f, long g, long h) {
+	return a + b + c + d + e + f + g + h;
+}
+
+// At -O0 the argument registers are live while the last argument is
+// evaluated, so the short load through a pointer and the indexed load of
+// table both have their address and destination spilled, and need
+// registers of the spiller's own.
+int main() {
+	short value = 1;
+	short* pointer = &value;
+	long x = 2;
+	table[1] = 5;
+	return add(x + 1, x + 2, x + 3, x + 4, x + 5, x + 6, x + 7, table[*pointer & 3] + x);
+}
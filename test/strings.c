@@ -0,0 +1,32 @@
+int puts(char* str) {
+	while (*str) {
+		putchar(*str);
+		str += 1;
+	}
+	return 0;
+}
+
+// Print a label and a value, reusing the same literals on every call.
+int show(char* label, char* value) {
+	puts(label);
+	puts(" = ");
+	puts(value);
+	puts("\n");
+	return 0;
+}
+
+int main() {
+	// Identical literals share one copy, and a literal ending another one
+	// shares it's tail, down to the empty string.
+	show("greeting", "hello, world");
+	show("tail", "world");
+	show("last", "d");
+	show("empty", "");
+	show("again", "hello, world");
+	show("long", "a string long enough to be aligned to sixteen bytes");
+	show("suffix", "sixteen bytes");
+	char* text = "escaped\t\"quotes\"\n";
+	puts(text);
+	puts("\"quotes\"\n");
+	return sizeof("hello, world");
+}
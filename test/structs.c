@@ -0,0 +1,158 @@
+int puts(char* str) {
+	while (*str) {
+		putchar(*str);
+		str += 1;
+	}
+	return 0;
+}
+
+int putl(long n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		putl(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+int show(long n) {
+	putl(n);
+	return putchar('\n');
+}
+
+// Fields are laid out in order, each aligned to it's size, so a char before
+// a long leaves 7 bytes of padding.
+struct point {
+	long x;
+	long y;
+};
+
+struct padded {
+	char tag;
+	long value;
+	short count;
+};
+
+struct sorted {
+	long value;
+	short count;
+	char tag;
+};
+
+// A struct of 12 bytes, whose arrays are indexed by a multiplication.
+struct triple {
+	int a;
+	int b;
+	int c;
+};
+
+struct rectangle {
+	struct point low;
+	struct point high;
+	char name[6];
+};
+
+struct node {
+	long value;
+	struct node* next;
+};
+
+struct point origin = {3, 4};
+struct rectangle frame = {1, 2, 30, 40};
+struct triple triples[] = {1, 2, 3, 4, 5, 6, 7};
+struct node* free_list;
+struct padded zeros;
+
+// Read a field through a pointer, with it's offset as a displacement.
+long area(struct rectangle* r) {
+	return (r->high.x - r->low.x) * (r->high.y - r->low.y);
+}
+
+// Walk a linked list.
+long total(struct node* list) {
+	long sum = 0;
+	while (list) {
+		sum += list->value;
+		list = list->next;
+	}
+	return sum;
+}
+
+// Push a node onto a list, returning the new head.
+struct node* push(struct node* list, long value) {
+	struct node* node = malloc(sizeof(struct node));
+	node->value = value;
+	node->next = list;
+	return node;
+}
+
+// Move a point by an offset, in place.
+int translate(struct point* p, long dx, long dy) {
+	p->x += dx;
+	p->y = p->y + dy;
+	return 0;
+}
+
+int main() {
+	show(sizeof(struct point));
+	show(sizeof(struct padded));
+	show(sizeof(struct sorted));
+	show(sizeof(struct triple));
+	show(sizeof(struct rectangle));
+	show(sizeof(frame.name));
+	show(sizeof(triples));
+
+	show(origin.x * 10 + origin.y);
+	translate(&origin, 10, 20);
+	show(origin.x * 100 + origin.y);
+	show(area(&frame));
+	frame.name[0] = 'r';
+	frame.name[1] = 0;
+	puts(frame.name);
+	putchar('\n');
+
+	// Local structs, with and without initializers.
+	struct point p = {5};
+	p.y = p.x * 2;
+	show(p.x + p.y);
+	struct padded q;
+	q.tag = 'q';
+	q.value = 4294967296;
+	q.count = -3;
+	show(q.tag + q.value + q.count);
+	struct rectangle box = {0, 0, p.x, p.y};
+	show(area(&box));
+	long* y = &box.high.y;
+	*y = 100;
+	show(box.high.y);
+	q.count++;
+	--q.count;
+	q.count += 10;
+	show(q.count);
+
+	// Arrays of structs and pointer arithmetic over them.
+	show(triples[2].a + triples[1].c + triples[2].b + triples[2].c);
+	struct triple* t = triples;
+	long sum = 0;
+	while (t < triples + 3) {
+		sum += t->a * 100 + t->b * 10 + t->c;
+		t++;
+	}
+	show(sum);
+	show(t - triples);
+	show(&triples[2] - &triples[0]);
+	int i = 1;
+	triples[i].b = 50;
+	show((triples + i)->b);
+
+	// A linked list on the heap.
+	for (long v = 1; v <= 10; v++) {
+		free_list = push(free_list, v * v);
+	}
+	show(total(free_list));
+	show(free_list->next->next->value);
+	show(zeros.tag + zeros.value + zeros.count);
+	return origin.y - 20;
+}
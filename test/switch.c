@@ -0,0 +1,167 @@
+int puts(char* str) {
+	while (*str) {
+		putchar(*str);
+		str += 1;
+	}
+	return 0;
+}
+
+int puti(long n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		puti(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+// Dense cases jump through a table, with a hole going to the default.
+int dense(int n) {
+	int result = 0;
+	switch (n) {
+	case 1:
+		result = 10;
+		break;
+	case 2:
+		result = 20;
+		break;
+	case 3:
+		result = 30;
+		break;
+	case 5:
+		result = 50;
+		break;
+	case 6:
+		return 60;
+	default:
+		result = -1;
+	}
+	return result;
+}
+
+// Sparse cases are found by a binary search.
+int sparse(long n) {
+	switch (n) {
+	case -1000000:
+		return 1;
+	case -7:
+		return 2;
+	case 0:
+		return 3;
+	case 100:
+		return 4;
+	case 4096:
+		return 5;
+	case 9223372036854775807:
+		return 6;
+	}
+	return 0;
+}
+
+// A small set of cases with few targets is tested as a bit set.
+int is_vowel(int c) {
+	int vowel = 0;
+	switch (c) {
+	case 'a':
+	case 'e':
+	case 'i':
+	case 'o':
+	case 'u':
+		vowel = 1;
+		break;
+	case 'y':
+		vowel = 2;
+	}
+	return vowel;
+}
+
+// Cases fall through to the next, and break leaves the switch only.
+int fall_through(int n) {
+	int result = 0;
+	switch (n) {
+	case 0:
+		result += 1;
+	case 1:
+		result += 10;
+	case 2:
+		result += 100;
+		break;
+	case 3:
+		result += 1000;
+	}
+	return result;
+}
+
+// Switch statements nest, and continue applies to the enclosing loop.
+int nested(int limit) {
+	int total = 0;
+	for (int i = 0; i < limit; i += 1) {
+		switch (i % 4) {
+		case 0:
+			continue;
+		case 1:
+			switch (i % 3) {
+			case 0:
+				total += 1;
+				break;
+			default:
+				total += 2;
+			}
+			break;
+		default:
+			for (int j = 0; j < 3; j += 1) {
+				if (j == i % 3) {
+					break;
+				}
+				total += 100;
+			}
+		}
+		total += 1000;
+	}
+	return total;
+}
+
+// A dense switch around a large first value.
+int offset(long n) {
+	switch (n - 4294967296) {
+	case 4294967296:
+		return 1;
+	case 4294967297:
+		return 2;
+	case 4294967298:
+		return 3;
+	case 4294967299:
+		return 4;
+	case 4294967300:
+		return 5;
+	}
+	return 0;
+}
+
+int main() {
+	long sum = 0;
+	int n = -10;
+	while (n <= 10) {
+		sum = sum * 3 + dense(n) + sparse(n) + fall_through(n);
+		n += 1;
+	}
+	puti(sum);
+	putchar('\n');
+	puti(sparse(-1000000) + sparse(4096) * 10 + sparse(9223372036854775807) * 100 + sparse(-9223372036854775807));
+	putchar('\n');
+	char* text = "a quick brown fox jumps over the lazy dog, mostly";
+	int vowels = 0;
+	while (*text) {
+		vowels += is_vowel(*text);
+		text += 1;
+	}
+	puti(vowels);
+	putchar('\n');
+	puti(nested(20));
+	putchar('\n');
+	puti(offset(8589934592) + offset(8589934596) * 10 + offset(8589934597) * 100 + offset(0) * 1000);
+	putchar('\n');
+	return 0;
+}
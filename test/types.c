@@ -0,0 +1,154 @@
+int puts(char* str) {
+	while (*str) {
+		putchar(*str);
+		str += 1;
+	}
+	return 0;
+}
+
+int putl(long n) {
+	if (n < 0) {
+		putchar('-');
+		n = -n;
+	}
+	if (n / 10) {
+		putl(n / 10);
+	}
+	return putchar(n % 10 + '0');
+}
+
+int show(long n) {
+	putl(n);
+	return putchar('\n');
+}
+
+// An int parameter takes the lower half of a long argument.
+int truncate(int n) {
+	return n;
+}
+
+// A short parameter takes the lower two bytes, sign-extended.
+long widen(short n) {
+	return n;
+}
+
+// Sum the elements of an int array, as a long.
+long sum(int* values, int count) {
+	long total = 0;
+	for (int i = 0; i < count; i++) {
+		total += values[i];
+	}
+	return total;
+}
+
+// Divide ints by constants and by variables.
+int divisions(int n, int d) {
+	return n / 7 + n % 7 * 10 + n / -4 * 100 + n / d * 1000 + n % d * 10000;
+}
+
+int main() {
+	show(sizeof(char));
+	show(sizeof(short));
+	show(sizeof(int));
+	show(sizeof(long));
+	show(sizeof(int*));
+	show(sizeof(short*));
+
+	// Int arithmetic wraps around at 32 bits, long arithmetic does not.
+	int big = 2147483647;
+	show(big + 1);
+	long wide = big;
+	show(wide + 1);
+	show(wide * 4);
+	show(big * 4);
+	int product = 65536;
+	product *= 65536;
+	show(product);
+	show(truncate(4294967297));
+	show(-2147483647 - 1);
+
+	// Shorts are sign-extended, chars zero-extended.
+	short s = 32767;
+	s += 1;
+	show(s);
+	show(widen(65535));
+	show(widen(-1));
+	s = -300;
+	char c = s;
+	show(c);
+	show(s >> 2);
+	s++;
+	show(s);
+	show(++s);
+	show(~s);
+
+	// Mixed comparisons convert to the wider type.
+	int negative = -1;
+	long zero = 0;
+	show(negative < zero);
+	show(negative < 4294967295);
+	show(big < 4294967295);
+	show(negative == 4294967295);
+
+	// Shifts and bitwise operators at 32 bits.
+	int one = 1;
+	show(one << 31);
+	show(one << 33);
+	show(zero + 1 << 33);
+	show(negative >> 28);
+	show(big ^ negative);
+	show((big & 65535) | 16777216);
+
+	// Divisions of ints.
+	show(divisions(100, 3));
+	show(divisions(-100, 3));
+	show(divisions(2147483647, -2));
+	show(divisions(-2147483647 - 1, 5));
+
+	// Int and short arrays are dense.
+	int* values = malloc(10 * sizeof(int));
+	for (int i = 0; i < 10; i++) {
+		values[i] = i * 1000000000;
+	}
+	show(sum(values, 10));
+	show(values[3]);
+	show(&values[7] - values);
+	short* halves = malloc(6 * sizeof(short));
+	halves[0] = 40000;
+	halves[1] = -2;
+	halves[2] = 70000;
+	show(halves[0] + halves[1] + halves[2]);
+	short* h = halves;
+	h++;
+	show(*h);
+	show(h - halves);
+	long* longs = malloc(3 * sizeof(long));
+	longs[0] = values[9];
+	longs[1] = 3000000000;
+	longs[2] = halves[0];
+	show(longs[0] + longs[1] + longs[2]);
+
+	// A ternary converts both values to a common type.
+	long picked = negative ? negative : 4294967296;
+	show(picked);
+	int flag = 0;
+	show(flag ? 4294967296 : big);
+
+	// A call to a function defined further down returns an int.
+	if (later(5) < 0) {
+		puts("negative\n");
+	}
+	long widened = later(5);
+	show(widened);
+	if (product) {
+		puts("nonzero\n");
+	} else {
+		puts("zero\n");
+	}
+	return truncate(4294967296 + 42);
+}
+
+// Defined after it's caller.
+int later(int a) {
+	return a - 10;
+}
@@ -69,6 +69,32 @@ void prettyprint_expression(expression_t* expression, long tab_count) {
 		std::cout << tabs << T << "}," << std::endl;
 		std::cout << tabs << T << "operator: " << prettyprint_unary_operator(expression->unary.unary_operator) << std::endl;
 		std::cout << tabs << "}";
+	} else if (expression->type == et_ternary) {
+		std::cout << tabs << set_color(red) << "ternary expression" << set_color(reset) << " {" << std::endl;
+		std::cout << tabs << T << "condition: {" << std::endl;
+		prettyprint_expression(expression->ternary.condition, tab_count + 2);
+		std::cout << std::endl;
+		std::cout << tabs << T << "}," << std::endl;
+		std::cout << tabs << T << "if true: {" << std::endl;
+		prettyprint_expression(expression->ternary.if_true, tab_count + 2);
+		std::cout << std::endl;
+		std::cout << tabs << T << "}," << std::endl;
+		std::cout << tabs << T << "if false: {" << std::endl;
+		prettyprint_expression(expression->ternary.if_false, tab_count + 2);
+		std::cout << std::endl;
+		std::cout << tabs << T << "}" << std::endl;
+		std::cout << tabs << "}";
+	} else if (expression->type == et_member) {
+		std::cout << tabs << set_color(red) << "member expression" << set_color(reset) << " {" << std::endl;
+		std::cout << tabs << T << "object: {" << std::endl;
+		prettyprint_expression(expression->member.object, tab_count + 2);
+		std::cout << std::endl;
+		std::cout << tabs << T << "}," << std::endl;
+		std::cout << tabs << T << "member: " << set_color(yellow) << expression->member.member << set_color(reset) << "," << std::endl;
+		std::cout << tabs << T << "operator: " << (expression->member.arrow ? "->" : ".") << std::endl;
+		std::cout << tabs << "}";
+	} else if (expression->type == et_type_name) {
+		std::cout << tabs << set_color(red) << "type name expression" << set_color(reset) << ": " << set_color(yellow) << prettyprint_type(expression->return_type) << set_color(reset);
 	}
 }
 
@@ -94,6 +120,12 @@ void prettyprint_statement(statement_t* statement, long tab_count) {
 		std::cout << tabs << T << "body: {" << std::endl;
 		prettyprint_statement(statement->conditional_stmt.body, tab_count + 2);
 		std::cout << std::endl;
+		if (statement->conditional_stmt.else_body) {
+			std::cout << tabs << T << "}," << std::endl;
+			std::cout << tabs << T << "else body: {" << std::endl;
+			prettyprint_statement(statement->conditional_stmt.else_body, tab_count + 2);
+			std::cout << std::endl;
+		}
 		std::cout << tabs << T << "}" << std::endl;
 		std::cout << tabs << "}";
 	} else if (statement->type == st_while) {
@@ -124,6 +156,12 @@ void prettyprint_statement(statement_t* statement, long tab_count) {
 			std::cout << std::endl;
 			std::cout << tabs << T << "}" << std::endl;
 		}
+		for (int i = 0; i < statement->variable_declaration_stmt.initializers.size(); i++) {
+			std::cout << tabs << T << "element: {" << std::endl;
+			prettyprint_expression(statement->variable_declaration_stmt.initializers[i], tab_count + 2);
+			std::cout << std::endl;
+			std::cout << tabs << T << "}" << std::endl;
+		}
 		std::cout << tabs << "}";
 	} else if (statement->type == st_no_op) {
 		std::cout << tabs << set_color(red) << "no-op statement" << set_color(reset) << " {}";